@@ -2779,6 +2779,19 @@ std::vector<Option> get_global_options() {
     .set_description("")
     .add_see_also("osd_op_num_shards"),
 
+    Option("osd_op_shard_steal_high", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Queue depth at which idle threads of other op shards start helping a shard")
+    .set_long_description("When a shard's op queue reaches this many items, threads of other shards with nothing to do process its items too, under the shard's own locks so that per-PG ordering is preserved, until the queue drains to osd_op_shard_steal_low. 0 disables work stealing.")
+    .add_see_also("osd_op_shard_steal_low"),
+
+    Option("osd_op_shard_steal_low", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Queue depth under which other op shards stop helping a shard")
+    .add_see_also("osd_op_shard_steal_high"),
+
     Option("osd_skip_data_digest", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Do not store full-object checksums if the backend (bluestore) does its own checksums.  Only usable with all BlueStore OSDs."),
@@ -3262,6 +3275,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Update coding chunks by delta for small EC overwrites")
+    .set_long_description("For pools with allow_ec_overwrites and a jerasure or isa profile, an overwrite that stays within one stripe and touches few of its data chunks reads only those chunks and the coding chunks, and writes them back updated by the delta, instead of reading, re-encoding and writing the whole stripe."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -3583,6 +3601,11 @@ std::vector<Option> get_global_options() {
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
 
+    Option("osd_deep_scrub_store_checksums", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Have the object store verify its own checksums in place during deep scrub")
+    .set_long_description("Instead of reading object data back and hashing it, deep scrub asks the object store to verify the checksums it keeps against the device and derive the data digest from them.  The digest is the same either way, so replicas are compared as before; BlueStore reads each stride in device order and skips hashing the data a second time where its checksums are crc32c.  Stores without checksums of their own fall back to reading."),
+
     Option("osd_deep_scrub_update_digest_min_age", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(2_hr)
     .set_description("Update overall object digest only if object was last modified longer ago than this"),
@@ -4265,6 +4288,44 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Enables Linux io_uring API instead of libaio")
+    .set_long_description("KernelDevice falls back to libaio if ceph is built "
+                          "without liburing or the running kernel doesn't "
+                          "support io_uring.")
+    .add_see_also("bdev_ioring_sqthread_poll"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Use a kernel submission queue polling thread with io_uring")
+    .set_long_description("A kernel thread polls the submission queue, so that "
+                          "io submission doesn't need a syscall. This costs a "
+                          "CPU core per block device and requires "
+                          "CAP_SYS_ADMIN on kernels older than 5.11.")
+    .add_see_also("bdev_ioring"),
+
+    Option("bdev_aio_reap_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of aio contexts, each with its own completion thread, per block device")
+    .set_long_description("IOContexts are sharded across the contexts, so that "
+                          "completions of a fast device aren't bottlenecked on "
+                          "a single reaping thread.")
+    .add_see_also("bdev_aio_reap_cpus"),
+
+    Option("bdev_aio_reap_cpus", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("List of CPUs to pin aio completion threads to, e.g. 0-3,8")
+    .set_long_description("Completion threads are assigned CPUs from the list in "
+                          "a round-robin fashion. Threads are not pinned if "
+                          "the list is empty.")
+    .add_see_also("bdev_aio_reap_threads"),
+
     Option("bdev_block_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -4534,6 +4595,35 @@ std::vector<Option> get_global_options() {
     .set_description("Default bluestore_prefer_deferred_size for non-rotational (solid state) media")
     .add_see_also("bluestore_prefer_deferred_size"),
 
+    Option("bluestore_inline_data_max", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Keep data of objects up to this size inside their onode")
+    .set_long_description("Objects no larger than this are stored in the onode's metadata record instead of an allocated blob, which saves an allocation unit and a device read per object. An object moves out to a blob once it grows past the limit. The value is capped at bluestore_min_alloc_size, and 0 disables it. Writing the first inline object raises the store's min_compat_ondisk_format, after which releases without this feature refuse to mount it."),
+
+    Option("bluestore_tier_promote_heat", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Read heat at which a small object moves inline, onto the DB device")
+    .set_long_description("With a dedicated DB device, objects no larger than bluestore_inline_data_max whose decayed read count reaches this value are moved into their onode, and so onto the DB device, when they are next written. While the DB device is short of free space, no object moves there, and cold inline objects move back to the main device, in the background as well as when they are written. 0 disables tiering.")
+    .add_see_also("bluestore_inline_data_max")
+    .add_see_also("bluestore_tier_heat_half_life")
+    .add_see_also("bluestore_tier_db_min_free_ratio"),
+
+    Option("bluestore_tier_heat_half_life", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_min(1)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Seconds after which the read heat of an object halves")
+    .add_see_also("bluestore_tier_promote_heat"),
+
+    Option("bluestore_tier_db_min_free_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.3)
+    .set_min_max(0.0, 1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Free fraction of the DB device kept for BlueFS when tiering")
+    .add_see_also("bluestore_tier_promote_heat"),
+
     Option("bluestore_compression_mode", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("none")
     .set_enum_allowed({"none", "passive", "aggressive", "force"})
@@ -4584,6 +4674,12 @@ std::vector<Option> get_global_options() {
     .set_description("Default value of bluestore_compression_max_blob_size for non-rotational (solid state) media")
     .add_see_also("bluestore_compression_max_blob_size"),
 
+    Option("bluestore_compression_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of threads compressing the blobs of a write in parallel")
+    .set_long_description("When non-zero, the blobs of a single write are compressed concurrently by a dedicated pool of threads, with the submitting thread helping out; otherwise they are compressed one after another by the submitting thread. Takes effect on mount.")
+    .add_see_also("bluestore_compression_mode"),
+
     Option("bluestore_gc_enable_blob_threshold", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4638,6 +4734,12 @@ std::vector<Option> get_global_options() {
     .set_default(256)
     .set_description("Preallocated buffer for inline shards"),
 
+    Option("bluestore_extent_map_packed_encoding", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Encode extent map shards as packed fixed-width arrays")
+    .set_long_description("Extent map shards written with this enabled decode faster and are usually smaller, but cannot be read by releases that predate the encoding. Enabling it on a mounted store, or writing the first such shard, marks the store as unmountable by those releases. Shards in the older encoding remain readable and are converted as they are rewritten."),
+
     Option("bluestore_cache_trim_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.05)
     .set_description("How frequently we trim the bluestore cache"),
@@ -4648,8 +4750,25 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
-    .set_enum_allowed({"2q", "lru"})
-    .set_description("Cache replacement algorithm"),
+    .set_enum_allowed({"2q", "lru", "arc"})
+    .set_description("Cache replacement algorithm")
+    .set_long_description("'arc' adapts the share of recently and frequently "
+                          "used buffers to the workload; it applies to the "
+                          "buffer cache, onodes are always cached in LRU order."),
+
+    Option("bluestore_cache_pool_reservations", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Pools given a dedicated share of the onode and buffer caches")
+    .set_long_description("A list of <pool id>=<ratio> pairs, e.g. '1=.2 5=.1'. "
+                          "Each listed pool gets its own cache shards, sized "
+                          "to the given fraction of the meta and data caches, "
+                          "so that other pools can't evict its onodes and "
+                          "buffers.  The part of a reservation a pool doesn't "
+                          "use is lent to the shards shared by all other "
+                          "pools.  With cache autotuning the reserved bytes "
+                          "are requested at the highest priority.")
+    .add_see_also("bluestore_cache_autotune"),
 
     Option("bluestore_2q_cache_kin_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(.5)
@@ -4702,10 +4821,47 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("bitmap")
-    .set_enum_allowed({"bitmap", "stupid"})
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid"})
     .set_description("Allocator policy")
     .set_long_description("Allocator to use for bluestore.  Stupid should only be used for testing."),
 
+    Option("bluestore_avl_alloc_bf_threshold", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(131072)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Largest free extent size below which the avl allocator switches to best-fit")
+    .set_long_description("The avl allocator normally places new extents in a first-fit fashion "
+                          "next to the previous allocation of similar alignment, using the "
+                          "offset-ordered tree. Once the largest free extent becomes smaller "
+                          "than this value it searches the size-ordered tree for the best fit instead.")
+    .add_see_also("bluestore_avl_alloc_bf_free_pct"),
+
+    Option("bluestore_avl_alloc_bf_free_pct", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Free space percentage below which the avl allocator switches to best-fit")
+    .add_see_also("bluestore_avl_alloc_bf_threshold"),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Persist allocator state to BlueFS on clean shutdown")
+    .set_long_description("On clean umount BlueStore saves the list of free extents "
+                          "to BlueFS, and loads it at the next mount instead of "
+                          "rebuilding the allocator from the freelist. The snapshot "
+                          "is dropped as soon as the store is opened for writing, and "
+                          "is ignored when it is missing, corrupted or stale.")
+    .add_see_also("bluestore_allocator"),
+
+    Option("bluestore_hybrid_alloc_mem_cap", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(64_M)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Maximum RAM the hybrid allocator's range tree may use")
+    .set_long_description("The hybrid allocator tracks free extents in an AVL range tree "
+                          "until the tree reaches this amount of memory. Beyond that the "
+                          "smallest free extents are moved into a bitmap allocator, whose "
+                          "memory use does not depend on fragmentation. Both are accounted "
+                          "to the bluestore_alloc mempool.")
+    .add_see_also("bluestore_allocator"),
+
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(128)
     .set_description("Block (and bits) per database key"),
@@ -4726,6 +4882,30 @@ std::vector<Option> get_global_options() {
     .set_default(3)
     .set_description("max duration to force deferred submit"),
 
+    Option("bluestore_bulk_remove_collection", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Allow removing non-empty collections in bulk")
+    .set_long_description("When set, a collection may be removed along with the objects it still holds. Their onodes are hidden from any collection later created over the same hash range, and their keys and space are released by a background thread. PG removal uses this instead of deleting objects one by one.")
+    .add_see_also({"bluestore_bulk_remove_batch_objects",
+                   "bluestore_bulk_remove_sleep",
+                   "bluestore_bulk_remove_paused"}),
+
+    Option("bluestore_bulk_remove_batch_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(256)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Max number of objects reclaimed per transaction from collections removed in bulk"),
+
+    Option("bluestore_bulk_remove_sleep", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Time in seconds to sleep between batches of objects reclaimed from collections removed in bulk"),
+
+    Option("bluestore_bulk_remove_paused", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Pause reclaiming objects of collections removed in bulk"),
+
     Option("bluestore_rocksdb_options", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("compression=kNoCompression,max_write_buffer_number=4,min_write_buffer_number_to_merge=1,recycle_log_file_num=4,write_buffer_size=268435456,writable_file_max_buffer_size=0,compaction_readahead_size=2097152,max_background_compactions=2")
     .set_description("Rocksdb options"),
@@ -4736,7 +4916,8 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("A key of the form 'O(4,0-13)' spreads prefix O over 4 column families O-0 .. O-3, the one holding a key being chosen by a hash of the key bytes [0, 13); an omitted range hashes the whole key. Options for a single shard may be given with a key like 'O-2'. The layout is fixed when the OSD is created; use 'ceph-bluestore-tool reshard' to change it."),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4770,6 +4951,13 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_finalize_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min(1)
+    .set_description("Number of threads finalizing committed transactions")
+    .set_long_description("Committed transactions are handed from the kv sync thread to the finalize threads by collection, so that each collection's transactions are still completed in order. More than one thread helps when a single finalize thread cannot keep up with a fast device.")
+    .add_see_also("bluestore_sync_submit_transaction"),
+
     Option("bluestore_fsck_read_bytes_cap", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4779,6 +4967,16 @@ std::vector<Option> get_global_options() {
       .set_default(2)
       .set_description("Number of additional threads to perform quick-fix (shallow fsck) command"),
 
+    Option("bluestore_fsck_threads", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+      .set_default(2)
+      .set_description("Number of threads checking objects during regular and deep fsck")
+      .set_long_description("The object keyspace is split at collection "
+                            "boundaries and the ranges are checked in "
+                            "parallel.  Each thread keeps its own used blocks "
+                            "bitmap, which costs a bit per allocation unit "
+                            "of the main device.  Repair always runs on a "
+                            "single thread."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4806,6 +5004,17 @@ std::vector<Option> get_global_options() {
     .set_description("Default bluestore_throttle_cost_per_io for non-rotation (solid state) media")
     .add_see_also("bluestore_throttle_cost_per_io"),
 
+    Option("bluestore_deferred_aggregate", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Merge pending deferred writes of all sequencers into a single submission")
+    .set_long_description("When deferred writes are flushed, batches of all "
+                          "sequencers are sorted by disk offset together, so that "
+                          "adjacent writes from different PGs reach the device as "
+                          "one large IO. Otherwise each sequencer's batch is "
+                          "submitted separately.")
+    .add_see_also("bluestore_deferred_batch_ops")
+    .add_see_also("bluestore_max_defer_interval"),
+
     Option("bluestore_deferred_batch_ops", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -24,6 +24,7 @@
 #ifndef _ENC_DEC_H
 #define _ENC_DEC_H
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <map>
@@ -551,6 +552,92 @@ denc_signed_varint_lowz(T& v, It& p)
   }
 }
 
+// packed u32 array
+//
+// first byte: low 5 bits = how many low zero bits all elements share,
+// high 2 bits = element width (0 = all zero, 1 = 1 byte, 2 = 2 bytes,
+// 3 = 4 bytes) after shifting those bits out.  unlike a run of varints,
+// every element then decodes with the same fixed-width load and shift,
+// so the decode loop has no branches and vectorizes.
+inline void denc_packed_u32s(const uint32_t *v, size_t n, size_t& p) {
+  p += 1 + n * sizeof(uint32_t);
+}
+
+template<class It>
+inline std::enable_if_t<!is_const_iterator_v<It>>
+denc_packed_u32s(const uint32_t *v, size_t n, It& p) {
+  uint32_t all = 0;
+  for (size_t i = 0; i < n; ++i) {
+    all |= v[i];
+  }
+  unsigned shift = all ? ctz(all) : 0;
+  all >>= shift;
+  unsigned width = !all ? 0 : all <= 0xff ? 1 : all <= 0xffff ? 2 : 3;
+  get_pos_add<__u8>(p) = shift | (width << 6);
+  switch (width) {
+  case 1:
+    {
+      auto d = reinterpret_cast<__u8*>(p.get_pos_add(n));
+      for (size_t i = 0; i < n; ++i) {
+	d[i] = v[i] >> shift;
+      }
+    }
+    break;
+  case 2:
+    {
+      auto d = reinterpret_cast<ceph_le16*>(p.get_pos_add(n * 2));
+      for (size_t i = 0; i < n; ++i) {
+	d[i] = v[i] >> shift;
+      }
+    }
+    break;
+  case 3:
+    {
+      auto d = reinterpret_cast<ceph_le32*>(p.get_pos_add(n * 4));
+      for (size_t i = 0; i < n; ++i) {
+	d[i] = v[i] >> shift;
+      }
+    }
+    break;
+  }
+}
+
+template<class It>
+inline std::enable_if_t<is_const_iterator_v<It>>
+denc_packed_u32s(uint32_t *v, size_t n, It& p) {
+  __u8 h = get_pos_add<__u8>(p);
+  unsigned shift = h & 0x1f;
+  switch (h >> 6) {
+  case 0:
+    std::fill(v, v + n, 0);
+    break;
+  case 1:
+    {
+      auto s = reinterpret_cast<const __u8*>(p.get_pos_add(n));
+      for (size_t i = 0; i < n; ++i) {
+	v[i] = (uint32_t)s[i] << shift;
+      }
+    }
+    break;
+  case 2:
+    {
+      auto s = reinterpret_cast<const ceph_le16*>(p.get_pos_add(n * 2));
+      for (size_t i = 0; i < n; ++i) {
+	v[i] = (uint32_t)s[i] << shift;
+      }
+    }
+    break;
+  case 3:
+    {
+      auto s = reinterpret_cast<const ceph_le32*>(p.get_pos_add(n * 4));
+      for (size_t i = 0; i < n; ++i) {
+	v[i] = (uint32_t)s[i] << shift;
+      }
+    }
+    break;
+  }
+}
+
 
 // LBA
 //
@@ -0,0 +1,320 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "ConcurrentSkipList.h"
+#include "include/ceph_assert.h"
+#include "include/intarith.h"
+
+// Arena
+
+unsigned ConcurrentSkipList::Arena::size_class(size_t n, size_t *rounded)
+{
+  ceph_assert(n > 0 && n <= max_chunk);
+  if (n <= 512) {
+    *rounded = p2roundup<size_t>(n, 16);
+    return *rounded / 16 - 1;
+  }
+  unsigned bits = 64 - __builtin_clzll(n - 1);
+  *rounded = size_t(1) << bits;
+  return 32 + bits - 10;
+}
+
+ConcurrentSkipList::Arena::~Arena()
+{
+  for (auto b : blocks) {
+    ::free(b);
+  }
+}
+
+void *ConcurrentSkipList::Arena::allocate(size_t n)
+{
+  if (n > max_chunk) {
+    void *p = ::malloc(n);
+    ceph_assert(p);
+    allocated_bytes.fetch_add(n, std::memory_order_relaxed);
+    return p;
+  }
+  size_t rounded;
+  unsigned c = size_class(n, &rounded);
+  if (free_lists[c]) {
+    void *p = free_lists[c];
+    free_lists[c] = *static_cast<void**>(p);
+    return p;
+  }
+  if (left < rounded) {
+    // the tail of the old block is wasted, it is less than max_chunk
+    pos = static_cast<char*>(::malloc(block_size));
+    ceph_assert(pos);
+    blocks.push_back(pos);
+    left = block_size;
+    allocated_bytes.fetch_add(block_size, std::memory_order_relaxed);
+  }
+  void *p = pos;
+  pos += rounded;
+  left -= rounded;
+  return p;
+}
+
+void ConcurrentSkipList::Arena::release(void *p, size_t n)
+{
+  if (n > max_chunk) {
+    ::free(p);
+    allocated_bytes.fetch_sub(n, std::memory_order_relaxed);
+    return;
+  }
+  size_t rounded;
+  unsigned c = size_class(n, &rounded);
+  *static_cast<void**>(p) = free_lists[c];
+  free_lists[c] = p;
+}
+
+// ConcurrentSkipList
+
+ConcurrentSkipList::ConcurrentSkipList()
+{
+  head = _new_node(std::string_view(), max_height, nullptr);
+}
+
+ConcurrentSkipList::~ConcurrentSkipList()
+{
+  // only allocations too large for the arena blocks need to be given back
+  // one by one, but walk everything for simplicity
+  for (auto& l : limbo) {
+    for (auto& p : l) {
+      arena.release(p.first, p.second);
+    }
+  }
+  Node *n = first();
+  while (n) {
+    Node *nx = next(n);
+    Value *v = n->value.load(std::memory_order_relaxed);
+    arena.release(v, _value_size(v->len));
+    arena.release(n, _node_size(n->height, n->key_len));
+    n = nx;
+  }
+}
+
+uint64_t ConcurrentSkipList::_enter() const
+{
+  for (;;) {
+    uint64_t e = epoch.load();
+    readers[e & 1].n.fetch_add(1);
+    // the writer may have moved on (and checked our slot) in between
+    if (epoch.load() == e) {
+      return e;
+    }
+    readers[e & 1].n.fetch_sub(1);
+  }
+}
+
+void ConcurrentSkipList::reclaim()
+{
+  if (limbo[0].empty() && limbo[1].empty()) {
+    return;
+  }
+  // What was retired during the previous epoch may still be seen by
+  // readers of that epoch, which share a slot with the next one; readers
+  // of the epoch before that were gone when we moved to this one.
+  uint64_t e = epoch.load(std::memory_order_relaxed);
+  auto& slot = limbo[(e + 1) & 1];
+  if (readers[(e + 1) & 1].n.load() != 0) {
+    return;
+  }
+  for (auto& p : slot) {
+    arena.release(p.first, p.second);
+  }
+  slot.clear();
+  epoch.store(e + 1);
+}
+
+size_t ConcurrentSkipList::_node_size(unsigned height, size_t key_len)
+{
+  return sizeof(Node) + (height - 1) * sizeof(std::atomic<Node*>) + key_len;
+}
+
+unsigned ConcurrentSkipList::_random_height()
+{
+  // one in four nodes goes up a level
+  unsigned h = 1;
+  while (h < max_height) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    if (rand_state & 3) {
+      break;
+    }
+    ++h;
+  }
+  return h;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::_new_node(
+  std::string_view key, unsigned height, Value *v)
+{
+  void *p = arena.allocate(_node_size(height, key.size()));
+  Node *n = new (p) Node;
+  n->value.store(v, std::memory_order_relaxed);
+  n->key_len = key.size();
+  n->height = height;
+  for (unsigned i = 0; i < height; ++i) {
+    new (&n->next[i]) std::atomic<Node*>(nullptr);
+  }
+  if (!key.empty()) {
+    memcpy(reinterpret_cast<char*>(n->next + height), key.data(), key.size());
+  }
+  return n;
+}
+
+ConcurrentSkipList::Value *ConcurrentSkipList::_new_value(
+  const char *data, uint32_t len)
+{
+  Value *v = static_cast<Value*>(arena.allocate(_value_size(len)));
+  v->len = len;
+  if (len) {
+    memcpy(v->data(), data, len);
+  }
+  return v;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::_find_ge(
+  std::string_view key, Node **prev) const
+{
+  Node *x = head;
+  unsigned level = height.load(std::memory_order_relaxed) - 1;
+  for (;;) {
+    Node *nx = x->next[level].load(std::memory_order_acquire);
+    if (nx && nx->key() < key) {
+      x = nx;
+    } else {
+      if (prev) {
+	prev[level] = x;
+      }
+      if (level == 0) {
+	return nx;
+      }
+      --level;
+    }
+  }
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::find(std::string_view key) const
+{
+  Node *n = _find_ge(key, nullptr);
+  return n && n->key() == key ? n : nullptr;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::lower_bound(
+  std::string_view key) const
+{
+  return _find_ge(key, nullptr);
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::upper_bound(
+  std::string_view key) const
+{
+  Node *n = _find_ge(key, nullptr);
+  if (n && n->key() == key) {
+    n = next(n);
+  }
+  return n;
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::last_before(
+  std::string_view key) const
+{
+  Node *x = head;
+  unsigned level = height.load(std::memory_order_relaxed) - 1;
+  for (;;) {
+    Node *nx = x->next[level].load(std::memory_order_acquire);
+    if (nx && nx->key() < key) {
+      x = nx;
+    } else if (level == 0) {
+      return x == head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::last() const
+{
+  Node *x = head;
+  unsigned level = height.load(std::memory_order_relaxed) - 1;
+  for (;;) {
+    Node *nx = x->next[level].load(std::memory_order_acquire);
+    if (nx) {
+      x = nx;
+    } else if (level == 0) {
+      return x == head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+bool ConcurrentSkipList::set(std::string_view key, const char *data,
+			     uint32_t len, uint32_t *old_len)
+{
+  Node *prev[max_height];
+  Node *x = _find_ge(key, prev);
+  Value *v = _new_value(data, len);
+  if (x && x->key() == key) {
+    Value *old = x->value.load(std::memory_order_relaxed);
+    x->value.store(v, std::memory_order_release);
+    *old_len = old->len;
+    _retire(old, _value_size(old->len));
+    return true;
+  }
+
+  unsigned h = _random_height();
+  unsigned cur = height.load(std::memory_order_relaxed);
+  if (h > cur) {
+    for (unsigned i = cur; i < h; ++i) {
+      prev[i] = head;
+    }
+    // readers that see the new height before the node just find nothing
+    // up there and drop down a level
+    height.store(h, std::memory_order_relaxed);
+  }
+  x = _new_node(key, h, v);
+  for (unsigned i = 0; i < h; ++i) {
+    x->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed),
+		     std::memory_order_relaxed);
+    prev[i]->next[i].store(x, std::memory_order_release);
+  }
+  return false;
+}
+
+bool ConcurrentSkipList::remove(std::string_view key, uint32_t *old_len)
+{
+  Node *prev[max_height];
+  Node *x = _find_ge(key, prev);
+  if (!x || x->key() != key) {
+    return false;
+  }
+  unlink_seq.fetch_add(1);
+  // readers standing on x keep walking through its own links, which we
+  // leave alone
+  for (unsigned i = x->height; i-- > 0; ) {
+    prev[i]->next[i].store(x->next[i].load(std::memory_order_relaxed),
+			   std::memory_order_release);
+  }
+  Value *v = x->value.load(std::memory_order_relaxed);
+  *old_len = v->len;
+  _retire(v, _value_size(v->len));
+  _retire(x, _node_size(x->height, x->key_len));
+  return true;
+}
@@ -0,0 +1,181 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_KV_CONCURRENTSKIPLIST_H
+#define CEPH_KV_CONCURRENTSKIPLIST_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Ordered map of byte strings with lock-free readers.
+ *
+ * Modifications (set, remove, reclaim) must be serialized by the caller.
+ * Lookups and scans may run concurrently with them from any number of
+ * threads, as long as they hold a ReadGuard for as long as they use the
+ * nodes and values they found.
+ *
+ * Nodes and values are carved out of an arena owned by the list.  What a
+ * writer unlinks or replaces is retired rather than freed, and handed
+ * back to the arena by reclaim() once every reader that could still see
+ * it has dropped its guard (epoch based reclamation).  Readers never
+ * block, and never block the writer.
+ */
+class ConcurrentSkipList {
+public:
+  struct Value {
+    uint32_t len;
+
+    const char *data() const {
+      return reinterpret_cast<const char*>(this + 1);
+    }
+    char *data() {
+      return reinterpret_cast<char*>(this + 1);
+    }
+  };
+
+  struct Node {
+    std::atomic<Value*> value;
+    uint32_t key_len;
+    uint32_t height;
+    std::atomic<Node*> next[1];  ///< height links, followed by the key
+
+    std::string_view key() const {
+      return std::string_view(reinterpret_cast<const char*>(next + height),
+			      key_len);
+    }
+  };
+
+  class ReadGuard {
+    const ConcurrentSkipList& sl;
+    uint64_t epoch;
+  public:
+    explicit ReadGuard(const ConcurrentSkipList& sl)
+      : sl(sl), epoch(sl._enter()) {}
+    ~ReadGuard() {
+      sl._exit(epoch);
+    }
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+  };
+
+  ConcurrentSkipList();
+  ~ConcurrentSkipList();
+  ConcurrentSkipList(const ConcurrentSkipList&) = delete;
+  ConcurrentSkipList& operator=(const ConcurrentSkipList&) = delete;
+
+  /// @name reads: under a ReadGuard, or from the writer
+  /// @{
+  Node *find(std::string_view key) const;
+  Node *lower_bound(std::string_view key) const;  ///< first key >= key
+  Node *upper_bound(std::string_view key) const;  ///< first key > key
+  Node *last_before(std::string_view key) const;  ///< last key < key
+  Node *first() const {
+    return head->next[0].load(std::memory_order_acquire);
+  }
+  Node *last() const;
+  static Node *next(const Node *n) {
+    return n->next[0].load(std::memory_order_acquire);
+  }
+  static const Value *value(const Node *n) {
+    return n->value.load(std::memory_order_acquire);
+  }
+
+  /// bumped before any node is unlinked; a reader that sees it unchanged
+  /// under a new guard may keep using a node it found under an old one
+  uint64_t get_unlink_seq() const {
+    return unlink_seq.load();
+  }
+  /// @}
+
+  /// @name writes: serialized by the caller
+  /// @{
+  /// insert or replace; return the length of the value replaced, if any
+  bool set(std::string_view key, const char *data, uint32_t len,
+	   uint32_t *old_len);
+  /// return the length of the value removed, if any
+  bool remove(std::string_view key, uint32_t *old_len);
+  /// give back to the arena what no reader can see anymore
+  void reclaim();
+  /// @}
+
+  uint64_t get_allocated_bytes() const {
+    return arena.get_allocated_bytes();
+  }
+
+private:
+  /// chunks of fixed size classes carved out of large blocks, single
+  /// threaded (only the writer allocates and frees)
+  class Arena {
+    static constexpr size_t block_size = 1 << 20;
+    static constexpr size_t max_chunk = block_size / 4;
+    static constexpr unsigned num_classes = 41;
+
+    std::vector<char*> blocks;
+    char *pos = nullptr;
+    size_t left = 0;
+    std::array<void*, num_classes> free_lists{};
+    std::atomic<uint64_t> allocated_bytes = {0};
+
+    static unsigned size_class(size_t n, size_t *rounded);
+
+  public:
+    ~Arena();
+    void *allocate(size_t n);
+    void release(void *p, size_t n);
+    uint64_t get_allocated_bytes() const {
+      return allocated_bytes.load(std::memory_order_relaxed);
+    }
+  };
+
+  static constexpr unsigned max_height = 12;
+
+  Arena arena;
+  Node *head;
+  std::atomic<unsigned> height = {1};
+  uint64_t rand_state = 0x2545f4914f6cdd1dull;
+
+  std::atomic<uint64_t> unlink_seq = {0};
+
+  // epoch based reclamation: readers count themselves in the slot of the
+  // epoch they entered in, the writer retires into the slot of the
+  // current epoch
+  std::atomic<uint64_t> epoch = {2};
+  struct alignas(64) ReaderCount {
+    std::atomic<int64_t> n = {0};
+  };
+  mutable std::array<ReaderCount, 2> readers;
+  std::array<std::vector<std::pair<void*, size_t>>, 2> limbo;
+
+  uint64_t _enter() const;
+  void _exit(uint64_t e) const {
+    readers[e & 1].n.fetch_sub(1);
+  }
+  void _retire(void *p, size_t n) {
+    limbo[epoch.load(std::memory_order_relaxed) & 1].emplace_back(p, n);
+  }
+
+  static size_t _node_size(unsigned height, size_t key_len);
+  static size_t _value_size(uint32_t len) {
+    return sizeof(Value) + len;
+  }
+  unsigned _random_height();
+  Node *_new_node(std::string_view key, unsigned height, Value *v);
+  Value *_new_value(const char *data, uint32_t len);
+  Node *_find_ge(std::string_view key, Node **prev) const;
+};
+
+#endif
@@ -171,6 +171,12 @@ public:
   /// Try to repair K/V database. leveldb and rocksdb require that database must be not opened.
   virtual int repair(std::ostream &out) { return 0; }
 
+  /// Move the keys of an open database to the column families in @cfs,
+  /// as given to create_and_open().  Must be re-run if interrupted.
+  virtual int reshard(const std::vector<ColumnFamily>& cfs, std::ostream& out) {
+    return -EOPNOTSUPP;
+  }
+
   virtual Transaction get_transaction() = 0;
   virtual int submit_transaction(Transaction) = 0;
   virtual int submit_transaction_sync(Transaction t) {
@@ -53,10 +53,11 @@ static string make_key(const string &prefix, const string &value)
   return out;
 }
 
-void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
+void MemDB::_encode(const mdb_map_t::Node *n, bufferlist &bl)
 {
-  encode(iter->first, bl);
-  encode(iter->second, bl);
+  encode(string(n->key()), bl);
+  const mdb_map_t::Value *v = mdb_map_t::value(n);
+  encode(bufferptr(v->data(), v->len), bl);
 }
 
 std::string MemDB::_get_data_fn()
@@ -79,11 +80,9 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  for (auto n = m_map.first(); n; n = mdb_map_t::next(n)) {
+    dout(10) << __func__ << " Key:"<< n->key() << dendl;
+    _encode(n, bl);
   }
   bl.write_fd(fd);
 
@@ -125,7 +124,10 @@ int MemDB::_load()
     bytes_done += ::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
+    uint32_t old_len;
+    if (m_map.set(key, datap.c_str(), datap.length(), &old_len)) {
+      m_total_bytes -= old_len;
+    }
     m_total_bytes += datap.length();
   }
   VOID_TEMP_FAILURE_RETRY(::close(fd));
@@ -172,7 +174,6 @@ int MemDB::set_merge_operator(
 int MemDB::do_open(ostream &out, bool create)
 {
   m_total_bytes = 0;
-  m_allocated_bytes = 1;
 
   return _init(create);
 }
@@ -214,6 +215,7 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
+  std::lock_guard<std::mutex> l(m_lock);
   for(auto& op : mt->get_ops()) {
     if(op.first == MDBTransactionImpl::WRITE) {
       ms_op_t set_op = op.second;
@@ -227,6 +229,7 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
       _rmkey(rm_op);
     }
   }
+  m_map.reclaim();
 
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_memdb_txns);
@@ -298,42 +301,30 @@ void MemDB::MDBTransactionImpl::merge(
 
 int MemDB::_setkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
 
   m_total_bytes += bl.length();
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    /*
-     * delete and free existing key.
-     */
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
-    m_map.erase(key);
+  uint32_t old_len;
+  if (m_map.set(key, bl.c_str(), bl.length(), &old_len)) {
+    ceph_assert(m_total_bytes >= old_len);
+    m_total_bytes -= old_len;
   }
-
-  m_map[key] = bufferptr((char *) bl.c_str(), bl.length());
-  iterator_seq_no++;
   return 0;
 }
 
 int MemDB::_rmkey(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    ceph_assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
+  uint32_t old_len;
+  if (!m_map.remove(key, &old_len)) {
+    return 0;
   }
-  iterator_seq_no++;
-  /*
-   * Erase will call the destructor for bufferptr.
-   */
-  return m_map.erase(key);
+  ceph_assert(m_total_bytes >= old_len);
+  m_total_bytes -= old_len;
+  return 1;
 }
 
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
@@ -351,7 +342,6 @@ std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::stri
 
 int MemDB::_merge(ms_op_t &op)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string prefix = op.first.first;
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
@@ -366,53 +356,52 @@ int MemDB::_merge(ms_op_t &op)
   /*
    * call the merge operator with value and non value
    */
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old) == false) {
-    std::string new_val;
+  /*
+   * The old value stays valid until the next reclaim(), which only we
+   * call.
+   */
+  std::string new_val;
+  uint32_t old_len;
+  mdb_map_t::Node *n = m_map.find(key);
+  if (!n) {
     /*
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
   } else {
     /*
      * Merge existing.
      */
-    std::string new_val;
-    mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
-    bytes_adjusted -= bl_old.length();
-    bl_old.clear();
+    const mdb_map_t::Value *v = mdb_map_t::value(n);
+    mop->merge(v->data(), v->len, bl.c_str(), bl.length(), &new_val);
+  }
+  if (m_map.set(key, new_val.c_str(), new_val.length(), &old_len)) {
+    bytes_adjusted -= old_len;
   }
 
   ceph_assert((int64_t)m_total_bytes + bytes_adjusted >= 0);
   m_total_bytes += bytes_adjusted;
-  iterator_seq_no++;
   return 0;
 }
 
 /*
- * Caller take btree lock.
+ * Lock-free; safe against a concurrent writer.
  */
 bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 {
   string key = make_key(prefix, k);
 
-  mdb_iter_t iter = m_map.find(key);
-  if (iter == m_map.end()) {
+  mdb_map_t::ReadGuard g(m_map);
+  mdb_map_t::Node *n = m_map.find(key);
+  if (!n) {
     return false;
   }
 
-  out->push_back((m_map[key].clone()));
+  const mdb_map_t::Value *v = mdb_map_t::value(n);
+  out->append(v->data(), v->len);
   return true;
 }
 
-bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
-{
-  std::lock_guard<std::mutex> l(m_lock);
-  return _get(prefix, k, out);
-}
-
 
 int MemDB::get(const string &prefix, const std::string& key,
                  bufferlist *out)
@@ -420,7 +409,7 @@ int MemDB::get(const string &prefix, const std::string& key,
   utime_t start = ceph_clock_now();
   int ret;
 
-  if (_get_locked(prefix, key, out)) {
+  if (_get(prefix, key, out)) {
     ret = 0;
   } else {
     ret = -ENOENT;
@@ -440,7 +429,7 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
 
   for (const auto& i : keys) {
     bufferlist bl;
-    if (_get_locked(prefix, i, &bl))
+    if (_get(prefix, i, &bl))
       out->insert(make_pair(i, bl));
   }
 
@@ -451,11 +440,23 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
   return 0;
 }
 
-void MemDB::MDBWholeSpaceIteratorImpl::fill_current()
+/*
+ * Called under a ReadGuard.
+ */
+int MemDB::MDBWholeSpaceIteratorImpl::fill_current(mdb_map_t::Node *n,
+						   uint64_t unlink_seq)
 {
+  free_last();
+  m_node = n;
+  if (!n) {
+    return -1;
+  }
+  m_unlink_seq = unlink_seq;
+  const mdb_map_t::Value *v = mdb_map_t::value(n);
   bufferlist bl;
-  bl.push_back(m_iter->second.clone());
-  m_key_value = std::make_pair(m_iter->first, bl);
+  bl.append(v->data(), v->len);
+  m_key_value = std::make_pair(string(n->key()), bl);
+  return 0;
 }
 
 bool MemDB::MDBWholeSpaceIteratorImpl::valid()
@@ -466,41 +467,6 @@ bool MemDB::MDBWholeSpaceIteratorImpl::valid()
   return true;
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::iterator_validate() {
-
-  if (this_seq_no != *global_seq_no) {
-    auto key = m_key_value.first;
-    ceph_assert(!key.empty());
-
-    bool restart_iter = false;
-    if (!m_using_btree) {
-      /*
-       * Map is modified and marker key does not exists, 
-       * restart the iterator from next key.
-       */
-      if (m_map_p->find(key) == m_map_p->end()) {
-        restart_iter = true;
-      }
-    } else {
-      restart_iter = true;
-    }
-
-    if (restart_iter) {
-      m_iter = m_map_p->lower_bound(key);
-      if (m_iter == m_map_p->end()) {
-        return false;
-      }
-    }
-
-    /*
-     * This iter is valid now.
-     */
-    this_seq_no = *global_seq_no;
-  }
-
-  return true;
-}
-
 void
 MemDB::MDBWholeSpaceIteratorImpl::free_last()
 {
@@ -539,36 +505,29 @@ bufferlist MemDB::MDBWholeSpaceIteratorImpl::value()
 
 int MemDB::MDBWholeSpaceIteratorImpl::next()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
+  if (!valid()) {
     return -1;
   }
-  free_last();
-  ++m_iter;
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  } else {
-    return -1;
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
+  if (seq == m_unlink_seq) {
+    return fill_current(mdb_map_t::next(m_node), seq);
   }
+  /*
+   * Something was removed since, possibly our entry: restart from the
+   * next key.
+   */
+  return fill_current(m_map_p->upper_bound(m_key_value.first), seq);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl:: prev()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
-    return -1;
-  }
-  free_last();
-  if (m_iter != m_map_p->begin()) {
-    --m_iter;
-    fill_current();
-    return 0;
-  } else {
+  if (!valid()) {
     return -1;
   }
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
+  return fill_current(m_map_p->last_before(m_key_value.first), seq);
 }
 
 /*
@@ -576,37 +535,22 @@ int MemDB::MDBWholeSpaceIteratorImpl:: prev()
  */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_first(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
   if (k.empty()) {
-    m_iter = m_map_p->begin();
-  } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-  
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    return fill_current(m_map_p->first(), seq);
   }
-  fill_current();
-  return 0;
+  return fill_current(m_map_p->lower_bound(k), seq);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
   if (k.empty()) {
-    m_iter = m_map_p->end();
-    --m_iter;
-  } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    return fill_current(m_map_p->last(), seq);
   }
-  fill_current();
-  return 0;
+  return fill_current(m_map_p->lower_bound(k), seq);
 }
 
 MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
@@ -617,27 +561,18 @@ MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
 int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
     const std::string &after) {
 
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-
   dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
   string k = make_key(prefix, after);
-  m_iter = m_map_p->upper_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
+  return fill_current(m_map_p->upper_bound(k), seq);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
     const std::string &to) {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
   dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
   string k = make_key(prefix, to);
-  m_iter = m_map_p->lower_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  mdb_map_t::ReadGuard g(*m_map_p);
+  uint64_t seq = m_map_p->get_unlink_seq();
+  return fill_current(m_map_p->lower_bound(k), seq);
 }
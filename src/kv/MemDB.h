@@ -18,6 +18,7 @@
 #include "include/encoding.h"
 #include "include/btree_map.h"
 #include "KeyValueDB.h"
+#include "ConcurrentSkipList.h"
 #include "osd/osd_types.h"
 
 using std::string;
@@ -37,14 +38,11 @@ enum {
 class MemDB : public KeyValueDB
 {
   typedef std::pair<std::pair<std::string, std::string>, bufferlist> ms_op_t;
+  /// serializes writers; readers go straight to the skiplist
   std::mutex m_lock;
-  uint64_t m_total_bytes;
-  uint64_t m_allocated_bytes;
-
-  typedef std::map<std::string, bufferptr> mdb_map_t;
-  typedef mdb_map_t::iterator mdb_iter_t;
-  bool m_using_btree;
+  std::atomic<uint64_t> m_total_bytes;
 
+  typedef ConcurrentSkipList mdb_map_t;
   mdb_map_t m_map;
 
   CephContext *m_cct;
@@ -57,17 +55,15 @@ class MemDB : public KeyValueDB
   int _open(ostream &out);
   void close() override;
   bool _get(const string &prefix, const string &k, bufferlist *out);
-  bool _get_locked(const string &prefix, const string &k, bufferlist *out);
   std::string _get_data_fn();
-  void _encode(mdb_iter_t iter, bufferlist &bl);
+  void _encode(const mdb_map_t::Node *n, bufferlist &bl);
   void _save();
   int _load();
-  uint64_t iterator_seq_no;
 
 public:
   MemDB(CephContext *c, const string &path, void *p) :
-    m_total_bytes(0), m_allocated_bytes(0), m_using_btree(false),
-    m_cct(c), logger(NULL), m_priv(p), m_db_path(path), iterator_seq_no(1)
+    m_total_bytes(0),
+    m_cct(c), logger(NULL), m_priv(p), m_db_path(path)
   {
     //Nothing as of now
   }
@@ -119,7 +115,7 @@ public:
 private:
 
   /*
-   * Transaction states.
+   * Transaction states, applied with m_lock held.
    */
   int _merge(const std::string &k, bufferptr &bl);
   int _merge(ms_op_t &op);
@@ -153,26 +149,20 @@ public:
 
   class MDBWholeSpaceIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
 
-      mdb_iter_t m_iter;
+      /*
+       * The current entry is copied out, so that nothing is pinned in the
+       * skiplist between calls.  m_node is only followed again if nothing
+       * was unlinked since it was found, otherwise we seek from the key.
+       */
+      mdb_map_t::Node *m_node = nullptr;
+      uint64_t m_unlink_seq = 0;
       std::pair<string, bufferlist> m_key_value;
       mdb_map_t *m_map_p;
-      std::mutex *m_map_lock_p;
-      uint64_t *global_seq_no;
-      uint64_t this_seq_no;
-      bool m_using_btree;
 
   public:
-    MDBWholeSpaceIteratorImpl(mdb_map_t *btree_p, std::mutex *btree_lock_p,
-                              uint64_t *iterator_seq_no, bool using_btree) {
-      m_map_p = btree_p;
-      m_map_lock_p = btree_lock_p;
-      std::lock_guard<std::mutex> l(*m_map_lock_p);
-      global_seq_no = iterator_seq_no;
-      this_seq_no = *iterator_seq_no;
-      m_using_btree = using_btree;
-    }
+    explicit MDBWholeSpaceIteratorImpl(mdb_map_t *map_p) : m_map_p(map_p) {}
 
-    void fill_current();
+    int fill_current(mdb_map_t::Node *n, uint64_t unlink_seq);
     void free_last();
 
 
@@ -185,7 +175,6 @@ public:
     int upper_bound(const std::string &prefix, const std::string &after) override;
     int lower_bound(const std::string &prefix, const std::string &to) override;
     bool valid() override;
-    bool iterator_validate();
 
     int next() override;
     int prev() override;
@@ -199,22 +188,20 @@ public:
   };
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
-      std::lock_guard<std::mutex> l(m_lock);
-      return m_allocated_bytes;
+      return m_map.get_allocated_bytes();
   };
 
   int get_statfs(struct store_statfs_t *buf) override {
-    std::lock_guard<std::mutex> l(m_lock);
     buf->reset();
     buf->total = m_total_bytes;
-    buf->allocated = m_allocated_bytes;
+    buf->allocated = m_map.get_allocated_bytes();
     buf->data_stored = m_total_bytes;
     return 0;
   }
 
   WholeSpaceIterator get_wholespace_iterator() override {
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
-      new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
+      new MDBWholeSpaceIteratorImpl(&m_map));
   }
 };
 
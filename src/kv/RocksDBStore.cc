@@ -18,6 +18,8 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
+#include "rocksdb/listener.h"
+#include "rocksdb/version.h"
 
 using std::string;
 #include "common/perf_counters.h"
@@ -25,6 +27,8 @@ using std::string;
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
+#include "include/ceph_hash.h"
+#include "common/strtol.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
 
@@ -77,6 +81,9 @@ public:
     for (auto& p : store.cf_handles) {
       names.erase(p.first);
     }
+    for (auto& p : store.cf_shards) {
+      names.erase(p.first);
+    }
     for (auto& p : names) {
       store.assoc_name += '.';
       store.assoc_name += p.first;
@@ -147,6 +154,31 @@ public:
   }
 };
 
+//
+// Keeps the per column family perf counters up to date.
+//
+class RocksDBStore::CFStatsListener : public rocksdb::EventListener
+{
+  RocksDBStore& store;
+public:
+  explicit CFStatsListener(RocksDBStore &_store) : store(_store) {}
+
+  void OnFlushCompleted(rocksdb::DB* db,
+			const rocksdb::FlushJobInfo& fi) override {
+    store.update_cf_stats(fi.cf_name, [](PerfCounters *l) {
+      l->inc(l_rocksdb_cf_flushes);
+    });
+  }
+  void OnCompactionCompleted(rocksdb::DB* db,
+			     const rocksdb::CompactionJobInfo& ci) override {
+    store.update_cf_stats(ci.cf_name, [&ci](PerfCounters *l) {
+      l->inc(l_rocksdb_cf_compactions);
+      l->inc(l_rocksdb_cf_compaction_read_bytes, ci.stats.total_input_bytes);
+      l->inc(l_rocksdb_cf_compaction_written_bytes, ci.stats.total_output_bytes);
+    });
+  }
+};
+
 int RocksDBStore::set_merge_operator(
   const string& prefix,
   std::shared_ptr<KeyValueDB::MergeOperator> mop)
@@ -310,6 +342,425 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+int RocksDBStore::parse_sharding(const std::string& name, cf_sharding_t *s)
+{
+  *s = cf_sharding_t();
+  auto p = name.find('(');
+  if (p == std::string::npos) {
+    s->prefix = name;
+    return name.empty() ? -EINVAL : 0;
+  }
+  if (p == 0 || name.back() != ')') {
+    return -EINVAL;
+  }
+  s->prefix = name.substr(0, p);
+  std::string args = name.substr(p + 1, name.size() - p - 2);
+  auto comma = args.find(',');
+  std::string err;
+  long long n = strict_strtoll(args.substr(0, comma).c_str(), 10, &err);
+  if (!err.empty() || n < 1 || n > 1024) {
+    return -EINVAL;
+  }
+  s->shards = n;
+  if (comma != std::string::npos) {
+    // hash range "l-h", where an omitted h stands for the end of the key
+    std::string range = args.substr(comma + 1);
+    auto dash = range.find('-');
+    if (dash == std::string::npos) {
+      return -EINVAL;
+    }
+    long long l = strict_strtoll(range.substr(0, dash).c_str(), 10, &err);
+    if (!err.empty() || l < 0) {
+      return -EINVAL;
+    }
+    s->hash_l = l;
+    if (dash + 1 < range.size()) {
+      long long h = strict_strtoll(range.substr(dash + 1).c_str(), 10, &err);
+      if (!err.empty() || h <= l || h > UINT32_MAX) {
+	return -EINVAL;
+      }
+      s->hash_h = h;
+    }
+  }
+  return 0;
+}
+
+std::string RocksDBStore::get_shard_name(const std::string& prefix, unsigned i)
+{
+  return prefix + "-" + stringify(i);
+}
+
+std::string RocksDBStore::get_sharding_spec(const cf_sharding_t& s)
+{
+  if (s.shards == 1) {
+    return s.prefix;
+  }
+  return s.prefix + "(" + stringify(s.shards) + "," + stringify(s.hash_l) +
+    "-" + (s.hash_h == UINT32_MAX ? std::string() : stringify(s.hash_h)) +
+    ")";
+}
+
+int RocksDBStore::parse_cfs(
+  const std::vector<ColumnFamily>& cfs,
+  std::map<std::string, cf_sharding_t> *layout,
+  std::map<std::string, std::vector<std::string>> *cf_options,
+  std::map<std::string, std::vector<ColumnFamily>> *specs)
+{
+  // the prefixes first, so that "O-2" can be told to be an option
+  // override for shard 2 of "O(4)" rather than a prefix of its own
+  std::vector<const ColumnFamily*> plain;
+  for (auto& p : cfs) {
+    cf_sharding_t s;
+    int r = parse_sharding(p.name, &s);
+    if (r < 0) {
+      derr << __func__ << " invalid column family '" << p.name << "'" << dendl;
+      return r;
+    }
+    if (p.name.find('(') == std::string::npos) {
+      plain.push_back(&p);
+      continue;
+    }
+    if (layout->count(s.prefix)) {
+      derr << __func__ << " column family '" << s.prefix
+	   << "' is given more than once" << dendl;
+      return -EINVAL;
+    }
+    (*layout)[s.prefix] = s;
+    if (specs) {
+      (*specs)[s.prefix].push_back(p);
+    }
+    if (s.shards == 1) {
+      (*cf_options)[s.prefix].push_back(p.option);
+    } else {
+      for (unsigned i = 0; i < s.shards; ++i) {
+	(*cf_options)[get_shard_name(s.prefix, i)].push_back(p.option);
+      }
+    }
+  }
+  for (auto p : plain) {
+    auto dash = p->name.rfind('-');
+    if (dash != std::string::npos) {
+      auto q = layout->find(p->name.substr(0, dash));
+      if (q != layout->end() && q->second.shards > 1) {
+	std::string err;
+	long long i = strict_strtoll(p->name.substr(dash + 1).c_str(), 10, &err);
+	if (!err.empty() || i < 0 || i >= q->second.shards) {
+	  derr << __func__ << " no such shard '" << p->name << "'" << dendl;
+	  return -EINVAL;
+	}
+	(*cf_options)[p->name].push_back(p->option);
+	if (specs) {
+	  (*specs)[q->first].push_back(*p);
+	}
+	continue;
+      }
+    }
+    if (layout->count(p->name)) {
+      derr << __func__ << " column family '" << p->name
+	   << "' is given more than once" << dendl;
+      return -EINVAL;
+    }
+    cf_sharding_t s;
+    s.prefix = p->name;
+    (*layout)[p->name] = s;
+    (*cf_options)[p->name].push_back(p->option);
+    if (specs) {
+      (*specs)[p->name].push_back(*p);
+    }
+  }
+  return 0;
+}
+
+rocksdb::ColumnFamilyOptions RocksDBStore::get_cf_options(
+  const std::string& cf_name)
+{
+  auto cf = get_cf_handle(cf_name);
+  for (auto& p : cf_shards) {
+    for (auto h : p.second.handles) {
+      if (h->GetName() == cf_name) {
+	cf = h;
+      }
+    }
+  }
+  return db->GetOptions(cf ? cf : default_cf);
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(
+  const std::string& prefix,
+  const char *key, size_t keylen)
+{
+  auto p = cf_shards.find(prefix);
+  if (p == cf_shards.end()) {
+    return get_cf_handle(prefix);
+  }
+  auto& s = p->second.sharding;
+  size_t l = std::min<size_t>(s.hash_l, keylen);
+  size_t h = std::min<size_t>(s.hash_h, keylen);
+  uint32_t hash = ceph_str_hash_rjenkins(key + l, h - l);
+  return p->second.handles[hash % p->second.handles.size()];
+}
+
+std::vector<rocksdb::ColumnFamilyHandle*> RocksDBStore::get_cf_handles(
+  const std::string& prefix)
+{
+  auto p = cf_shards.find(prefix);
+  if (p != cf_shards.end()) {
+    return p->second.handles;
+  }
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    return {cf};
+  }
+  return {};
+}
+
+int RocksDBStore::create_cfs(
+  const cf_sharding_t& s,
+  const rocksdb::ColumnFamilyOptions& base,
+  const std::map<std::string, std::vector<std::string>>& cf_options)
+{
+  std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  for (unsigned i = 0; i < s.shards; ++i) {
+    std::string name = s.shards > 1 ? get_shard_name(s.prefix, i) : s.prefix;
+    // copy default CF settings, block cache, merge operators as
+    // the base for new CF
+    rocksdb::ColumnFamilyOptions cf_opt(base);
+    // user input options will override the base options, the ones
+    // given for a single shard override those of its prefix
+    auto p = cf_options.find(name);
+    if (p != cf_options.end()) {
+      for (auto& o : p->second) {
+	auto status = rocksdb::GetColumnFamilyOptionsFromString(
+	  cf_opt, o, &cf_opt);
+	if (!status.ok()) {
+	  derr << __func__ << " invalid db column family option string for CF: "
+	       << name << dendl;
+	  return -EINVAL;
+	}
+      }
+    }
+    install_cf_mergeop(s.prefix, &cf_opt);
+    rocksdb::ColumnFamilyHandle *cf;
+    auto status = db->CreateColumnFamily(cf_opt, name, &cf);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << name << dendl;
+      return -EINVAL;
+    }
+    handles.push_back(cf);
+  }
+  if (s.shards > 1) {
+    cf_shards[s.prefix] = prefix_shards{s, handles};
+  } else {
+    // store the new CF handle
+    add_column_family(s.prefix, static_cast<void*>(handles.front()));
+  }
+  return 0;
+}
+
+void RocksDBStore::drop_cfs(const std::string& prefix)
+{
+  for (auto cf : get_cf_handles(prefix)) {
+    unregister_cf_stats(cf->GetName());
+    auto status = db->DropColumnFamily(cf);
+    if (!status.ok()) {
+      derr << __func__ << " failed to drop column family " << cf->GetName()
+	   << ": " << status.ToString() << dendl;
+    }
+    db->DestroyColumnFamilyHandle(cf);
+  }
+  cf_shards.erase(prefix);
+  cf_handles.erase(prefix);
+}
+
+rocksdb::Env *RocksDBStore::get_env()
+{
+  return env ? env : rocksdb::Env::Default();
+}
+
+int RocksDBStore::read_sharding_def(
+  std::map<std::string, cf_sharding_t> *layout,
+  std::map<std::string, std::vector<std::string>> *cf_options,
+  bool *resharding)
+{
+  auto e = get_env();
+  *resharding = e->FileExists(path + "/sharding/resharding").ok();
+  std::string def;
+  auto status = rocksdb::ReadFileToString(e, path + "/sharding/def", &def);
+  if (status.IsNotFound()) {
+    return 0;
+  }
+  if (!status.ok()) {
+    derr << __func__ << " failed to read sharding: " << status.ToString()
+	 << dendl;
+    return -EIO;
+  }
+  // the entries are in bluestore_rocksdb_cfs syntax
+  map<string,string> entries;
+  std::vector<ColumnFamily> cfs;
+  if (get_str_map(def, &entries, " \t\n") < 0) {
+    derr << __func__ << " invalid sharding '" << def << "'" << dendl;
+    return -EINVAL;
+  }
+  for (auto& [name, option] : entries) {
+    cfs.push_back(ColumnFamily(name, option));
+  }
+  cf_specs.clear();
+  int r = parse_cfs(cfs, layout, cf_options, &cf_specs);
+  if (r < 0) {
+    derr << __func__ << " invalid sharding '" << def << "'" << dendl;
+    return r;
+  }
+  dout(10) << __func__ << " " << def << (*resharding ? " (resharding)" : "")
+	   << dendl;
+  return 0;
+}
+
+int RocksDBStore::write_sharding_def()
+{
+  // the column families with the options they were given, as the config
+  // the db is opened with next may well not mention them
+  std::string def;
+  bool needed = !cf_shards.empty();
+  for (auto& p : cf_specs) {
+    for (auto& cf : p.second) {
+      if (!def.empty()) {
+	def += ' ';
+      }
+      def += cf.name + "=" + cf.option;
+      needed |= !cf.option.empty();
+    }
+  }
+  auto e = get_env();
+  std::string fn = path + "/sharding/def";
+  if (!needed && !e->FileExists(fn).ok()) {
+    // nothing is sharded or tuned, stay readable by older versions
+    return 0;
+  }
+  dout(10) << __func__ << " " << def << dendl;
+  auto status = e->CreateDirIfMissing(path + "/sharding");
+  if (status.ok()) {
+    // replace the old definition atomically
+    status = rocksdb::WriteStringToFile(e, def + "\n", fn + ".new", true);
+  }
+  if (status.ok()) {
+    status = e->RenameFile(fn + ".new", fn);
+  }
+  if (!status.ok()) {
+    derr << __func__ << " failed to write sharding: " << status.ToString()
+	 << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int RocksDBStore::mark_resharding(bool resharding)
+{
+  auto e = get_env();
+  std::string fn = path + "/sharding/resharding";
+  rocksdb::Status status;
+  if (resharding) {
+    status = e->CreateDirIfMissing(path + "/sharding");
+    if (status.ok()) {
+      status = rocksdb::WriteStringToFile(e, "", fn, true);
+    }
+  } else {
+    status = e->DeleteFile(fn);
+  }
+  if (!status.ok()) {
+    derr << __func__ << " " << resharding << ": " << status.ToString() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+void RocksDBStore::register_cf_stats(const std::string& cf_name,
+				     rocksdb::ColumnFamilyHandle *cf)
+{
+  PerfCountersBuilder b(cct, "rocksdb-cf-" + cf_name,
+			l_rocksdb_cf_first, l_rocksdb_cf_last);
+  b.add_u64_counter(l_rocksdb_cf_compactions, "compactions",
+		    "Compactions completed");
+  b.add_u64_counter(l_rocksdb_cf_compaction_read_bytes,
+		    "compaction_read_bytes", "Bytes read by compactions",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_rocksdb_cf_compaction_written_bytes,
+		    "compaction_written_bytes", "Bytes written by compactions",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_rocksdb_cf_flushes, "flushes", "Memtable flushes");
+  b.add_u64(l_rocksdb_cf_sst_bytes, "sst_bytes", "Size of live SST files",
+	    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64(l_rocksdb_cf_keys, "keys", "Estimated number of keys");
+  PerfCounters *l = b.create_perf_counters();
+  uint64_t v;
+  if (db->GetIntProperty(cf, "rocksdb.live-sst-files-size", &v)) {
+    l->set(l_rocksdb_cf_sst_bytes, v);
+  }
+  if (db->GetIntProperty(cf, "rocksdb.estimate-num-keys", &v)) {
+    l->set(l_rocksdb_cf_keys, v);
+  }
+  cct->get_perfcounters_collection()->add(l);
+  std::lock_guard sl(cf_stats_lock);
+  cf_stats[cf_name] = cf_stats_t{l, cf};
+}
+
+void RocksDBStore::unregister_cf_stats(const std::string& cf_name)
+{
+  PerfCounters *l;
+  {
+    std::unique_lock sl(cf_stats_lock);
+    auto p = cf_stats.find(cf_name);
+    // the handle may be destroyed once we return
+    while (p != cf_stats.end() && p->second.updating) {
+      cf_stats_cond.wait(sl);
+      p = cf_stats.find(cf_name);
+    }
+    if (p == cf_stats.end()) {
+      return;
+    }
+    l = p->second.logger;
+    cf_stats.erase(p);
+  }
+  cct->get_perfcounters_collection()->remove(l);
+  delete l;
+}
+
+void RocksDBStore::update_cf_stats(const std::string& cf_name,
+				   std::function<void(PerfCounters*)> f)
+{
+  rocksdb::ColumnFamilyHandle *cf;
+  {
+    std::lock_guard sl(cf_stats_lock);
+    auto p = cf_stats.find(cf_name);
+    if (p == cf_stats.end()) {
+      return;
+    }
+    f(p->second.logger);
+    cf = p->second.cf;
+    ++p->second.updating;
+  }
+
+  // the property queries take the DB mutex; don't make other column
+  // families' callbacks wait behind them
+  uint64_t sst_bytes, keys;
+  bool have_sst_bytes =
+    db->GetIntProperty(cf, "rocksdb.live-sst-files-size", &sst_bytes);
+  bool have_keys = db->GetIntProperty(cf, "rocksdb.estimate-num-keys", &keys);
+
+  std::lock_guard sl(cf_stats_lock);
+  auto p = cf_stats.find(cf_name);
+  ceph_assert(p != cf_stats.end());  // unregister_cf_stats waits for us
+  if (have_sst_bytes) {
+    p->second.logger->set(l_rocksdb_cf_sst_bytes, sst_bytes);
+  }
+  if (have_keys) {
+    p->second.logger->set(l_rocksdb_cf_keys, keys);
+  }
+  if (--p->second.updating == 0) {
+    cf_stats_cond.notify_all();
+  }
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -475,6 +926,16 @@ int RocksDBStore::do_open(ostream &out,
     dout(1) << __func__ << " load rocksdb options failed" << dendl;
     return r;
   }
+  std::map<std::string, cf_sharding_t> layout;
+  std::map<std::string, std::vector<std::string>> cf_options;
+  std::map<std::string, std::vector<ColumnFamily>> specs;
+  if (cfs) {
+    r = parse_cfs(*cfs, &layout, &cf_options, &specs);
+    if (r < 0) {
+      return r;
+    }
+  }
+  opt.listeners.push_back(std::make_shared<CFStatsListener>(*this));
   rocksdb::Status status;
   if (create_if_missing) {
     status = rocksdb::DB::Open(opt, path, &db);
@@ -482,34 +943,39 @@ int RocksDBStore::do_open(ostream &out,
       derr << status.ToString() << dendl;
       return -EINVAL;
     }
+    default_cf = db->DefaultColumnFamily();
     // create and open column families
-    if (cfs) {
-      for (auto& p : *cfs) {
-	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
-	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	// user input options will override the base options
-	status = rocksdb::GetColumnFamilyOptionsFromString(
-	  cf_opt, p.option, &cf_opt);
-	if (!status.ok()) {
-	  derr << __func__ << " invalid db column family option string for CF: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
+    for (auto& p : layout) {
+      r = create_cfs(p.second, rocksdb::ColumnFamilyOptions(opt), cf_options);
+      if (r < 0) {
+	return r;
       }
     }
-    default_cf = db->DefaultColumnFamily();
+    cf_specs = std::move(specs);
+    r = write_sharding_def();
+    if (r < 0) {
+      return r;
+    }
   } else {
+    std::map<std::string, cf_sharding_t> stored;
+    std::map<std::string, std::vector<std::string>> stored_options;
+    bool resharding = false;
+    r = read_sharding_def(&stored, &stored_options, &resharding);
+    if (r < 0) {
+      return r;
+    }
+    for (auto p = stored.begin(); p != stored.end(); ) {
+      if (p->second.shards < 2) {
+	p = stored.erase(p);
+      } else {
+	++p;
+      }
+    }
+    if (resharding && !kv_options.count("resharding")) {
+      derr << __func__ << " resharding of " << path << " was interrupted;"
+	   << " it must be completed with ceph-bluestore-tool reshard" << dendl;
+      return -EINVAL;
+    }
     std::vector<string> existing_cfs;
     status = rocksdb::DB::ListColumnFamilies(
       rocksdb::DBOptions(opt),
@@ -532,30 +998,57 @@ int RocksDBStore::do_open(ostream &out,
       // we cannot change column families for a created database.  so, map
       // what options we are given to whatever cf's already exist.
       std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+      // the sharded prefix and shard of each existing cf, if any
+      std::vector<std::pair<std::string, int>> shard_of;
       for (auto& n : existing_cfs) {
+	std::string prefix = n;
+	int shard = -1;
+	auto dash = n.rfind('-');
+	if (dash != std::string::npos) {
+	  auto q = stored.find(n.substr(0, dash));
+	  std::string err;
+	  long long i = strict_strtoll(n.substr(dash + 1).c_str(), 10, &err);
+	  if (q != stored.end() && err.empty() && i >= 0 &&
+	      i < q->second.shards) {
+	    prefix = q->first;
+	    shard = i;
+	  }
+	}
+	shard_of.emplace_back(prefix, shard);
 	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
+	// the base for new CF; then the options the cf was created with,
+	// then those we are given now, where a plain prefix we are given
+	// applies to all of its shards
 	rocksdb::ColumnFamilyOptions cf_opt(opt);
 	bool found = false;
-	if (cfs) {
-	  for (auto& i : *cfs) {
-	    if (i.name == n) {
-	      found = true;
-	      status = rocksdb::GetColumnFamilyOptionsFromString(
-		cf_opt, i.option, &cf_opt);
-	      if (!status.ok()) {
-		derr << __func__ << " invalid db column family options for CF '"
-		     << i.name << "': " << i.option << dendl;
-		return -EINVAL;
-	      }
-	    }
+	std::vector<std::string> opts;
+	for (auto from : {&stored_options, &cf_options}) {
+	  if (shard >= 0 && from == &cf_options &&
+	      layout.count(prefix) && layout[prefix].shards == 1) {
+	    auto& po = cf_options[prefix];
+	    opts.insert(opts.end(), po.begin(), po.end());
+	    found = true;
+	  }
+	  auto p = from->find(n);
+	  if (p != from->end()) {
+	    opts.insert(opts.end(), p->second.begin(), p->second.end());
+	    found = true;
+	  }
+	}
+	for (auto& o : opts) {
+	  status = rocksdb::GetColumnFamilyOptionsFromString(
+	    cf_opt, o, &cf_opt);
+	  if (!status.ok()) {
+	    derr << __func__ << " invalid db column family options for CF '"
+		 << n << "': " << o << dendl;
+	    return -EINVAL;
 	  }
 	}
 	if (n != rocksdb::kDefaultColumnFamilyName) {
-	  install_cf_mergeop(n, &cf_opt);
+	  install_cf_mergeop(prefix, &cf_opt);
 	}
 	column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
-	if (!found && n != rocksdb::kDefaultColumnFamilyName) {
+	if (!found && shard < 0 && n != rocksdb::kDefaultColumnFamilyName) {
 	  dout(1) << __func__ << " column family '" << n
 		  << "' exists but not expected" << dendl;
 	}
@@ -573,14 +1066,62 @@ int RocksDBStore::do_open(ostream &out,
 	derr << status.ToString() << dendl;
 	return -EINVAL;
       }
+      for (auto& p : stored) {
+	cf_shards[p.first] = prefix_shards{
+	  p.second,
+	  std::vector<rocksdb::ColumnFamilyHandle*>(p.second.shards, nullptr)};
+      }
       for (unsigned i = 0; i < existing_cfs.size(); ++i) {
 	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
 	  default_cf = handles[i];
 	  must_close_default_cf = true;
+	} else if (shard_of[i].second >= 0) {
+	  cf_shards[shard_of[i].first].handles[shard_of[i].second] = handles[i];
 	} else {
 	  add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
 	}
       }
+      for (auto& p : cf_shards) {
+	for (unsigned i = 0; i < p.second.handles.size(); ++i) {
+	  if (!p.second.handles[i]) {
+	    derr << __func__ << " column family "
+		 << get_shard_name(p.first, i) << " is missing" << dendl;
+	    return -EINVAL;
+	  }
+	}
+      }
+    }
+    // the layout can only be changed by resharding, say so if we are
+    // given a different one
+    std::map<std::string, cf_sharding_t> actual;
+    for (auto& p : cf_shards) {
+      actual[p.first] = p.second.sharding;
+    }
+    for (auto& p : cf_handles) {
+      actual[p.first].prefix = p.first;
+    }
+    if (!layout.empty()) {
+      std::string given, have;
+      bool sharded = false;
+      for (auto& [prefix, s] : layout) {
+	given += " " + get_sharding_spec(s);
+	auto q = actual.find(prefix);
+	sharded |= s.shards > 1 && (q == actual.end() || q->second != s);
+      }
+      for (auto& [prefix, s] : actual) {
+	have += " " + get_sharding_spec(s);
+	auto q = layout.find(prefix);
+	sharded |= s.shards > 1 && (q == layout.end() || q->second != s);
+      }
+      if (sharded) {
+	derr << __func__ << " column families given (" << given
+	     << " ) differ from those of the db (" << have << " ),"
+	     << " which are kept; use ceph-bluestore-tool reshard to change"
+	     << " them" << dendl;
+      } else if (layout != actual) {
+	dout(1) << __func__ << " column families given (" << given
+		<< " ) differ from those of the db (" << have << " )" << dendl;
+      }
     }
   }
   ceph_assert(default_cf != nullptr);
@@ -604,6 +1145,16 @@ int RocksDBStore::do_open(ostream &out,
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
+  register_cf_stats(rocksdb::kDefaultColumnFamilyName, default_cf);
+  for (auto& p : cf_handles) {
+    register_cf_stats(p.first, static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
+  }
+  for (auto& p : cf_shards) {
+    for (auto cf : p.second.handles) {
+      register_cf_stats(cf->GetName(), cf);
+    }
+  }
+
   if (compact_on_mount) {
     derr << "Compacting rocksdb store..." << dendl;
     compact();
@@ -634,6 +1185,14 @@ RocksDBStore::~RocksDBStore()
       static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
     p.second = nullptr;
   }
+  for (auto& p : cf_shards) {
+    for (auto& cf : p.second.handles) {
+      if (cf) {
+	db->DestroyColumnFamilyHandle(cf);
+	cf = nullptr;
+      }
+    }
+  }
   if (must_close_default_cf) {
     db->DestroyColumnFamilyHandle(default_cf);
     must_close_default_cf = false;
@@ -662,6 +1221,17 @@ void RocksDBStore::close()
 
   if (logger)
     cct->get_perfcounters_collection()->remove(logger);
+
+  std::vector<std::string> names;
+  {
+    std::lock_guard sl(cf_stats_lock);
+    for (auto& p : cf_stats) {
+      names.push_back(p.first);
+    }
+  }
+  for (auto& n : names) {
+    unregister_cf_stats(n);
+  }
 }
 
 int RocksDBStore::repair(std::ostream &out)
@@ -694,16 +1264,20 @@ void RocksDBStore::split_stats(const std::string &s, char delim, std::vector<std
 int64_t RocksDBStore::estimate_prefix_size(const string& prefix,
 					   const string& key_prefix)
 {
-  auto cf = get_cf_handle(prefix);
+  auto cfs = get_cf_handles(prefix);
   uint64_t size = 0;
   uint8_t flags =
     //rocksdb::DB::INCLUDE_MEMTABLES |  // do not include memtables...
     rocksdb::DB::INCLUDE_FILES;
-  if (cf) {
+  if (!cfs.empty()) {
     string start = key_prefix + string(1, '\x00');
     string limit = key_prefix + string("\xff\xff\xff\xff");
     rocksdb::Range r(start, limit);
-    db->GetApproximateSizes(cf, &r, 1, &size, flags);
+    for (auto cf : cfs) {
+      uint64_t s = 0;
+      db->GetApproximateSizes(cf, &r, 1, &s, flags);
+      size += s;
+    }
   } else {
     string start = combine_strings(prefix , key_prefix);
     string limit = combine_strings(prefix , key_prefix + "\xff\xff\xff\xff");
@@ -880,7 +1454,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
   } else {
@@ -894,7 +1468,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
     put_bat(bat, cf, key, to_set_bl);
@@ -908,7 +1482,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
   } else {
@@ -920,7 +1494,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
   } else {
@@ -933,7 +1507,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
   } else {
@@ -943,10 +1517,12 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
     string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
-    bat.DeleteRange(cf, string(), endprefix);
+    for (auto cf : cfs) {
+      bat.DeleteRange(cf, string(), endprefix);
+    }
   } else {
     string endprefix = prefix;
     endprefix.push_back('\x01');
@@ -960,9 +1536,11 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
-    bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
+    for (auto cf : cfs) {
+      bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+    }
   } else {
     bat.DeleteRange(
         db->default_cf,
@@ -976,7 +1554,7 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
     if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
@@ -1017,35 +1595,54 @@ int RocksDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
-  auto cf = get_cf_handle(prefix);
-  if (cf) {
+  // look all the keys up at once, so that rocksdb can share the block
+  // reads among them and issue those in parallel
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs;
+  std::vector<rocksdb::Slice> key_slices;
+  std::vector<string> combined;
+  cfs.reserve(keys.size());
+  key_slices.reserve(keys.size());
+  if (cf_shards.count(prefix) || get_cf_handle(prefix)) {
     for (auto& key : keys) {
-      std::string value;
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
+      cfs.push_back(get_cf_handle(prefix, key));
+      key_slices.emplace_back(key);
     }
   } else {
+    combined.reserve(keys.size());
     for (auto& key : keys) {
-      std::string value;
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
+      combined.push_back(combine_strings(prefix, key));
+      cfs.push_back(default_cf);
+      key_slices.emplace_back(combined.back());
+    }
+  }
+#if ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 4)
+  std::vector<rocksdb::PinnableSlice> values(keys.size());
+  std::vector<rocksdb::Status> statuses(keys.size());
+  db->MultiGet(rocksdb::ReadOptions(), keys.size(), cfs.data(),
+	       key_slices.data(), values.data(), statuses.data());
+  unsigned i = 0;
+  for (auto& key : keys) {
+    if (statuses[i].ok()) {
+      (*out)[key].append(values[i].data(), values[i].size());
+    } else if (statuses[i].IsIOError()) {
+      ceph_abort_msg(statuses[i].getState());
+    }
+    ++i;
+  }
+#else
+  std::vector<string> values;
+  auto statuses = db->MultiGet(rocksdb::ReadOptions(), cfs, key_slices,
+			       &values);
+  unsigned i = 0;
+  for (auto& key : keys) {
+    if (statuses[i].ok()) {
+      (*out)[key].append(values[i]);
+    } else if (statuses[i].IsIOError()) {
+      ceph_abort_msg(statuses[i].getState());
     }
+    ++i;
   }
+#endif
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
@@ -1062,7 +1659,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1099,7 +1696,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key, keylen);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1157,6 +1754,11 @@ void RocksDBStore::compact()
       static_cast<rocksdb::ColumnFamilyHandle*>(cf.second),
       nullptr, nullptr);
   }
+  for (auto& p : cf_shards) {
+    for (auto cf : p.second.handles) {
+      db->CompactRange(options, cf, nullptr, nullptr);
+    }
+  }
 }
 
 
@@ -1442,8 +2044,157 @@ public:
   }
 };
 
+//
+// Merges the column families a prefix is sharded over into a single
+// ordered view, all of them read at the same snapshot.
+//
+class ShardMergeIteratorImpl : public KeyValueDB::IteratorImpl {
+  string prefix;
+  rocksdb::DB *db;
+  const rocksdb::Snapshot *snapshot;
+  std::vector<rocksdb::Iterator*> iters;
+  rocksdb::Iterator *cur = nullptr;  ///< the shard at the current key
+  bool forward = true;
+
+  /// move to the least (or, going backward, the greatest) key of all shards
+  void pick() {
+    cur = nullptr;
+    for (auto it : iters) {
+      if (!it->Valid()) {
+	continue;
+      }
+      if (!cur) {
+	cur = it;
+	continue;
+      }
+      int c = it->key().compare(cur->key());
+      if (forward ? c < 0 : c > 0) {
+	cur = it;
+      }
+    }
+  }
+public:
+  ShardMergeIteratorImpl(const std::string& p,
+			 rocksdb::DB *db,
+			 const std::vector<rocksdb::ColumnFamilyHandle*>& cfs)
+    : prefix(p), db(db), snapshot(db->GetSnapshot()) {
+    rocksdb::ReadOptions options;
+    options.snapshot = snapshot;
+    for (auto cf : cfs) {
+      iters.push_back(db->NewIterator(options, cf));
+    }
+  }
+  ~ShardMergeIteratorImpl() {
+    for (auto it : iters) {
+      delete it;
+    }
+    db->ReleaseSnapshot(snapshot);
+  }
+
+  int seek_to_first() override {
+    for (auto it : iters) {
+      it->SeekToFirst();
+    }
+    forward = true;
+    pick();
+    return status();
+  }
+  int seek_to_last() override {
+    for (auto it : iters) {
+      it->SeekToLast();
+    }
+    forward = false;
+    pick();
+    return status();
+  }
+  int upper_bound(const string &after) override {
+    lower_bound(after);
+    if (valid() && (key() == after)) {
+      next();
+    }
+    return status();
+  }
+  int lower_bound(const string &to) override {
+    rocksdb::Slice slice_bound(to);
+    for (auto it : iters) {
+      it->Seek(slice_bound);
+    }
+    forward = true;
+    pick();
+    return status();
+  }
+  int next() override {
+    if (valid()) {
+      if (!forward) {
+	// the other shards sit before the current key, bring them past it
+	string k = cur->key().ToString();
+	for (auto it : iters) {
+	  if (it != cur) {
+	    it->Seek(k);
+	    if (it->Valid() && it->key() == k) {
+	      it->Next();
+	    }
+	  }
+	}
+	forward = true;
+      }
+      cur->Next();
+      pick();
+    }
+    return status();
+  }
+  int prev() override {
+    if (valid()) {
+      if (forward) {
+	string k = cur->key().ToString();
+	for (auto it : iters) {
+	  if (it != cur) {
+	    it->SeekForPrev(k);
+	    if (it->Valid() && it->key() == k) {
+	      it->Prev();
+	    }
+	  }
+	}
+	forward = false;
+      }
+      cur->Prev();
+      pick();
+    }
+    return status();
+  }
+  bool valid() override {
+    return cur != nullptr;
+  }
+  string key() override {
+    return cur->key().ToString();
+  }
+  std::pair<std::string, std::string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bufferlist value() override {
+    return to_bufferlist(cur->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = cur->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto it : iters) {
+      if (!it->status().ok()) {
+	return -1;
+      }
+    }
+    return 0;
+  }
+};
+
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
 {
+  auto p = cf_shards.find(prefix);
+  if (p != cf_shards.end()) {
+    return std::make_shared<ShardMergeIteratorImpl>(
+      prefix, db, p->second.handles);
+  }
   rocksdb::ColumnFamilyHandle *cf_handle =
     static_cast<rocksdb::ColumnFamilyHandle*>(get_cf_handle(prefix));
   if (cf_handle) {
@@ -1454,3 +2205,198 @@ KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
     return KeyValueDB::get_iterator(prefix);
   }
 }
+
+// keys are moved between column families in batches of about this size
+static constexpr uint64_t RESHARD_BATCH_BYTES = 16 << 20;
+
+int RocksDBStore::reshard_drain(const std::string& prefix,
+				rocksdb::ColumnFamilyHandle *cf,
+				uint64_t *moved)
+{
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  rocksdb::WriteBatch bat;
+  uint64_t bytes = 0;
+  std::unique_ptr<rocksdb::Iterator> it(
+    db->NewIterator(rocksdb::ReadOptions(), cf));
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    // a key is deleted along with its copy being written, so an
+    // interrupted move leaves no duplicates behind
+    bat.Put(default_cf, combine_strings(prefix, it->key().ToString()),
+	    it->value());
+    bat.Delete(cf, it->key());
+    bytes += it->key().size() + it->value().size();
+    ++*moved;
+    if (bytes >= RESHARD_BATCH_BYTES) {
+      auto status = db->Write(woptions, &bat);
+      if (!status.ok()) {
+	derr << __func__ << " " << status.ToString() << dendl;
+	return -EIO;
+      }
+      bat.Clear();
+      bytes = 0;
+    }
+  }
+  auto status = it->status();
+  if (status.ok() && bat.Count()) {
+    status = db->Write(woptions, &bat);
+  }
+  if (!status.ok()) {
+    derr << __func__ << " " << status.ToString() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int RocksDBStore::reshard_fill(const std::string& prefix, uint64_t *moved)
+{
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  rocksdb::WriteBatch bat;
+  uint64_t bytes = 0;
+  string start = combine_strings(prefix, string());
+  string end = past_prefix(prefix);
+  std::unique_ptr<rocksdb::Iterator> it(
+    db->NewIterator(rocksdb::ReadOptions(), default_cf));
+  for (it->Seek(start);
+       it->Valid() && it->key().compare(rocksdb::Slice(end)) < 0;
+       it->Next()) {
+    rocksdb::Slice k(it->key().data() + start.size(),
+		     it->key().size() - start.size());
+    bat.Put(get_cf_handle(prefix, k.data(), k.size()), k, it->value());
+    bat.Delete(default_cf, it->key());
+    bytes += it->key().size() + it->value().size();
+    ++*moved;
+    if (bytes >= RESHARD_BATCH_BYTES) {
+      auto status = db->Write(woptions, &bat);
+      if (!status.ok()) {
+	derr << __func__ << " " << status.ToString() << dendl;
+	return -EIO;
+      }
+      bat.Clear();
+      bytes = 0;
+    }
+  }
+  auto status = it->status();
+  if (status.ok() && bat.Count()) {
+    status = db->Write(woptions, &bat);
+  }
+  if (!status.ok()) {
+    derr << __func__ << " " << status.ToString() << dendl;
+    return -EIO;
+  }
+  if (*moved) {
+    // get rid of the tombstones left behind
+    rocksdb::Slice b(start), e(end);
+    db->CompactRange(rocksdb::CompactRangeOptions(), default_cf, &b, &e);
+  }
+  return 0;
+}
+
+int RocksDBStore::reshard(const std::vector<ColumnFamily>& cfs,
+			  std::ostream& out)
+{
+  ceph_assert(db);
+  std::map<std::string, cf_sharding_t> target;
+  std::map<std::string, std::vector<std::string>> target_options;
+  std::map<std::string, std::vector<ColumnFamily>> target_specs;
+  int r = parse_cfs(cfs, &target, &target_options, &target_specs);
+  if (r < 0) {
+    out << "invalid column families" << std::endl;
+    return r;
+  }
+  std::map<std::string, cf_sharding_t> current;
+  for (auto& p : cf_shards) {
+    current[p.first] = p.second.sharding;
+  }
+  for (auto& p : cf_handles) {
+    cf_sharding_t s;
+    s.prefix = p.first;
+    current[p.first] = s;
+  }
+  std::set<std::string> moving;
+  for (auto& p : current) {
+    auto q = target.find(p.first);
+    if (q == target.end() || q->second != p.second) {
+      moving.insert(p.first);
+    }
+  }
+  for (auto& p : target) {
+    if (!current.count(p.first)) {
+      moving.insert(p.first);
+    }
+  }
+  dout(1) << __func__ << " moving " << moving << dendl;
+
+  // opening the db is refused from now on until we are done
+  r = mark_resharding(true);
+  if (r < 0) {
+    return r;
+  }
+
+  // first bring every prefix that moves back to the default column family
+  for (auto& prefix : moving) {
+    if (!current.count(prefix)) {
+      continue;
+    }
+    uint64_t moved = 0;
+    for (auto cf : get_cf_handles(prefix)) {
+      r = reshard_drain(prefix, cf, &moved);
+      if (r < 0) {
+	out << "failed to move keys out of " << cf->GetName() << std::endl;
+	return r;
+      }
+    }
+    out << "moved " << moved << " keys of " << prefix
+	<< " to the default column family" << std::endl;
+    // forget about the old column families before they are dropped;
+    // if we crash in between they are just empty ones of no use
+    cf_specs.erase(prefix);
+    auto p = cf_shards.find(prefix);
+    if (p != cf_shards.end()) {
+      auto shards = std::move(p->second);
+      cf_shards.erase(p);
+      r = write_sharding_def();
+      cf_shards[prefix] = std::move(shards);
+    } else {
+      r = write_sharding_def();
+    }
+    if (r < 0) {
+      return r;
+    }
+    drop_cfs(prefix);
+  }
+
+  // then spread them over their new column families
+  rocksdb::ColumnFamilyOptions base(db->GetOptions(default_cf));
+  for (auto& p : target) {
+    if (moving.count(p.first)) {
+      r = create_cfs(p.second, base, target_options);
+      if (r < 0) {
+	out << "failed to create column families for " << p.first << std::endl;
+	return r;
+      }
+      for (auto cf : get_cf_handles(p.first)) {
+	register_cf_stats(cf->GetName(), cf);
+      }
+    }
+    // the options take effect on the next open of those that stay put
+    cf_specs[p.first] = target_specs[p.first];
+    r = write_sharding_def();
+    if (r < 0) {
+      return r;
+    }
+    // this also picks up what an interrupted run left behind
+    uint64_t moved = 0;
+    r = reshard_fill(p.first, &moved);
+    if (r < 0) {
+      out << "failed to move keys of " << p.first << std::endl;
+      return r;
+    }
+    if (moved || moving.count(p.first)) {
+      out << "moved " << moved << " keys of " << p.first << " to "
+	  << get_cf_handles(p.first).size() << " column families" << std::endl;
+    }
+  }
+  return mark_resharding(false);
+}
@@ -10,6 +10,9 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -47,6 +50,17 @@ enum {
   l_rocksdb_last,
 };
 
+enum {
+  l_rocksdb_cf_first = 34360,
+  l_rocksdb_cf_compactions,
+  l_rocksdb_cf_compaction_read_bytes,
+  l_rocksdb_cf_compaction_written_bytes,
+  l_rocksdb_cf_flushes,
+  l_rocksdb_cf_sst_bytes,
+  l_rocksdb_cf_keys,
+  l_rocksdb_cf_last,
+};
+
 namespace rocksdb{
   class DB;
   class Env;
@@ -87,13 +101,89 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+public:
+  /**
+   * How the keys of a prefix are placed.  A prefix given as
+   * "O(4,0-13)" is spread over 4 column families named O-0 .. O-3, the
+   * one holding a key being chosen by a hash of its bytes [0, 13); a
+   * plain "O" keeps the whole prefix in a column family named O.
+   */
+  struct cf_sharding_t {
+    std::string prefix;
+    uint32_t shards = 1;
+    uint32_t hash_l = 0;           ///< first key byte fed to the hash
+    uint32_t hash_h = UINT32_MAX;  ///< past the last one
+    bool operator==(const cf_sharding_t& o) const {
+      return prefix == o.prefix && shards == o.shards &&
+	hash_l == o.hash_l && hash_h == o.hash_h;
+    }
+    bool operator!=(const cf_sharding_t& o) const {
+      return !(*this == o);
+    }
+  };
+  static int parse_sharding(const std::string& name, cf_sharding_t *s);
+  static std::string get_shard_name(const std::string& prefix, unsigned i);
+  /// e.g. "O(4,0-13)", or just "O"
+  static std::string get_sharding_spec(const cf_sharding_t& s);
+  /// split @cfs into the prefix layout and the options of each column
+  /// family, and optionally into the entries describing each prefix
+  int parse_cfs(
+    const std::vector<ColumnFamily>& cfs,
+    std::map<std::string, cf_sharding_t> *layout,
+    std::map<std::string, std::vector<std::string>> *cf_options,
+    std::map<std::string, std::vector<ColumnFamily>> *specs = nullptr);
+  /// the options column family @cf_name was opened with
+  rocksdb::ColumnFamilyOptions get_cf_options(const std::string& cf_name);
+
+private:
+  /// the column families a sharded prefix is spread over
+  struct prefix_shards {
+    cf_sharding_t sharding;
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  };
+  std::unordered_map<std::string, prefix_shards> cf_shards;
+  /// the entries each prefix was created or last resharded with, which
+  /// are kept along with the layout
+  std::map<std::string, std::vector<ColumnFamily>> cf_specs;
+
+  // per column family compaction and size stats
+  class CFStatsListener;
+  struct cf_stats_t {
+    PerfCounters *logger = nullptr;
+    rocksdb::ColumnFamilyHandle *cf = nullptr;
+    unsigned updating = 0;  ///< update_cf_stats() calls using cf unlocked
+  };
+  ceph::mutex cf_stats_lock = ceph::make_mutex("RocksDBStore::cf_stats_lock");
+  ceph::condition_variable cf_stats_cond;
+  std::map<std::string, cf_stats_t> cf_stats;  ///< by column family name
+  void register_cf_stats(const std::string& cf_name,
+			 rocksdb::ColumnFamilyHandle *cf);
+  void unregister_cf_stats(const std::string& cf_name);
+  void update_cf_stats(const std::string& cf_name,
+		       std::function<void(PerfCounters*)> f);
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  int create_cfs(const cf_sharding_t& s,
+		 const rocksdb::ColumnFamilyOptions& base,
+		 const std::map<std::string, std::vector<std::string>>& cf_options);
+  void drop_cfs(const std::string& prefix);
   int create_db_dir();
   int do_open(ostream &out, bool create_if_missing, bool open_readonly,
 	      const vector<ColumnFamily>* cfs = nullptr);
   int load_rocksdb_options(bool create_if_missing, rocksdb::Options& opt);
 
+  // the layout of the sharded prefixes is kept next to the db
+  rocksdb::Env *get_env();
+  int read_sharding_def(std::map<std::string, cf_sharding_t> *layout,
+			std::map<std::string, std::vector<std::string>> *cf_options,
+			bool *resharding);
+  int write_sharding_def();
+  int mark_resharding(bool resharding);
+  int reshard_drain(const std::string& prefix, rocksdb::ColumnFamilyHandle *cf,
+		    uint64_t *moved);
+  int reshard_fill(const std::string& prefix, uint64_t *moved);
+
   // manage async compactions
   ceph::mutex compact_queue_lock =
     ceph::make_mutex("RocksDBStore::compact_thread_lock");
@@ -184,6 +274,17 @@ public:
     else
       return static_cast<rocksdb::ColumnFamilyHandle*>(iter->second);
   }
+  /// the column family holding @key, nullptr if it is in the default one
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const char *key, size_t keylen);
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const std::string& key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  /// all column families @prefix is placed in, none if the default one
+  std::vector<rocksdb::ColumnFamilyHandle*> get_cf_handles(
+    const std::string& prefix);
+  int reshard(const std::vector<ColumnFamily>& cfs, std::ostream& out) override;
   int repair(std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
@@ -2987,7 +2987,7 @@ bool OSDMonitor::prepare_mark_me_dead(MonOpRequestRef op)
   mon->clog->info() << "osd." << target_osd << " marked itself dead as of e"
 		    << m->get_epoch();
   if (!pending_inc.new_xinfo.count(target_osd)) {
-    pending_inc.new_xinfo[target_osd] = osdmap.osd_xinfo[target_osd];
+    pending_inc.new_xinfo[target_osd] = osdmap.get_xinfo(target_osd);
   }
   pending_inc.new_xinfo[target_osd].dead_epoch = m->get_epoch();
   wait_for_finished_proposal(
@@ -3195,7 +3195,7 @@ void OSDMonitor::force_failure(int target_osd, int by)
   dout(1) << " we're forcing failure of osd." << target_osd << dendl;
   pending_inc.new_state[target_osd] = CEPH_OSD_UP;
   if (!pending_inc.new_xinfo.count(target_osd)) {
-    pending_inc.new_xinfo[target_osd] = osdmap.osd_xinfo[target_osd];
+    pending_inc.new_xinfo[target_osd] = osdmap.get_xinfo(target_osd);
   }
   pending_inc.new_xinfo[target_osd].dead_epoch = pending_inc.epoch;
 
@@ -3537,7 +3537,7 @@ bool OSDMonitor::prepare_boot(MonOpRequestRef op)
     }
 
     if (pending_inc.new_xinfo.count(from) == 0)
-      pending_inc.new_xinfo[from] = osdmap.osd_xinfo[from];
+      pending_inc.new_xinfo[from] = osdmap.get_xinfo(from);
     osd_xinfo_t& xi = pending_inc.new_xinfo[from];
     if (m->boot_epoch == 0) {
       xi.laggy_probability *= (1.0 - g_conf()->mon_osd_laggy_weight);
@@ -4254,10 +4254,10 @@ bool OSDMonitor::prepare_beacon(MonOpRequestRef op)
     last_epoch_clean.report(pg, beacon->min_last_epoch_clean);
   }
 
-  if (osdmap.osd_xinfo[from].last_purged_snaps_scrub <
+  if (osdmap.get_xinfo(from).last_purged_snaps_scrub <
       beacon->last_purged_snaps_scrub) {
     if (pending_inc.new_xinfo.count(from) == 0) {
-      pending_inc.new_xinfo[from] = osdmap.osd_xinfo[from];
+      pending_inc.new_xinfo[from] = osdmap.get_xinfo(from);
     }
     pending_inc.new_xinfo[from].last_purged_snaps_scrub =
       beacon->last_purged_snaps_scrub;
@@ -5029,7 +5029,7 @@ void OSDMonitor::tick()
 
 	  // remember previous weight
 	  if (pending_inc.new_xinfo.count(o) == 0)
-	    pending_inc.new_xinfo[o] = osdmap.osd_xinfo[o];
+	    pending_inc.new_xinfo[o] = osdmap.get_xinfo(o);
 	  pending_inc.new_xinfo[o].old_weight = osdmap.osd_weight[o];
 
 	  do_propose = true;
@@ -11246,7 +11246,7 @@ bool OSDMonitor::prepare_command_impl(MonOpRequestRef op,
 	  }
 	  if (definitely_dead) {
 	    if (!pending_inc.new_xinfo.count(osd)) {
-	      pending_inc.new_xinfo[osd] = osdmap.osd_xinfo[osd];
+	      pending_inc.new_xinfo[osd] = osdmap.get_xinfo(osd);
 	    }
 	    if (pending_inc.new_xinfo[osd].dead_epoch < pending_inc.epoch) {
 	      any = true;
@@ -11261,7 +11261,7 @@ bool OSDMonitor::prepare_command_impl(MonOpRequestRef op,
 	    pending_inc.new_weight[osd] = CEPH_OSD_OUT;
 	    if (osdmap.osd_weight[osd]) {
 	      if (pending_inc.new_xinfo.count(osd) == 0) {
-	        pending_inc.new_xinfo[osd] = osdmap.osd_xinfo[osd];
+	        pending_inc.new_xinfo[osd] = osdmap.get_xinfo(osd);
 	      }
 	      pending_inc.new_xinfo[osd].old_weight = osdmap.osd_weight[osd];
 	    }
@@ -11285,10 +11285,10 @@ bool OSDMonitor::prepare_command_impl(MonOpRequestRef op,
             if (verbose)
 	      ss << "osd." << osd << " is already in. ";
 	  } else {
-	    if (osdmap.osd_xinfo[osd].old_weight > 0) {
-	      pending_inc.new_weight[osd] = osdmap.osd_xinfo[osd].old_weight;
+	    if (osdmap.get_xinfo(osd).old_weight > 0) {
+	      pending_inc.new_weight[osd] = osdmap.get_xinfo(osd).old_weight;
 	      if (pending_inc.new_xinfo.count(osd) == 0) {
-	        pending_inc.new_xinfo[osd] = osdmap.osd_xinfo[osd];
+	        pending_inc.new_xinfo[osd] = osdmap.get_xinfo(osd);
 	      }
 	      pending_inc.new_xinfo[osd].old_weight = 0;
 	    } else {
@@ -13794,7 +13794,7 @@ int OSDMonitor::_prepare_remove_pool(
     }
   }
   // remove any pg_upmap mappings for this pool
-  for (auto& p : osdmap.pg_upmap) {
+  for (auto& p : *osdmap.pg_upmap) {
     if (p.first.pool() == pool) {
       dout(10) << __func__ << " " << pool
                << " removing obsolete pg_upmap "
@@ -13817,7 +13817,7 @@ int OSDMonitor::_prepare_remove_pool(
     }
   }
   // remove any pg_upmap_items mappings for this pool
-  for (auto& p : osdmap.pg_upmap_items) {
+  for (auto& p : *osdmap.pg_upmap_items) {
     if (p.first.pool() == pool) {
       dout(10) << __func__ << " " << pool
                << " removing obsolete pg_upmap_items " << p.first
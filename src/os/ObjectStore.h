@@ -246,6 +246,7 @@ public:
   virtual void dump_perf_counters(ceph::Formatter *f) {}
   virtual void dump_cache_stats(ceph::Formatter *f) {}
   virtual void dump_cache_stats(std::ostream& os) {}
+  virtual void dump_cache_pool_stats(ceph::Formatter *f) {}
 
   virtual std::string get_type() = 0;
 
@@ -468,6 +469,34 @@ public:
      ceph::buffer::list& bl,
      uint32_t op_flags = 0) = 0;
 
+  /**
+   * checksum_digest -- verify a byte range of an object and crc32c it
+   *
+   * Does what read() followed by ceph::buffer::list::crc32c() would,
+   * for a store that keeps checksums of its own: it verifies them
+   * against the device and builds the digest from them where it can,
+   * without handing the data back or caching it.  *crc is updated the
+   * way ceph::buffer::list::crc32c(*crc) would update it, so calls can
+   * be chained, and mixed with read()s of other ranges.
+   *
+   * @param cid collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be digested
+   * @param len number of bytes to be digested
+   * @param crc running crc32c
+   * @returns number of bytes digested on success, -EOPNOTSUPP if the
+   * store has nothing better than read(), or negative error code on
+   * failure.
+   */
+  virtual int checksum_digest(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    uint32_t *crc) {
+    return -EOPNOTSUPP;
+  }
+
   /**
    * fiemap -- get extent std::map of data of an object
    *
@@ -755,6 +784,13 @@ public:
   virtual bool has_builtin_csum() const {
     return false;
   }
+  /**
+   * whether remove_collection() accepts a non-empty collection, dropping
+   * its objects along with it and reclaiming their space in the background
+   */
+  virtual bool can_bulk_remove_collection() const {
+    return false;
+  }
 };
 
 #endif
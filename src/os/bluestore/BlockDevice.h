@@ -224,7 +224,7 @@ public:
   virtual int queue_discard(interval_set<uint64_t> &to_release) { return -1; }
   virtual void discard_drain() { return; }
 
-  void queue_reap_ioc(IOContext *ioc);
+  virtual void queue_reap_ioc(IOContext *ioc);
   void reap_ioc();
 
   // for managing buffered readers/writers
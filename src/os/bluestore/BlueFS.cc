@@ -177,6 +177,28 @@ void BlueFS::_init_logger()
 	    "jlen", PerfCountersBuilder::PRIO_INTERESTING, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluefs_log_compactions, "log_compactions",
 		    "Compactions of the metadata log");
+  {
+    PerfHistogramCommon::axis_config_d stall_x_axis_config{
+      "Lock held (usec)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Stall in logarithmic scale
+      0,                               ///< Start at 0
+      10000,                           ///< Quantization unit is 10usec
+      24,                              ///< Enough to cover minutes
+    };
+    PerfHistogramCommon::axis_config_d stall_y_axis_config{
+      "Compacted log size (bytes)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+      0,                               ///< Start at 0
+      4096,                            ///< Quantization unit is 4KB
+      24,                              ///< Enough to cover tens of GB
+    };
+    b.add_u64_counter_histogram(
+      l_bluefs_log_compaction_stall_histogram,
+      "log_compaction_stall_histogram",
+      stall_x_axis_config, stall_y_axis_config,
+      "Histogram of the time the metadata log compaction blocks other "
+      "BlueFS users + compacted log size");
+  }
   b.add_u64_counter(l_bluefs_logged_bytes, "logged_bytes",
 		    "Bytes written to the metadata log", "j",
 		    PerfCountersBuilder::PRIO_CRITICAL, unit_t(UNIT_BYTES));
@@ -701,23 +723,28 @@ int BlueFS::fsck()
   return 0;
 }
 
-int BlueFS::_write_super(int dev)
+void BlueFS::_encode_super(bufferlist& bl)
 {
-  // build superblock
-  bufferlist bl;
   encode(super, bl);
   uint32_t crc = bl.crc32c(-1);
   encode(crc, bl);
   dout(10) << __func__ << " super block length(encoded): " << bl.length() << dendl;
   dout(10) << __func__ << " superblock " << super.version << dendl;
   dout(10) << __func__ << " log_fnode " << super.log_fnode << dendl;
+  dout(20) << __func__ << " crc 0x" << std::hex << crc << std::dec << dendl;
   ceph_assert_always(bl.length() <= get_super_length());
   bl.append_zero(get_super_length() - bl.length());
+}
+
+int BlueFS::_write_super(int dev)
+{
+  // build superblock
+  bufferlist bl;
+  _encode_super(bl);
 
   bdev[dev]->write(get_super_offset(), bl, false, WRITE_LIFE_SHORT);
   dout(20) << __func__ << " v " << super.version
-           << " crc 0x" << std::hex << crc
-           << " offset 0x" << get_super_offset() << std::dec
+           << " offset 0x" << std::hex << get_super_offset() << std::dec
            << dendl;
   return 0;
 }
@@ -1727,6 +1754,10 @@ uint64_t BlueFS::_estimate_log_size()
 void BlueFS::compact_log()
 {
   std::unique_lock l(lock);
+  while (new_log) {
+    dout(10) << __func__ << " waiting for async compaction" << dendl;
+    log_cond.wait(l);
+  }
   if (cct->_conf->bluefs_compact_log_sync) {
      _compact_log_sync();
   } else {
@@ -1950,6 +1981,14 @@ void BlueFS::_rewrite_log_sync(bool allocate_with_fallback,
  *
  * 8. Release the old log space.  Clean up.
  */
+/*
+ * Compact the log while it stays online.  Only a consistent snapshot of
+ * the metadata is taken under the lock; the new log is encoded and
+ * written, and the superblock pointing at it is persisted, with the lock
+ * dropped, while new entries keep being appended to the tail of the old
+ * log.  That tail is spliced onto the new log in a short locked step, so
+ * either superblock leads to the same entries.
+ */
 void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
 {
   dout(10) << __func__ << dendl;
@@ -1984,11 +2023,11 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   log_t.op_file_update(log_file->fnode);
   log_t.op_jump(log_seq, old_log_jump_to);
 
-  flush_bdev();  // FIXME?
-
   _flush_and_sync_log(l, 0, old_log_jump_to);
 
-  // 2. prepare compacted log
+  // 2. snapshot the metadata as of the jump; everything past it goes
+  // to the old log and is replayed on top of the snapshot
+  auto stall_start = mono_clock::now();
   bluefs_transaction_t t;
   //avoid record two times in log_t and _compact_log_dump_metadata.
   log_t.clear();
@@ -2011,25 +2050,33 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   // we might have some more ops in log_t due to _allocate call
   t.claim_ops(log_t);
 
+  new_log_writer = _create_writer(new_log);
+  auto stall = mono_clock::now() - stall_start;
+  l.unlock();
+
+  // 3. encode and write the compacted log; nobody else looks at it.
+  // the data of the snapshotted files must be durable before the log
+  // refers to it
+  flush_bdev();
   bufferlist bl;
   encode(t, bl);
   _pad_bl(bl);
+  ceph_assert(bl.length() <= new_log_jump_to);
 
   dout(10) << __func__ << " new_log_jump_to 0x" << std::hex << new_log_jump_to
 	   << std::dec << dendl;
 
-  new_log_writer = _create_writer(new_log);
   new_log_writer->append(bl);
-
-  // 3. flush
   r = _flush(new_log_writer, true);
   ceph_assert(r == 0);
 
   // 4. wait
+  l.lock();
   _flush_bdev_safely(new_log_writer);
 
   // 5. update our log fnode
   // discard first old_log_jump_to extents
+  stall_start = mono_clock::now();
   dout(10) << __func__ << " remove 0x" << std::hex << old_log_jump_to << std::dec
 	   << " of " << log_file->fnode.extents << dendl;
   uint64_t discarded = 0;
@@ -2068,15 +2115,21 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   log_writer->pos = log_writer->file->fnode.size =
     log_writer->pos - old_log_jump_to + new_log_jump_to;
 
-  // 6. write the super block to reflect the changes
-  dout(10) << __func__ << " writing super" << dendl;
+  // 6. write the super block to reflect the changes.  Log flushes racing
+  // with it land in the spliced tail, which the old super reaches via
+  // the jump and the new one directly; the runway can't grow meanwhile
+  // as _flush_and_sync_log waits for new_log_writer to go away.
   super.log_fnode = log_file->fnode;
   ++super.version;
-  _write_super(BDEV_DB);
+  bufferlist super_bl;
+  _encode_super(super_bl);
+  stall += mono_clock::now() - stall_start;
 
-  lock.unlock();
+  l.unlock();
+  dout(10) << __func__ << " writing super" << dendl;
+  bdev[BDEV_DB]->write(get_super_offset(), super_bl, false, WRITE_LIFE_SHORT);
   flush_bdev();
-  lock.lock();
+  l.lock();
 
   // 7. release old space
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
@@ -2095,8 +2148,11 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   new_log = nullptr;
   log_cond.notify_all();
 
-  dout(10) << __func__ << " log extents " << log_file->fnode.extents << dendl;
+  dout(10) << __func__ << " log extents " << log_file->fnode.extents
+	   << ", held the lock for " << stall << dendl;
   logger->inc(l_bluefs_log_compactions);
+  logger->hinc(l_bluefs_log_compaction_stall_histogram,
+	       std::chrono::nanoseconds(stall).count(), new_log_jump_to);
 }
 
 void BlueFS::_pad_bl(bufferlist& bl)
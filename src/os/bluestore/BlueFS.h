@@ -32,6 +32,7 @@ enum {
   l_bluefs_num_files,
   l_bluefs_log_bytes,
   l_bluefs_log_compactions,
+  l_bluefs_log_compaction_stall_histogram,
   l_bluefs_logged_bytes,
   l_bluefs_files_written_wal,
   l_bluefs_files_written_sst,
@@ -384,6 +385,7 @@ private:
   void _invalidate_cache(FileRef f, uint64_t offset, uint64_t length);
 
   int _open_super();
+  void _encode_super(bufferlist& bl);
   int _write_super(int dev);
   int _replay(bool noop, bool to_stdout = false); ///< replay journal
 
@@ -29,6 +29,7 @@
 #include "include/stringify.h"
 #include "include/str_map.h"
 #include "include/util.h"
+#include "include/random.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
@@ -79,9 +80,16 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_BULK_REMOVE = "R"; // collection name.nid -> cnode_t
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
+// allocator snapshot, written to bluefs on clean umount; it's valid only
+// while PREFIX_SUPER's ALLOC_SNAPSHOT_KEY holds the nonce stored in it.
+const string ALLOC_SNAPSHOT_DIR = "bluestore";
+const string ALLOC_SNAPSHOT_FILE = "alloc_snapshot";
+const string ALLOC_SNAPSHOT_KEY = "alloc_snapshot";
+
 // write a label in the first block.  always use this size.  note that
 // bluefs makes a matching assumption about the location of its
 // superblock (always the second block of the device).
@@ -321,6 +329,27 @@ static void get_coll_key_range(const coll_t& cid, int bits,
   }
 }
 
+/*
+ * a bulk removal is keyed by the collection name and the nid it was
+ * given, as a collection may be removed again before it is reclaimed
+ */
+static string get_bulk_remove_key(const coll_t& cid, uint64_t nid)
+{
+  return stringify(cid) + "." + stringify(nid);
+}
+
+static bool get_bulk_remove_key_coll(const string& key, coll_t *cid,
+				     uint64_t *nid)
+{
+  auto dot = key.rfind('.');
+  if (dot == string::npos) {
+    return false;
+  }
+  string err;
+  *nid = strict_strtoll(key.c_str() + dot + 1, 10, &err);
+  return err.empty() && *nid > 0 && cid->parse(key.substr(0, dot));
+}
+
 static void get_shared_blob_key(uint64_t sbid, string *key)
 {
   key->clear();
@@ -1023,7 +1052,6 @@ struct TwoQBufferCacheShard : public BlueStore::BufferCacheShard {
   list_t hot;      ///< "Am" hot buffers
   list_t warm_in;  ///< "A1in" newly warm buffers
   list_t warm_out; ///< "A1out" empty buffers we've evicted
-  uint64_t buffer_bytes = 0;     ///< bytes
 
   enum {
     BUFFER_NEW = 0,
@@ -1327,6 +1355,262 @@ public:
 #endif
 };
 
+// ArcBufferCacheShard
+
+/*
+ * An adaptive replacement cache: buffers referenced once live in the
+ * "recent" list, those referenced again are promoted to the "frequent"
+ * one.  Evicted buffers stay around as empty ghosts; hitting a ghost
+ * (via the discard hint, as in 2Q) tells us which list we evicted from
+ * too eagerly and shifts the target size of the recent list accordingly.
+ * Sizes are tracked in bytes rather than in pages.
+ */
+struct ArcBufferCacheShard : public BlueStore::BufferCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Buffer,
+    boost::intrusive::member_hook<
+      BlueStore::Buffer,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Buffer::lru_item> > list_t;
+  list_t recent;          ///< "T1" buffers referenced once
+  list_t recent_ghost;    ///< "B1" empty buffers evicted from recent
+  list_t frequent_ghost;  ///< "B2" empty buffers evicted from frequent
+  list_t frequent;        ///< "T2" buffers referenced more than once
+
+  // keep these ordered so that the highest value wins in _discard()
+  enum {
+    BUFFER_NEW = 0,
+    BUFFER_RECENT,
+    BUFFER_RECENT_GHOST,
+    BUFFER_FREQUENT_GHOST,
+    BUFFER_FREQUENT,
+    BUFFER_TYPE_MAX
+  };
+
+  uint64_t list_bytes[BUFFER_TYPE_MAX] = {0}; ///< bytes per type
+  uint64_t recent_target = 0;  ///< "p", bytes we aim to keep in recent
+
+  static bool is_ghost(int t) {
+    return t == BUFFER_RECENT_GHOST || t == BUFFER_FREQUENT_GHOST;
+  }
+  list_t& _list(int t) {
+    switch (t) {
+    case BUFFER_RECENT:
+      return recent;
+    case BUFFER_RECENT_GHOST:
+      return recent_ghost;
+    case BUFFER_FREQUENT_GHOST:
+      return frequent_ghost;
+    case BUFFER_FREQUENT:
+      return frequent;
+    default:
+      ceph_abort_msg("bad cache_private");
+    }
+  }
+  void _account(BlueStore::Buffer *b, int64_t delta) {
+    ceph_assert((int64_t)list_bytes[b->cache_private] + delta >= 0);
+    list_bytes[b->cache_private] += delta;
+    if (!is_ghost(b->cache_private)) {
+      ceph_assert((int64_t)buffer_bytes + delta >= 0);
+      buffer_bytes += delta;
+    }
+  }
+
+public:
+  explicit ArcBufferCacheShard(CephContext *cct) : BufferCacheShard(cct) {}
+
+  void _add(BlueStore::Buffer *b, int level, BlueStore::Buffer *near) override
+  {
+    dout(20) << __func__ << " level " << level << " near " << near
+             << " on " << *b
+             << " which has cache_private " << b->cache_private << dendl;
+    if (near) {
+      b->cache_private = near->cache_private;
+      ceph_assert(is_ghost(b->cache_private) == b->is_empty());
+      auto& l = _list(b->cache_private);
+      l.insert(l.iterator_to(*near), *b);
+    } else if (b->cache_private == BUFFER_NEW) {
+      b->cache_private = BUFFER_RECENT;
+      if (level > 0) {
+        recent.push_front(*b);
+      } else {
+        // take caller hint to start at the back of the recent list
+        recent.push_back(*b);
+      }
+    } else {
+      // we got a hint from discard: the range was referenced before
+      uint64_t cap = max;
+      switch (b->cache_private) {
+      case BUFFER_RECENT_GHOST:
+        {
+          // we evicted it from the recent list too early
+          double r = std::max(1.0, (double)list_bytes[BUFFER_FREQUENT_GHOST] /
+                                   (list_bytes[BUFFER_RECENT_GHOST] + b->length));
+          recent_target = std::min<uint64_t>(recent_target + r * b->length,
+                                             cap);
+        }
+        break;
+      case BUFFER_FREQUENT_GHOST:
+        {
+          // we evicted it from the frequent list too early
+          double r = std::max(1.0, (double)list_bytes[BUFFER_RECENT_GHOST] /
+                                   (list_bytes[BUFFER_FREQUENT_GHOST] + b->length));
+          uint64_t delta = r * b->length;
+          recent_target = recent_target > delta ? recent_target - delta : 0;
+        }
+        break;
+      case BUFFER_RECENT:
+      case BUFFER_FREQUENT:
+        break;
+      default:
+        ceph_abort_msg("bad cache_private");
+      }
+      dout(20) << __func__ << " move to front of frequent " << *b
+               << ", recent_target " << recent_target << dendl;
+      b->cache_private = BUFFER_FREQUENT;
+      frequent.push_front(*b);
+    }
+    _account(b, b->length);
+    num = recent.size() + frequent.size();
+  }
+
+  void _rm(BlueStore::Buffer *b) override
+  {
+    dout(20) << __func__ << " " << *b << dendl;
+    _account(b, -(int64_t)b->length);
+    auto& l = _list(b->cache_private);
+    l.erase(l.iterator_to(*b));
+    num = recent.size() + frequent.size();
+  }
+
+  void _move(BlueStore::BufferCacheShard *srcc, BlueStore::Buffer *b) override
+  {
+    ArcBufferCacheShard *src = static_cast<ArcBufferCacheShard*>(srcc);
+    src->_rm(b);
+
+    // preserve which list we're on (even if we can't preserve the order!)
+    ceph_assert(is_ghost(b->cache_private) == b->is_empty());
+    _list(b->cache_private).push_back(*b);
+    _account(b, b->length);
+    num = recent.size() + frequent.size();
+  }
+
+  void _adjust_size(BlueStore::Buffer *b, int64_t delta) override
+  {
+    dout(20) << __func__ << " delta " << delta << " on " << *b << dendl;
+    _account(b, delta);
+  }
+
+  void _touch(BlueStore::Buffer *b) override {
+    switch (b->cache_private) {
+    case BUFFER_RECENT:
+      // second reference, promote
+      recent.erase(recent.iterator_to(*b));
+      b->cache_private = BUFFER_FREQUENT;
+      list_bytes[BUFFER_RECENT] -= b->length;
+      list_bytes[BUFFER_FREQUENT] += b->length;
+      frequent.push_front(*b);
+      break;
+    case BUFFER_FREQUENT:
+      frequent.erase(frequent.iterator_to(*b));
+      frequent.push_front(*b);
+      break;
+    default:
+      ceph_abort_msg("ghosts are revived via discard hint");
+    }
+    num = recent.size() + frequent.size();
+    _audit("_touch_buffer end");
+  }
+
+  void _evict_to_ghost(BlueStore::Buffer *b, list_t& from,
+                       list_t& to, int ghost) {
+    ceph_assert(b->is_clean());
+    dout(20) << __func__ << " " << *b << dendl;
+    _account(b, -(int64_t)b->length);
+    from.erase(from.iterator_to(*b));
+    b->state = BlueStore::Buffer::STATE_EMPTY;
+    b->data.clear();
+    b->cache_private = ghost;
+    to.push_front(*b);
+    _account(b, b->length);
+  }
+
+  void _trim_to(uint64_t max) override
+  {
+    recent_target = std::min(recent_target, max);
+    uint64_t evicted = 0;
+    while (buffer_bytes > max) {
+      bool from_recent = !recent.empty() &&
+        (list_bytes[BUFFER_RECENT] > recent_target || frequent.empty());
+      if (from_recent) {
+        BlueStore::Buffer *b = &*recent.rbegin();
+        evicted += b->length;
+        _evict_to_ghost(b, recent, recent_ghost, BUFFER_RECENT_GHOST);
+      } else if (!frequent.empty()) {
+        BlueStore::Buffer *b = &*frequent.rbegin();
+        evicted += b->length;
+        _evict_to_ghost(b, frequent, frequent_ghost, BUFFER_FREQUENT_GHOST);
+      } else {
+        break;
+      }
+    }
+    if (evicted > 0) {
+      dout(20) << __func__ << " evicted " << byte_u_t(evicted)
+               << ", recent_target " << byte_u_t(recent_target) << dendl;
+    }
+
+    // remember no more than max bytes of history for each side
+    while (!recent_ghost.empty() &&
+           list_bytes[BUFFER_RECENT] + list_bytes[BUFFER_RECENT_GHOST] > max) {
+      BlueStore::Buffer *b = &*recent_ghost.rbegin();
+      dout(20) << __func__ << " recent_ghost rm " << *b << dendl;
+      b->space->_rm_buffer(this, b);
+    }
+    while (!frequent_ghost.empty() &&
+           list_bytes[BUFFER_FREQUENT] + list_bytes[BUFFER_FREQUENT_GHOST] > max) {
+      BlueStore::Buffer *b = &*frequent_ghost.rbegin();
+      dout(20) << __func__ << " frequent_ghost rm " << *b << dendl;
+      b->space->_rm_buffer(this, b);
+    }
+    num = recent.size() + frequent.size();
+  }
+
+  void add_stats(uint64_t *extents,
+                 uint64_t *blobs,
+                 uint64_t *buffers,
+                 uint64_t *bytes) override {
+    *extents += num_extents;
+    *blobs += num_blobs;
+    *buffers += num;
+    *bytes += buffer_bytes;
+  }
+
+#ifdef DEBUG_CACHE
+  void _audit(const char *when) override
+  {
+    dout(10) << __func__ << " " << when << " start" << dendl;
+    uint64_t s = 0;
+    for (int t = BUFFER_RECENT; t < BUFFER_TYPE_MAX; ++t) {
+      uint64_t ls = 0;
+      for (auto& b : _list(t)) {
+        ls += b.length;
+      }
+      ceph_assert(ls == list_bytes[t]);
+      if (!is_ghost(t)) {
+        s += ls;
+      }
+    }
+    if (s != buffer_bytes) {
+      derr << __func__ << " buffer_bytes " << buffer_bytes << " actual " << s
+           << dendl;
+      ceph_assert(s == buffer_bytes);
+    }
+    dout(20) << __func__ << " " << when << " buffer_bytes " << buffer_bytes
+             << " ok" << dendl;
+  }
+#endif
+};
+
 // BuferCacheShard
 
 BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
@@ -1339,6 +1623,8 @@ BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
     c = new LruBufferCacheShard(cct);
   else if (type == "2q")
     c = new TwoQBufferCacheShard(cct);
+  else if (type == "arc")
+    c = new ArcBufferCacheShard(cct);
   else
     ceph_abort_msg("unrecognized cache type");
   c->logger = logger;
@@ -2142,6 +2428,18 @@ void BlueStore::ExtentMap::dup(BlueStore* b, TransContext* txc,
   uint32_t dirty_range_begin = 0;
   uint32_t dirty_range_end = 0;
   bool src_dirty = false;
+  {
+    // the shared blobs below are loaded at once
+    vector<SharedBlobRef> sbs;
+    for (auto ep = oldo->extent_map.seek_lextent(srcoff);
+	 ep != oldo->extent_map.extent_map.end() && ep->logical_offset < end;
+	 ++ep) {
+      if (ep->blob->get_blob().is_shared()) {
+	sbs.push_back(ep->blob->shared_blob);
+      }
+    }
+    c->load_shared_blobs(sbs);
+  }
   for (auto ep = oldo->extent_map.seek_lextent(srcoff);
     ep != oldo->extent_map.extent_map.end();
     ++ep) {
@@ -2683,9 +2981,11 @@ bool BlueStore::ExtentMap::encode_some(
   auto start = extent_map.lower_bound(dummy);
   uint32_t end = offset + length;
 
-  __u8 struct_v = 2; // Version 2 differs from v1 in blob's ref_map
-                     // serialization only. Hence there is no specific
-                     // handling at ExtentMap level.
+  // Version 2 differs from v1 in blob's ref_map serialization only.
+  // Version 3 lays the extents out as packed arrays, see decode_some().
+  // Blobs are encoded as of version 2 in either case.
+  __u8 struct_v = onode->c->store->extent_map_struct_v;
+  __u8 blob_struct_v = 2;
 
   unsigned n = 0;
   size_t bound = 0;
@@ -2709,7 +3009,7 @@ bool BlueStore::ExtentMap::encode_some(
 
       p->blob->bound_encode(
         bound,
-        struct_v,
+        blob_struct_v,
         p->blob->shared_blob->get_sbid(),
         false);
     }
@@ -2720,6 +3020,7 @@ bool BlueStore::ExtentMap::encode_some(
 
   denc(struct_v, bound);
   denc_varint(0, bound); // number of extents
+  bound += 4;            // packed array headers
 
   {
     auto app = bl.get_contiguous_appender(bound);
@@ -2729,6 +3030,11 @@ bool BlueStore::ExtentMap::encode_some(
       *pn = n;
     }
 
+    if (struct_v >= 3) {
+      _encode_some_packed(start, end, n, app);
+      return false;
+    }
+
     n = 0;
     uint64_t pos = 0;
     uint64_t prev_len = 0;
@@ -2770,7 +3076,8 @@ bool BlueStore::ExtentMap::encode_some(
       }
       pos = p->logical_end();
       if (include_blob) {
-	p->blob->encode(app, struct_v, p->blob->shared_blob->get_sbid(), false);
+	p->blob->encode(app, blob_struct_v, p->blob->shared_blob->get_sbid(),
+			false);
       }
     }
   }
@@ -2782,6 +3089,90 @@ bool BlueStore::ExtentMap::encode_some(
   return false;
 }
 
+void BlueStore::ExtentMap::_encode_some_packed(
+  extent_map_t::iterator start,
+  uint32_t end,
+  unsigned n,
+  bufferlist::contiguous_appender& app)
+{
+  vector<uint32_t> refs(n), gaps(n), blob_offsets(n), lengths(n);
+  vector<Blob*> blobs;
+  uint64_t pos = 0;
+  unsigned i = 0;
+  for (auto p = start;
+       p != extent_map.end() && p->logical_offset < end;
+       ++p, ++i) {
+    if (p->blob->is_spanning()) {
+      refs[i] = (p->blob->id << 1) | 1;
+    } else {
+      if (p->blob->last_encoded_id < 0) {
+	p->blob->last_encoded_id = blobs.size();
+	blobs.push_back(p->blob.get());
+      }
+      refs[i] = p->blob->last_encoded_id << 1;
+    }
+    gaps[i] = p->logical_offset - pos;
+    blob_offsets[i] = p->blob_offset;
+    lengths[i] = p->length;
+    pos = p->logical_end();
+  }
+  ceph_assert(i == n);
+  denc_packed_u32s(refs.data(), n, app);
+  denc_packed_u32s(gaps.data(), n, app);
+  denc_packed_u32s(blob_offsets.data(), n, app);
+  denc_packed_u32s(lengths.data(), n, app);
+  for (auto b : blobs) {
+    b->encode(app, 2, b->shared_blob->get_sbid(), false);
+  }
+}
+
+unsigned BlueStore::ExtentMap::_decode_some_packed(
+  bufferptr::const_iterator& p,
+  unsigned num)
+{
+  auto cct = onode->c->store->cct; //used by dout
+  vector<uint32_t> refs(num), gaps(num), blob_offsets(num), lengths(num);
+  denc_packed_u32s(refs.data(), num, p);
+  denc_packed_u32s(gaps.data(), num, p);
+  denc_packed_u32s(blob_offsets.data(), num, p);
+  denc_packed_u32s(lengths.data(), num, p);
+
+  // the blobs follow the arrays, in the order they are first referenced
+  vector<BlobRef> blobs;
+  uint64_t pos = 0;
+  for (unsigned i = 0; i < num; ++i) {
+    Extent *le = new Extent();
+    le->logical_offset = pos + gaps[i];
+    le->blob_offset = blob_offsets[i];
+    le->length = lengths[i];
+    if (refs[i] & 1) {
+      dout(30) << __func__ << "  getting spanning blob "
+	       << (refs[i] >> 1) << dendl;
+      le->assign_blob(get_spanning_blob(refs[i] >> 1));
+    } else {
+      unsigned idx = refs[i] >> 1;
+      if (idx == blobs.size()) {
+	Blob *b = new Blob();
+	uint64_t sbid = 0;
+	b->decode(onode->c, p, 2, &sbid, false);
+	blobs.push_back(b);
+	onode->c->open_shared_blob(sbid, b);
+      }
+      ceph_assert(idx < blobs.size());
+      le->assign_blob(blobs[idx]);
+      // we build ref_map dynamically for non-spanning blobs
+      le->blob->get_ref(
+	onode->c,
+	le->blob_offset,
+	le->length);
+    }
+    pos = le->logical_end();
+    extent_map.insert(*le);
+  }
+  ceph_assert(p.end());
+  return num;
+}
+
 unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
 {
   auto cct = onode->c->store->cct; //used by dout
@@ -2798,10 +3189,13 @@ unsigned BlueStore::ExtentMap::decode_some(bufferlist& bl)
   // Version 2 differs from v1 in blob's ref_map
   // serialization only. Hence there is no specific
   // handling at ExtentMap level below.
-  ceph_assert(struct_v == 1 || struct_v == 2);
+  ceph_assert(struct_v >= 1 && struct_v <= 3);
 
   uint32_t num;
   denc_varint(num, p);
+  if (struct_v >= 3) {
+    return _decode_some_packed(p, num);
+  }
   vector<BlobRef> blobs(num);
   uint64_t pos = 0;
   uint64_t prev_len = 0;
@@ -3573,6 +3967,43 @@ void BlueStore::Collection::load_shared_blob(SharedBlobRef sb)
   }
 }
 
+void BlueStore::Collection::load_shared_blobs(
+  const vector<SharedBlobRef>& sbs)
+{
+  map<string, SharedBlobRef> to_load;
+  for (auto& sb : sbs) {
+    if (!sb->is_loaded()) {
+      string key;
+      get_shared_blob_key(sb->get_sbid(), &key);
+      to_load.emplace(key, sb);
+    }
+  }
+  if (to_load.size() < 2) {
+    // nothing to batch, leave it to load_shared_blob()
+    return;
+  }
+  set<string> keys;
+  for (auto& p : to_load) {
+    keys.insert(keys.end(), p.first);
+  }
+  map<string, bufferlist> vals;
+  store->db->get(PREFIX_SHARED_BLOB, keys, &vals);
+  for (auto& [key, v] : vals) {
+    auto& sb = to_load[key];
+    if (sb->is_loaded()) {
+      // listed more than once
+      continue;
+    }
+    sb->loaded = true;
+    sb->persistent = new bluestore_shared_blob_t(sb->get_sbid());
+    auto p = v.cbegin();
+    decode(*(sb->persistent), p);
+    ldout(store->cct, 10) << __func__ << " sbid 0x" << std::hex
+			  << sb->get_sbid() << std::dec
+			  << " loaded shared_blob " << *sb << dendl;
+  }
+}
+
 void BlueStore::Collection::make_blob_shared(uint64_t sbid, BlobRef b)
 {
   ldout(store->cct, 10) << __func__ << " " << *b << dendl;
@@ -3610,6 +4041,33 @@ uint64_t BlueStore::Collection::make_blob_unshared(SharedBlob *sb)
   return sbid;
 }
 
+bool BlueStore::Collection::is_bulk_stale(
+  const string& key,
+  uint64_t nid) const
+{
+  for (auto& f : bulk_fences) {
+    if (nid <= f.nid &&
+	((key >= f.temp_start && key < f.temp_end) ||
+	 (key >= f.start && key < f.end))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BlueStore::Collection::is_bulk_stale(
+  const string& key,
+  const bufferlist& v) const
+{
+  if (bulk_fences.empty() || !is_bulk_stale(key, 0)) {
+    return false;
+  }
+  bluestore_onode_t onode;
+  auto p = v.front().begin_deep();
+  onode.decode(p);
+  return is_bulk_stale(key, onode.nid);
+}
+
 BlueStore::OnodeRef BlueStore::Collection::get_onode(
   const ghobject_t& oid,
   bool create,
@@ -3627,8 +4085,11 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   }
 
   OnodeRef o = onode_map.lookup(oid);
-  if (o)
+  if (o) {
+    ++cache_stats.onode_hits;
     return o;
+  }
+  ++cache_stats.onode_misses;
 
   string key;
   get_object_key(store->cct, oid, &key);
@@ -3642,6 +4103,11 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   if (!is_createop) {
     r = store->db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
     ldout(store->cct, 20) << " r " << r << " v.len " << v.length() << dendl;
+    if (v.length() && is_bulk_stale(key, v)) {
+      ldout(store->cct, 20) << " left by a bulk removal" << dendl;
+      v.clear();
+      r = -ENOENT;
+    }
   }
   if (v.length() == 0) {
     ceph_assert(r == -ENOENT);
@@ -3660,6 +4126,38 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   return onode_map.add(oid, o);
 }
 
+void BlueStore::Collection::load_onodes(const vector<ghobject_t>& oids)
+{
+  ceph_assert(ceph_mutex_is_wlocked(lock));
+  map<string, const ghobject_t*> to_load;
+  for (auto& oid : oids) {
+    if (!onode_map.lookup(oid)) {
+      string key;
+      get_object_key(store->cct, oid, &key);
+      to_load.emplace(key, &oid);
+    }
+  }
+  if (to_load.size() < 2) {
+    return;
+  }
+  set<string> keys;
+  for (auto& p : to_load) {
+    keys.insert(keys.end(), p.first);
+  }
+  map<string, bufferlist> vals;
+  store->db->get(PREFIX_OBJ, keys, &vals);
+  ldout(store->cct, 20) << __func__ << " loaded " << vals.size() << "/"
+			<< keys.size() << " onodes" << dendl;
+  for (auto& [key, v] : vals) {
+    if (is_bulk_stale(key, v)) {
+      continue;
+    }
+    auto& oid = *to_load[key];
+    OnodeRef o(Onode::decode(this, oid, key, v));
+    onode_map.add(oid, o);
+  }
+}
+
 void BlueStore::Collection::split_cache(
   Collection *dest)
 {
@@ -3772,6 +4270,7 @@ void *BlueStore::MempoolThread::entry()
   utime_t next_balance = ceph_clock_now();
   utime_t next_resize = ceph_clock_now();
   utime_t next_deferred_force_submit = ceph_clock_now();
+  utime_t next_tier_update = ceph_clock_now();
 
   bool interval_stats_trim = false;
   while (!stop) {
@@ -3818,6 +4317,12 @@ void *BlueStore::MempoolThread::entry()
       next_deferred_force_submit += max_defer_interval/3;
     }
 
+    if (next_tier_update < ceph_clock_now()) {
+      store->_tier_update_room();
+      next_tier_update = ceph_clock_now();
+      next_tier_update += 1.0;
+    }
+
     // Now Resize the shards 
     _resize_shards(interval_stats_trim);
     interval_stats_trim = false;
@@ -3843,8 +4348,8 @@ void BlueStore::MempoolThread::_adjust_cache_settings()
 void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
 {
   auto cct = store->cct;
-  size_t onode_shards = store->onode_cache_shards.size();
-  size_t buffer_shards = store->buffer_cache_shards.size();
+  size_t onode_shards = store->num_shared_cache_shards;
+  size_t buffer_shards = store->num_shared_cache_shards;
   int64_t kv_used = store->db->get_cache_usage();
   int64_t meta_used = meta_cache->_get_used_bytes();
   int64_t data_used = data_cache->_get_used_bytes();
@@ -3882,18 +4387,45 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
                    << " data_used: " << data_used << dendl;
   }
 
+  // Pools with a cache partition get their reserved share of the meta and
+  // data allotments; whatever part of it they don't use is lent to the
+  // shards shared by everybody else.
+  double bytes_per_onode = meta_cache->get_bytes_per_onode();
+  int64_t meta_shared = meta_alloc;
+  int64_t data_shared = data_alloc;
+  for (auto& [pool, p] : store->cache_partitions) {
+    int64_t meta_reserved = meta_alloc * p.ratio;
+    int64_t data_reserved = data_alloc * p.ratio;
+    uint64_t max_shard_onodes = static_cast<uint64_t>(
+        (meta_reserved / (double) p.num) / bytes_per_onode);
+    uint64_t max_shard_buffer = static_cast<uint64_t>(data_reserved / p.num);
+    uint64_t onodes = 0;
+    uint64_t bytes = 0;
+    for (unsigned i = p.first; i < p.first + p.num; ++i) {
+      onodes += store->onode_cache_shards[i]->_get_num();
+      bytes += store->buffer_cache_shards[i]->_get_bytes();
+      store->onode_cache_shards[i]->set_max(max_shard_onodes);
+      store->buffer_cache_shards[i]->set_max(max_shard_buffer);
+    }
+    meta_shared -= std::min<int64_t>(meta_reserved, onodes * bytes_per_onode);
+    data_shared -= std::min<int64_t>(data_reserved, bytes);
+    ldout(cct, 30) << __func__ << " pool " << pool
+                   << " max_shard_onodes: " << max_shard_onodes
+                   << " max_shard_buffer: " << max_shard_buffer << dendl;
+  }
+
   uint64_t max_shard_onodes = static_cast<uint64_t>(
-      (meta_alloc / (double) onode_shards) / meta_cache->get_bytes_per_onode());
-  uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / buffer_shards);
+      (std::max<int64_t>(meta_shared, 0) / (double) onode_shards) /
+      bytes_per_onode);
+  uint64_t max_shard_buffer = static_cast<uint64_t>(
+      std::max<int64_t>(data_shared, 0) / buffer_shards);
 
   ldout(cct, 30) << __func__ << " max_shard_onodes: " << max_shard_onodes
                  << " max_shard_buffer: " << max_shard_buffer << dendl;
 
-  for (auto i : store->onode_cache_shards) {
-    i->set_max(max_shard_onodes);
-  }
-  for (auto i : store->buffer_cache_shards) {
-    i->set_max(max_shard_buffer);
+  for (unsigned i = 0; i < store->num_shared_cache_shards; ++i) {
+    store->onode_cache_shards[i]->set_max(max_shard_onodes);
+    store->buffer_cache_shards[i]->set_max(max_shard_buffer);
   }
 }
 
@@ -4110,7 +4642,8 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
+    bulk_remove_thread(this),
+    tier_demote_thread(this),
     mempool_thread(this)
 {
   _init_logger();
@@ -4129,7 +4662,8 @@ BlueStore::BlueStore(CephContext *cct,
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
+    bulk_remove_thread(this),
+    tier_demote_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
     mempool_thread(this)
@@ -4196,6 +4730,13 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_warn_on_legacy_statfs",
     "bluestore_warn_on_no_per_pool_omap",
     "bluestore_max_defer_interval",
+    "bluestore_inline_data_max",
+    "bluestore_extent_map_packed_encoding",
+    "bluestore_tier_promote_heat",
+    "bluestore_tier_heat_half_life",
+    "bluestore_tier_db_min_free_ratio",
+    "bluestore_bulk_remove_paused",
+    "bluestore_bulk_remove_sleep",
     NULL
   };
   return KEYS;
@@ -4214,6 +4755,14 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
   if (changed.count("bluestore_csum_type")) {
     _set_csum();
   }
+  if (changed.count("bluestore_extent_map_packed_encoding")) {
+    _set_extent_map_encoding();
+  }
+  if (changed.count("bluestore_tier_promote_heat") ||
+      changed.count("bluestore_tier_heat_half_life") ||
+      changed.count("bluestore_tier_db_min_free_ratio")) {
+    _set_tier_params();
+  }
   if (changed.count("bluestore_compression_mode") ||
       changed.count("bluestore_compression_algorithm") ||
       changed.count("bluestore_compression_min_blob_size") ||
@@ -4236,7 +4785,8 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       changed.count("bluestore_max_alloc_size") ||
       changed.count("bluestore_deferred_batch_ops") ||
       changed.count("bluestore_deferred_batch_ops_hdd") ||
-      changed.count("bluestore_deferred_batch_ops_ssd")) {
+      changed.count("bluestore_deferred_batch_ops_ssd") ||
+      changed.count("bluestore_inline_data_max")) {
     if (bdev) {
       // only after startup
       _set_alloc_sizes();
@@ -4263,6 +4813,11 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       _set_max_defer_interval();
     }
   }
+  if (changed.count("bluestore_bulk_remove_paused") ||
+      changed.count("bluestore_bulk_remove_sleep")) {
+    std::lock_guard l(bulk_remove_lock);
+    bulk_remove_cond.notify_all();
+  }
   if (changed.count("osd_memory_target") ||
       changed.count("osd_memory_base") ||
       changed.count("osd_memory_cache_min") ||
@@ -4341,6 +4896,35 @@ void BlueStore::_set_csum()
 	   << dendl;
 }
 
+void BlueStore::_set_extent_map_encoding()
+{
+  bool packed =
+    cct->_conf.get_val<bool>("bluestore_extent_map_packed_encoding");
+  if (packed && mounted) {
+    // before any shard can be encoded with it; see _record_onode()
+    _require_compat_ondisk_format(packed_extent_map_ondisk_format);
+  }
+  extent_map_struct_v = packed ? 3 : 2;
+  dout(10) << __func__ << " extent map struct_v "
+	   << (int)extent_map_struct_v << dendl;
+}
+
+void BlueStore::_set_tier_params()
+{
+  uint32_t heat = cct->_conf.get_val<uint64_t>("bluestore_tier_promote_heat");
+  if (heat && !(bluefs && bluefs_layout.dedicated_db)) {
+    dout(10) << __func__ << " no dedicated DB device, not tiering" << dendl;
+    heat = 0;
+  }
+  tier_heat_half_life = std::max<uint64_t>(
+    1, cct->_conf.get_val<uint64_t>("bluestore_tier_heat_half_life"));
+  tier_promote_heat = heat;
+  _tier_update_room();
+  dout(10) << __func__ << " promote_heat " << tier_promote_heat
+	   << " half_life " << tier_heat_half_life << "s"
+	   << " fast_room " << tier_fast_room << dendl;
+}
+
 void BlueStore::_set_throttle_params()
 {
   if (cct->_conf->bluestore_throttle_cost_per_io) {
@@ -4495,6 +5079,8 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kf_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_u64_avg(l_bluestore_kv_sync_txcs, "kv_sync_txcs",
+		"Average number of transactions committed per kv sync");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -4544,12 +5130,47 @@ void BlueStore::_init_logger()
     "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
     "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64_counter(l_bluestore_compress_parallel_blobs, "compress_parallel_blobs",
+    "Sum for blobs compressed by the compression threads");
+  {
+    PerfHistogramCommon::axis_config_d lat_x_axis_config{
+      "Latency (usec)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+      0,                               ///< Start at 0
+      10000,                           ///< Quantization unit is 10usec
+      24,                              ///< Enough to cover minutes
+    };
+    PerfHistogramCommon::axis_config_d size_y_axis_config{
+      "Write size (bytes)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+      0,                               ///< Start at 0
+      4096,                            ///< Quantization unit is 4KB
+      20,                              ///< Enough to cover GBs
+    };
+    b.add_u64_counter_histogram(
+      l_bluestore_alloc_write_compressed_lat_histogram,
+      "alloc_write_compressed_lat_histogram",
+      lat_x_axis_config, size_y_axis_config,
+      "Histogram of blob allocation and write preparation latency for "
+      "writes subject to compression + write size");
+    b.add_u64_counter_histogram(
+      l_bluestore_alloc_write_raw_lat_histogram,
+      "alloc_write_raw_lat_histogram",
+      lat_x_axis_config, size_y_axis_config,
+      "Histogram of blob allocation and write preparation latency for "
+      "uncompressed writes + write size");
+  }
   b.add_u64_counter(l_bluestore_write_pad_bytes, "write_pad_bytes",
 		    "Sum for write-op padded bytes", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_deferred_write_ops, "deferred_write_ops",
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_merge_in_ops, "deferred_merge_in_ops",
+		    "Sum for deferred writes before merging contiguous ones; "
+		    "ratio to deferred_write_ops is the merge ratio");
+  b.add_u64_avg(l_bluestore_deferred_merge_osrs, "deferred_merge_osrs",
+		"Average number of sequencers per aggregated deferred submit");
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4586,6 +5207,10 @@ void BlueStore::_init_logger()
 	    "Sum for bytes of read hit in the cache", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
 	    "Sum for bytes of read missed in the cache", NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_read_zero_copy_bytes,
+	    "bluestore_read_zero_copy_bytes",
+	    "Sum for bytes of cached data passed to reads by reference",
+	    NULL, 0, unit_t(UNIT_BYTES));
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -4609,6 +5234,18 @@ void BlueStore::_init_logger()
 		    "cached) to fill out the block");
   b.add_u64_counter(l_bluestore_write_small_new, "bluestore_write_small_new",
 		    "Small write into new (sparse) blob");
+  b.add_u64_counter(l_bluestore_write_inline, "bluestore_write_inline",
+		    "Writes kept inline in the onode");
+  b.add_u64_counter(l_bluestore_write_inline_moved, "bluestore_write_inline_moved",
+		    "Objects whose inline data was moved out to a blob");
+  b.add_u64_counter(l_bluestore_tier_fast_reads, "tier_fast_reads",
+		    "Reads served from inline data on the DB device");
+  b.add_u64_counter(l_bluestore_tier_slow_reads, "tier_slow_reads",
+		    "Reads served from blobs on the main device");
+  b.add_u64_counter(l_bluestore_tier_promoted, "tier_promoted",
+		    "Hot objects moved inline, onto the DB device");
+  b.add_u64_counter(l_bluestore_tier_demoted, "tier_demoted",
+		    "Cold inline objects moved out to the main device");
 
   b.add_u64_counter(l_bluestore_txc, "bluestore_txc", "Transactions committed");
   b.add_u64_counter(l_bluestore_onode_reshard, "bluestore_onode_reshard",
@@ -4636,6 +5273,12 @@ void BlueStore::_init_logger()
     "Average omap iterator next call latency");
   b.add_time_avg(l_bluestore_clist_lat, "clist_lat",
     "Average collection listing latency");
+  b.add_u64(l_bluestore_bulk_remove_colls, "bulk_remove_colls",
+    "Removed collections whose objects are still being reclaimed");
+  b.add_u64(l_bluestore_bulk_remove_objects, "bulk_remove_objects",
+    "Objects left to reclaim in the collections counted so far");
+  b.add_u64_counter(l_bluestore_bulk_removed_objects, "bulk_removed_objects",
+    "Objects reclaimed from collections removed in bulk");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4826,12 +5469,19 @@ void BlueStore::_set_alloc_sizes(void)
     }
   }
 
+  // anything bigger than an allocation unit is better off in a blob
+  inline_data_max = std::min<uint64_t>(
+    cct->_conf.get_val<Option::size_t>("bluestore_inline_data_max"),
+    min_alloc_size);
+
   dout(10) << __func__ << " min_alloc_size 0x" << std::hex << min_alloc_size
 	   << std::dec << " order " << (int)min_alloc_size_order
 	   << " max_alloc_size 0x" << std::hex << max_alloc_size
 	   << " prefer_deferred_size 0x" << prefer_deferred_size
 	   << std::dec
 	   << " deferred_batch_ops " << deferred_batch_ops
+	   << " inline_data_max 0x" << std::hex << inline_data_max
+	   << std::dec
 	   << dendl;
 }
 
@@ -5037,6 +5687,12 @@ int BlueStore::_open_alloc()
     return -EINVAL;
   }
 
+  alloc_fm_size = fm->get_size();
+  if (bluefs && cct->_conf.get_val<bool>("bluestore_alloc_snapshot") &&
+      _load_alloc_snapshot() == 0) {
+    return 0;
+  }
+
   uint64_t num = 0, bytes = 0;
 
   dout(1) << __func__ << " opening allocation metadata" << dendl;
@@ -5070,14 +5726,282 @@ void BlueStore::_close_alloc()
   alloc->shutdown();
   delete alloc;
   alloc = NULL;
+  alloc_snapshot_loaded = false;
   bluefs_extents.clear();
 }
 
-int BlueStore::_open_fsid(bool create)
+/*
+ * allocator snapshot layout:
+ *   ENCODE_START(1, 1)
+ *     nonce, bdev size, min_alloc_size,
+ *     bluefs extents on the shared device,
+ *     extent count, (offset, length) * extent count
+ *   ENCODE_FINISH
+ *   crc32c of all the above
+ */
+int BlueStore::_load_alloc_snapshot()
 {
-  ceph_assert(fsid_fd < 0);
-  int flags = O_RDWR|O_CLOEXEC;
-  if (create)
+  ceph_assert(bluefs);
+  ceph_assert(alloc);
+  utime_t start = ceph_clock_now();
+
+  uint64_t expected_nonce = 0;
+  {
+    bufferlist bl;
+    db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_KEY, &bl);
+    if (!bl.length()) {
+      dout(10) << __func__ << " no valid snapshot" << dendl;
+      return -ENOENT;
+    }
+    auto p = bl.cbegin();
+    try {
+      decode(expected_nonce, p);
+    } catch (buffer::error& e) {
+      derr << __func__ << " unable to decode snapshot nonce" << dendl;
+      return -EIO;
+    }
+  }
+
+  uint64_t size = 0;
+  int r = bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &size, nullptr);
+  if (r < 0 || size <= sizeof(uint32_t)) {
+    derr << __func__ << " snapshot is missing or truncated" << dendl;
+    return -ENOENT;
+  }
+  bufferlist bl;
+  {
+    BlueFS::FileReader *h;
+    r = bluefs->open_for_read(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h);
+    if (r < 0) {
+      derr << __func__ << " failed to open snapshot: " << cpp_strerror(r)
+	   << dendl;
+      return r;
+    }
+    r = bluefs->read(h, &h->buf, 0, size, &bl, nullptr);
+    delete h;
+    if (r < 0 || bl.length() != size) {
+      derr << __func__ << " failed to read snapshot: " << cpp_strerror(r)
+	   << dendl;
+      return r < 0 ? r : -EIO;
+    }
+  }
+
+  bufferlist payload;
+  payload.substr_of(bl, 0, size - sizeof(uint32_t));
+  uint32_t crc, expected_crc = payload.crc32c(-1);
+  {
+    auto p = bl.cbegin();
+    p.seek(size - sizeof(uint32_t));
+    decode(crc, p);
+  }
+  if (crc != expected_crc) {
+    derr << __func__ << " bad snapshot crc 0x" << std::hex << crc
+	 << ", expected 0x" << expected_crc << std::dec << dendl;
+    return -EIO;
+  }
+
+  uint64_t num = 0, bytes = 0;
+  try {
+    auto p = payload.cbegin();
+    DECODE_START(1, p);
+    uint64_t nonce, bdev_size, snap_min_alloc_size;
+    interval_set<uint64_t> snap_bluefs_extents;
+    decode(nonce, p);
+    decode(bdev_size, p);
+    decode(snap_min_alloc_size, p);
+    decode(snap_bluefs_extents, p);
+    if (nonce != expected_nonce) {
+      dout(1) << __func__ << " stale snapshot, nonce " << nonce
+	      << " != " << expected_nonce << dendl;
+      return -ESTALE;
+    }
+    if (bdev_size != bdev->get_size() ||
+	snap_min_alloc_size != min_alloc_size) {
+      dout(1) << __func__ << " stale snapshot, device size 0x" << std::hex
+	      << bdev_size << " min_alloc_size 0x" << snap_min_alloc_size
+	      << std::dec << " don't match" << dendl;
+      return -ESTALE;
+    }
+    if (!(snap_bluefs_extents == bluefs_extents)) {
+      // bluefs grabbed or gave back some space after the snapshot was taken
+      dout(1) << __func__ << " stale snapshot, bluefs extents 0x" << std::hex
+	      << snap_bluefs_extents << " != 0x" << bluefs_extents << std::dec
+	      << dendl;
+      return -ESTALE;
+    }
+    uint64_t count;
+    decode(count, p);
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t offset, length;
+      decode(offset, p);
+      decode(length, p);
+      alloc->init_add_free(offset, length);
+      ++num;
+      bytes += length;
+    }
+    DECODE_FINISH(p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode snapshot: " << e.what() << dendl;
+    // alloc might be partially populated
+    alloc->shutdown();
+    delete alloc;
+    alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
+			      bdev->get_size(),
+			      min_alloc_size, "block");
+    ceph_assert(alloc);
+    return -EIO;
+  }
+  alloc_snapshot_loaded = true;
+  dout(1) << __func__ << " loaded " << byte_u_t(bytes)
+	  << " in " << num << " extents from snapshot in "
+	  << (ceph_clock_now() - start) << " seconds" << dendl;
+  return 0;
+}
+
+int BlueStore::_write_alloc_snapshot()
+{
+  ceph_assert(bluefs);
+  ceph_assert(alloc);
+  utime_t start = ceph_clock_now();
+
+  if (fm->get_size() != alloc_fm_size) {
+    // e.g. the device has been expanded, alloc doesn't know about new space
+    dout(1) << __func__ << " freelist size changed, skipping" << dendl;
+    return -ESTALE;
+  }
+  interval_set<uint64_t> snap_bluefs_extents;
+  int r = bluefs->get_block_extents(bluefs_layout.shared_bdev,
+				    &snap_bluefs_extents);
+  if (r < 0) {
+    derr << __func__ << " failed to retrieve bluefs_extents: "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  uint64_t nonce = ceph::util::generate_random_number<uint64_t>(
+    1, std::numeric_limits<uint64_t>::max());
+  uint64_t num = 0, bytes = 0;
+  bufferlist bl;
+  {
+    bufferlist extents_bl;
+    alloc->dump([&](uint64_t offset, uint64_t length) {
+      encode(offset, extents_bl);
+      encode(length, extents_bl);
+      ++num;
+      bytes += length;
+    });
+    ENCODE_START(1, 1, bl);
+    encode(nonce, bl);
+    encode(bdev->get_size(), bl);
+    encode(min_alloc_size, bl);
+    encode(snap_bluefs_extents, bl);
+    encode(num, bl);
+    bl.claim_append(extents_bl);
+    ENCODE_FINISH(bl);
+  }
+  uint32_t crc = bl.crc32c(-1);
+  encode(crc, bl);
+
+  if (!bluefs->dir_exists(ALLOC_SNAPSHOT_DIR)) {
+    r = bluefs->mkdir(ALLOC_SNAPSHOT_DIR);
+    if (r < 0) {
+      derr << __func__ << " failed to create snapshot dir: "
+	   << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+  BlueFS::FileWriter *h;
+  r = bluefs->open_for_write(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h, false);
+  if (r < 0) {
+    derr << __func__ << " failed to open snapshot for write: "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  h->append(bl);
+  r = bluefs->fsync(h);
+  bluefs->close_writer(h);
+  if (r < 0) {
+    derr << __func__ << " failed to write snapshot: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+
+  // the snapshot becomes valid once the nonce is committed; any later change
+  // to the allocator is caught either by the nonce removal on the next R/W
+  // open or by the bluefs extents check at load time.
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist nonce_bl;
+  encode(nonce, nonce_bl);
+  t->set(PREFIX_SUPER, ALLOC_SNAPSHOT_KEY, nonce_bl);
+  db->submit_transaction_sync(t);
+
+  dout(1) << __func__ << " saved " << byte_u_t(bytes)
+	  << " in " << num << " extents, " << byte_u_t(bl.length())
+	  << " in " << (ceph_clock_now() - start) << " seconds" << dendl;
+  return 0;
+}
+
+void BlueStore::_invalidate_alloc_snapshot()
+{
+  ceph_assert(db);
+  ceph_assert(bluefs);
+  bufferlist bl;
+  db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_KEY, &bl);
+  if (bl.length()) {
+    dout(10) << __func__ << dendl;
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey(PREFIX_SUPER, ALLOC_SNAPSHOT_KEY);
+    db->submit_transaction_sync(t);
+  }
+  uint64_t size;
+  if (bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE,
+		   &size, nullptr) == 0) {
+    bluefs->unlink(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE);
+    bluefs->sync_metadata();
+  }
+}
+
+int64_t BlueStore::_fsck_check_alloc_snapshot()
+{
+  ceph_assert(alloc_snapshot_loaded);
+  dout(1) << __func__ << " checking allocator snapshot vs freelist" << dendl;
+
+  // the freelist doesn't know about bluefs extents, hence drop them
+  interval_set<uint64_t> expected;
+  fm->enumerate_reset();
+  uint64_t offset, length;
+  while (fm->enumerate_next(db, &offset, &length)) {
+    expected.union_insert(offset, length);
+  }
+  fm->enumerate_reset();
+  interval_set<uint64_t> bluefs_used;
+  bluefs_used.intersection_of(expected, bluefs_extents);
+  expected.subtract(bluefs_used);
+
+  interval_set<uint64_t> actual;
+  alloc->dump([&](uint64_t offset, uint64_t length) {
+    actual.union_insert(offset, length);
+  });
+
+  int64_t errors = 0;
+  if (!(actual == expected)) {
+    interval_set<uint64_t> common, only_snap(actual), only_fm(expected);
+    common.intersection_of(actual, expected);
+    only_snap.subtract(common);
+    only_fm.subtract(common);
+    derr << "fsck error: allocator snapshot doesn't match freelist, free in"
+	 << " snapshot only 0x" << std::hex << only_snap
+	 << ", free in freelist only 0x" << only_fm << std::dec << dendl;
+    ++errors;
+  }
+  return errors;
+}
+
+int BlueStore::_open_fsid(bool create)
+{
+  ceph_assert(fsid_fd < 0);
+  int flags = O_RDWR|O_CLOEXEC;
+  if (create)
     flags |= O_CREAT;
   fsid_fd = ::openat(path_fd, "fsid", flags, 0644);
   if (fsid_fd < 0) {
@@ -5573,6 +6497,10 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   map<string,string> kv_options;
   // force separate wal dir for all new deployments.
   kv_options["separate_wal_dir"] = 1;
+  if (db_resharding) {
+    // let an interrupted reshard be resumed
+    kv_options["resharding"] = "1";
+  }
   rocksdb::Env *env = NULL;
   if (do_bluefs) {
     dout(10) << __func__ << " initializing bluefs" << dendl;
@@ -5722,6 +6650,10 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   }
   dout(1) << __func__ << " opened " << kv_backend
 	  << " path " << fn << " options " << options << dendl;
+  if (bluefs && !create && !read_only) {
+    // freelist might be modified from now on
+    _invalidate_alloc_snapshot();
+  }
   return 0;
 }
 
@@ -5982,11 +6914,7 @@ int BlueStore::_open_collections()
        it->next()) {
     coll_t cid;
     if (cid.parse(it->key())) {
-      auto c = ceph::make_ref<Collection>(
-	  this,
-	  onode_cache_shards[cid.hash_to_shard(onode_cache_shards.size())],
-          buffer_cache_shards[cid.hash_to_shard(buffer_cache_shards.size())],
-	  cid);
+      auto c = _new_collection(cid);
       bufferlist bl = it->value();
       auto p = bl.cbegin();
       try {
@@ -6006,6 +6934,45 @@ int BlueStore::_open_collections()
       collections_had_errors = true;
     }
   }
+
+  // collections removed in bulk are kept around until their objects are
+  // reclaimed; their onodes are still valid, if unreachable
+  ceph_assert(bulk_removals.empty());
+  bulk_remove_colls.clear();
+  bulk_remove_osr = ceph::make_ref<OpSequencer>(this, coll_t());
+  it = db->get_iterator(PREFIX_BULK_REMOVE);
+  for (it->upper_bound(string());
+       it->valid();
+       it->next()) {
+    coll_t cid;
+    uint64_t nid = 0;
+    if (!get_bulk_remove_key_coll(it->key(), &cid, &nid)) {
+      derr << __func__ << " unrecognized bulk removal " << it->key() << dendl;
+      collections_had_errors = true;
+      continue;
+    }
+    auto c = _new_collection(cid);
+    bufferlist bl = it->value();
+    auto p = bl.cbegin();
+    try {
+      decode(c->cnode, p);
+    } catch (buffer::error& e) {
+      derr << __func__ << " failed to decode cnode, key:"
+	   << pretty_binary_string(it->key()) << dendl;
+      return -EIO;
+    }
+    dout(20) << __func__ << " reclaiming " << cid << " " << c
+	     << " " << c->cnode << dendl;
+    c->exists = false;
+    auto& r = bulk_removals[it->key()];
+    r.c = c;
+    r.nid = nid;
+    r.ready = true;
+  }
+  for (auto& [cid, c] : coll_map) {
+    std::unique_lock l(c->lock);
+    _bulk_remove_fence(c.get());
+  }
   return 0;
 }
 
@@ -6317,6 +7284,7 @@ int BlueStore::mkfs()
       t->set(PREFIX_SUPER, "per_pool_omap", bl);
     }
     ondisk_format = latest_ondisk_format;
+    compat_ondisk_format = 0;
     _prepare_ondisk_format_super(t);
     db->submit_transaction_sync(t);
   }
@@ -6766,21 +7734,84 @@ int BlueStore::expand_devices(ostream& out)
 void BlueStore::set_cache_shards(unsigned num)
 {
   dout(10) << __func__ << " " << num << dendl;
-  size_t oold = onode_cache_shards.size();
-  size_t bold = buffer_cache_shards.size();
-  ceph_assert(num >= oold && num >= bold);
-  onode_cache_shards.resize(num);
-  buffer_cache_shards.resize(num);
-  for (unsigned i = oold; i < num; ++i) {
-    onode_cache_shards[i] = 
-        OnodeCacheShard::create(cct, cct->_conf->bluestore_cache_type,
-                                 logger);
-  }
-  for (unsigned i = bold; i < num; ++i) {
-    buffer_cache_shards[i] = 
-        BufferCacheShard::create(cct, cct->_conf->bluestore_cache_type,
-                                 logger);
+  ceph_assert(num >= num_shared_cache_shards);
+
+  // the reservations are a startup option, parse them once
+  std::map<int64_t, cache_partition_t> partitions = cache_partitions;
+  map<string,string> reservations;
+  if (num_shared_cache_shards == 0) {
+    cct->_conf.with_val<string>("bluestore_cache_pool_reservations",
+                                get_str_map,
+                                &reservations,
+                                " ,\t");
+  }
+  double total_ratio = 0;
+  for (auto& [k, v] : reservations) {
+    string err;
+    int64_t pool = strict_strtoll(k.c_str(), 10, &err);
+    double ratio = err.empty() ? strict_strtod(v.c_str(), &err) : 0;
+    if (!err.empty() || pool < 0 || ratio <= 0 ||
+        total_ratio + ratio >= 1.0) {
+      derr << __func__ << " ignoring invalid cache reservation "
+           << k << "=" << v << dendl;
+      continue;
+    }
+    total_ratio += ratio;
+    partitions[pool].ratio = ratio;
   }
+
+  // shared shards first, then each partition's, all with the same
+  // fan-out; shards we already handed out to collections are kept
+  vector<OnodeCacheShard*> oshards;
+  vector<BufferCacheShard*> bshards;
+  auto add_shards = [&](unsigned first, unsigned old_num) {
+    for (unsigned i = 0; i < num; ++i) {
+      if (i < old_num) {
+        oshards.push_back(onode_cache_shards[first + i]);
+        bshards.push_back(buffer_cache_shards[first + i]);
+      } else {
+        oshards.push_back(
+          OnodeCacheShard::create(cct, cct->_conf->bluestore_cache_type,
+                                  logger));
+        bshards.push_back(
+          BufferCacheShard::create(cct, cct->_conf->bluestore_cache_type,
+                                   logger));
+      }
+    }
+  };
+  add_shards(0, num_shared_cache_shards);
+  for (auto& [pool, p] : partitions) {
+    unsigned old_first = p.first;
+    unsigned old_num = p.num;
+    p.first = oshards.size();
+    p.num = num;
+    add_shards(old_first, old_num);
+    if (!old_num) {
+      dout(1) << __func__ << " pool " << pool << " reserves " << p.ratio
+              << " of the cache" << dendl;
+    }
+  }
+  onode_cache_shards.swap(oshards);
+  buffer_cache_shards.swap(bshards);
+  cache_partitions.swap(partitions);
+  num_shared_cache_shards = num;
+}
+
+BlueStore::CollectionRef BlueStore::_new_collection(const coll_t& cid)
+{
+  unsigned first = 0;
+  unsigned num = num_shared_cache_shards;
+  auto p = cache_partitions.find(cid.pool());
+  if (p != cache_partitions.end()) {
+    first = p->second.first;
+    num = p->second.num;
+  }
+  unsigned shard = first + cid.hash_to_shard(num);
+  return ceph::make_ref<Collection>(
+    this,
+    onode_cache_shards[shard],
+    buffer_cache_shards[shard],
+    cid);
 }
 
 int BlueStore::_mount(bool kv_only, bool open_db)
@@ -6873,6 +7904,9 @@ int BlueStore::_mount(bool kv_only, bool open_db)
   if (r < 0)
     goto out_stop;
 
+  _compress_start();
+  _bulk_remove_start();
+  _tier_demote_start();
   mempool_thread.init();
 
   if (!per_pool_stat_collection &&
@@ -6910,14 +7944,26 @@ int BlueStore::umount()
   ceph_assert(_kv_only || mounted);
   dout(1) << __func__ << dendl;
 
+  if (!_kv_only) {
+    // it queues txcs of its own
+    _tier_demote_stop();
+  }
   _osr_drain_all();
 
   mounted = false;
   if (!_kv_only) {
     mempool_thread.shutdown();
+    _bulk_remove_stop();
+    _compress_stop();
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
     _flush_cache();
+    if (bluefs && cct->_conf.get_val<bool>("bluestore_alloc_snapshot")) {
+      // in-flight discards release their extents to the allocator once
+      // done; the snapshot must not miss them
+      bdev->discard_drain();
+      _write_alloc_snapshot();
+    }
     dout(20) << __func__ << " closing" << dendl;
 
   }
@@ -6938,7 +7984,7 @@ int BlueStore::umount()
   return 0;
 }
 
-int BlueStore::cold_open()
+int BlueStore::cold_open(bool read_only)
 {
   int r = _open_path();
   if (r < 0)
@@ -6958,7 +8004,7 @@ int BlueStore::cold_open()
   r = _open_bdev(false);
   if (r < 0)
     goto out_fsid;
-  r = _open_db_and_around(true);
+  r = _open_db_and_around(read_only);
   if (r < 0) {
     goto out_bdev;
   }
@@ -6980,6 +8026,29 @@ int BlueStore::cold_close()
   return 0;
 }
 
+int BlueStore::reshard_db(const string& new_cfs, ostream& out)
+{
+  map<string,string> cf_map;
+  int r = get_str_map(new_cfs, &cf_map, " \t");
+  if (r < 0) {
+    out << "invalid column families '" << new_cfs << "'" << std::endl;
+    return r;
+  }
+  vector<KeyValueDB::ColumnFamily> cfs;
+  for (auto& i : cf_map) {
+    cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+  }
+  db_resharding = true;
+  r = cold_open(false);
+  if (r == 0) {
+    dout(1) << __func__ << " " << new_cfs << dendl;
+    r = db->reshard(cfs, out);
+    cold_close();
+  }
+  db_resharding = false;
+  return r;
+}
+
 static void apply(uint64_t off,
                   uint64_t len,
                   uint64_t granularity,
@@ -7287,6 +8356,23 @@ BlueStore::OnodeRef BlueStore::fsck_check_objects_shallow(
     }
   } //for (auto& l : o->extent_map.extent_map)
 
+  if (o->onode.has_inline_data()) {
+    uint64_t inline_len = o->onode.inline_data.length();
+    if (!o->extent_map.extent_map.empty() ||
+	!o->onode.extent_map_shards.empty()) {
+      derr << "fsck error: " << oid << " has both inline data and extents"
+	   << dendl;
+      ++errors;
+    }
+    if (inline_len > o->onode.size) {
+      derr << "fsck error: " << oid << " inline data 0x" << std::hex
+	   << inline_len << " past EOF at 0x" << o->onode.size
+	   << std::dec << dendl;
+      ++errors;
+    }
+    res_statfs->data_stored += inline_len;
+  }
+
   for (auto& i : ref_map) {
     ++num_blobs;
     const bluestore_blob_t& blob = i.first->get_blob();
@@ -7604,57 +8690,33 @@ public:
   };
 };
 
-void BlueStore::_fsck_check_objects(FSCKDepth depth,
-  BlueStore::FSCK_ObjectCtx& ctx)
+size_t BlueStore::_fsck_check_object_range(FSCKDepth depth,
+  const string& start,
+  const string& end,
+  uint64_t_btree_t& used_nids,
+  BlueStore::FSCK_ObjectCtx& ctx,
+  fsck_offload_t offload)
 {
-  //no need for the below lock when in non-shallow mode as
-  // there is no multithreading in this case
-  if (depth != FSCK_SHALLOW) {
-    ctx.sb_info_lock = nullptr;
-  }
-
   auto& errors = ctx.errors;
   auto& warnings = ctx.warnings;
   auto used_omap_head = ctx.used_omap_head;
   auto used_per_pool_omap_head = ctx.used_per_pool_omap_head;
   auto used_pgmeta_omap_head = ctx.used_pgmeta_omap_head;
-  auto sb_info_lock = ctx.sb_info_lock;
-  auto sb_info = ctx.sb_info;
   auto repairer = ctx.repairer;
 
-  uint64_t_btree_t used_nids;
-
   size_t processed_myself = 0;
 
   auto it = db->get_iterator(PREFIX_OBJ);
   mempool::bluestore_fsck::list<string> expecting_shards;
   if (it) {
-    const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
-    typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
-    std::unique_ptr<WQ> wq(
-      new WQ(
-        "FSCKWorkQueue",
-        (thread_count ? : 1) * 32,
-        this,
-        expecting_shards,
-        sb_info_lock,
-        sb_info,
-        repairer));
-
-    ShallowFSCKThreadPool thread_pool(cct, "ShallowFSCKThreadPool", "ShallowFSCK", thread_count);
-
-    thread_pool.add_work_queue(wq.get());
-    if (depth == FSCK_SHALLOW && thread_count > 0) {
-      //not the best place but let's check anyway
-      ceph_assert(sb_info_lock);
-      thread_pool.start();
-    }
-
     //fill global if not overriden below
     CollectionRef c;
     int64_t pool_id = -1;
     spg_t pgid;
-    for (it->lower_bound(string()); it->valid(); it->next()) {
+    for (it->lower_bound(start); it->valid(); it->next()) {
+      if (!end.empty() && it->key() >= end) {
+        break;
+      }
       dout(30) << __func__ << " key "
         << pretty_binary_string(it->key()) << dendl;
       if (is_extent_shard_key(it->key())) {
@@ -7720,6 +8782,12 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
             break;
           }
         }
+        for (auto p = bulk_removals.begin(); !c && p != bulk_removals.end();
+             ++p) {
+          if (p->second.c->contains(oid)) {
+            c = p->second.c;
+          }
+        }
         if (!c) {
           derr << "fsck error: stray object " << oid
             << " not owned by any collection" << dendl;
@@ -7741,9 +8809,10 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
         expecting_shards.clear();
       }
 
+      ++fsck_progress.objects;
       bool queued = false;
-      if (depth == FSCK_SHALLOW && thread_count > 0) {
-        queued = wq->queue(
+      if (offload) {
+        queued = offload(
           pool_id,
           c,
           oid,
@@ -7932,19 +9001,232 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
           } while (offset < o->onode.size);
         } // deep
       } //if (depth != FSCK_SHALLOW)
-    } // for (it->lower_bound(string()); it->valid(); it->next())
-    if (depth == FSCK_SHALLOW && thread_count > 0) {
-      wq->finalize(thread_pool, ctx);
-      if (processed_myself) {
-        // may be needs more threads?
-        dout(0) << __func__ << " partial offload"
-                << ", done myself " << processed_myself
-                << " of " << ctx.num_objects
-                << "objects, threads " << thread_count
-                << dendl;
+    } // for (it->lower_bound(start); it->valid(); it->next())
+    if (depth != FSCK_SHALLOW &&
+      !expecting_shards.empty()) {
+      for (auto& k : expecting_shards) {
+        derr << "fsck error: missing shard key "
+          << pretty_binary_string(k) << dendl;
       }
+      ++errors;
     }
   } // if (it)
+  return processed_myself;
+}
+
+bool BlueStore::_fsck_check_objects_parallel(FSCKDepth depth,
+  size_t thread_count,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  // Split the object keyspace at collection boundaries.  Keys in between
+  // (stray objects) are picked up by the range preceding them, just like
+  // the serial walk would.
+  vector<string> bounds;
+  for (auto& [cid, c] : coll_map) {
+    string temp_start, temp_end, start, end;
+    get_coll_key_range(cid, c->cnode.bits, &temp_start, &temp_end,
+                       &start, &end);
+    bounds.push_back(start);
+    if (temp_start != end) {
+      bounds.push_back(temp_start);
+    }
+  }
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+  if (bounds.empty() || !bounds.front().empty()) {
+    bounds.insert(bounds.begin(), string());
+  }
+  size_t num_ranges = bounds.size();
+  fsck_progress.ranges = num_ranges;
+
+  // Every worker checks whole ranges against its own copy of the
+  // bookkeeping; results are merged in worker order once all are done.
+  struct worker_t {
+    int64_t errors = 0;
+    int64_t warnings = 0;
+    uint64_t num_objects = 0;
+    uint64_t num_extents = 0;
+    uint64_t num_blobs = 0;
+    uint64_t num_sharded_objects = 0;
+    uint64_t num_spanning_blobs = 0;
+    mempool_dynamic_bitset used_blocks;
+    uint64_t_btree_t used_nids;
+    uint64_t_btree_t used_omap_head;
+    uint64_t_btree_t used_per_pool_omap_head;
+    uint64_t_btree_t used_pgmeta_omap_head;
+    store_statfs_t expected_store_statfs;
+    per_pool_statfs expected_pool_statfs;
+  };
+  vector<worker_t> workers(thread_count);
+  vector<std::thread> threads;
+  std::atomic<size_t> next_range = {0};
+  for (size_t i = 0; i < thread_count; ++i) {
+    threads.push_back(make_named_thread("bstore_fsck", [&, i] {
+      auto& w = workers[i];
+      w.used_blocks.resize(ctx.used_blocks->size());
+      FSCK_ObjectCtx wctx(
+        w.errors,
+        w.warnings,
+        w.num_objects,
+        w.num_extents,
+        w.num_blobs,
+        w.num_sharded_objects,
+        w.num_spanning_blobs,
+        &w.used_blocks,
+        &w.used_omap_head,
+        &w.used_per_pool_omap_head,
+        &w.used_pgmeta_omap_head,
+        ctx.sb_info_lock,
+        ctx.sb_info,
+        w.expected_store_statfs,
+        w.expected_pool_statfs,
+        nullptr);
+      for (size_t r = next_range++; r < num_ranges; r = next_range++) {
+        _fsck_check_object_range(depth,
+          bounds[r],
+          r + 1 < num_ranges ? bounds[r + 1] : string(),
+          w.used_nids,
+          wctx,
+          nullptr);
+        ++fsck_progress.ranges_done;
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Blocks referenced twice are counted once per extent that reuses them,
+  // in key order, which the workers can't reproduce between them: they
+  // only keep the blocks.  Damage is the exception, so rather than keep
+  // every extent around, have the caller redo the walk serially then.
+  mempool_dynamic_bitset all_used_blocks(*ctx.used_blocks);
+  for (auto& w : workers) {
+    if (w.errors || all_used_blocks.intersects(w.used_blocks)) {
+      dout(1) << __func__ << " found errors, rechecking serially" << dendl;
+      ctx.sb_info.clear();
+      return false;
+    }
+    all_used_blocks |= w.used_blocks;
+    w.used_blocks.clear();
+  }
+  ctx.used_blocks->swap(all_used_blocks);
+
+  auto merge_ids = [&](const char* what,
+                       const uint64_t_btree_t& from,
+                       uint64_t_btree_t* to) {
+    for (auto id : from) {
+      if (!to->insert(id).second) {
+        derr << "fsck error: " << what << " 0x" << std::hex << id << std::dec
+             << " used by objects in different key ranges" << dendl;
+        ++ctx.errors;
+      }
+    }
+  };
+  uint64_t_btree_t used_nids;
+  for (auto& w : workers) {
+    ctx.errors += w.errors;
+    ctx.warnings += w.warnings;
+    ctx.num_objects += w.num_objects;
+    ctx.num_extents += w.num_extents;
+    ctx.num_blobs += w.num_blobs;
+    ctx.num_sharded_objects += w.num_sharded_objects;
+    ctx.num_spanning_blobs += w.num_spanning_blobs;
+    ctx.expected_store_statfs.add(w.expected_store_statfs);
+    for (auto& [pool, s] : w.expected_pool_statfs) {
+      ctx.expected_pool_statfs[pool].add(s);
+    }
+    merge_ids("nid", w.used_nids, &used_nids);
+    merge_ids("omap_head", w.used_omap_head, ctx.used_omap_head);
+    merge_ids("per-pool omap_head", w.used_per_pool_omap_head,
+              ctx.used_per_pool_omap_head);
+    merge_ids("pgmeta omap_head", w.used_pgmeta_omap_head,
+              ctx.used_pgmeta_omap_head);
+  }
+  return true;
+}
+
+void BlueStore::_fsck_check_objects(FSCKDepth depth,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  fsck_progress.objects = 0;
+  fsck_progress.ranges = 1;
+  fsck_progress.ranges_done = 0;
+
+  // Regular and deep checks split the keyspace across several threads;
+  // repair stays single-threaded so that it is applied in key order.
+  size_t thread_count = cct->_conf.get_val<int64_t>("bluestore_fsck_threads");
+  if (depth != FSCK_SHALLOW && !ctx.repairer && thread_count > 1 &&
+      coll_map.size() > 1) {
+    dout(1) << __func__ << " checking " << coll_map.size()
+            << " collections with " << thread_count << " threads" << dendl;
+    ceph_assert(ctx.sb_info_lock);
+    if (_fsck_check_objects_parallel(depth, thread_count, ctx)) {
+      return;
+    }
+    fsck_progress.objects = 0;
+    fsck_progress.ranges = 1;
+    fsck_progress.ranges_done = 0;
+  }
+
+  //no need for the below lock when in non-shallow mode as
+  // there is no multithreading in this case
+  if (depth != FSCK_SHALLOW) {
+    ctx.sb_info_lock = nullptr;
+  }
+
+  uint64_t_btree_t used_nids;
+  size_t processed_myself = 0;
+
+  thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
+  mempool::bluestore_fsck::list<string> expecting_shards;
+  typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
+  std::unique_ptr<WQ> wq(
+    new WQ(
+      "FSCKWorkQueue",
+      (thread_count ? : 1) * 32,
+      this,
+      expecting_shards,
+      ctx.sb_info_lock,
+      ctx.sb_info,
+      ctx.repairer));
+
+  ShallowFSCKThreadPool thread_pool(cct, "ShallowFSCKThreadPool", "ShallowFSCK", thread_count);
+
+  thread_pool.add_work_queue(wq.get());
+  fsck_offload_t offload;
+  if (depth == FSCK_SHALLOW && thread_count > 0) {
+    //not the best place but let's check anyway
+    ceph_assert(ctx.sb_info_lock);
+    thread_pool.start();
+    offload = [&](int64_t pool_id,
+                  CollectionRef c,
+                  const ghobject_t& oid,
+                  const string& key,
+                  const bufferlist& value) {
+      return wq->queue(pool_id, c, oid, key, value);
+    };
+  }
+
+  processed_myself = _fsck_check_object_range(depth,
+    string(),
+    string(),
+    used_nids,
+    ctx,
+    offload);
+  fsck_progress.ranges_done = 1;
+
+  if (depth == FSCK_SHALLOW && thread_count > 0) {
+    wq->finalize(thread_pool, ctx);
+    if (processed_myself) {
+      // may be needs more threads?
+      dout(0) << __func__ << " partial offload"
+              << ", done myself " << processed_myself
+              << " of " << ctx.num_objects
+              << "objects, threads " << thread_count
+              << dendl;
+    }
+  }
 }
 /**
 An overview for currently implemented repair logics 
@@ -8704,6 +9986,16 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
         used_blocks.flip();
       }
     }
+    if (alloc_snapshot_loaded) {
+      auto e = _fsck_check_alloc_snapshot();
+      errors += e;
+      if (e && repair) {
+	// drop the stale snapshot so that the next mount rebuilds the
+	// allocator from the freelist
+	_invalidate_alloc_snapshot();
+	repairer.inc_repaired();
+      }
+    }
   }
   if (repair) {
     dout(5) << __func__ << " applying repair results" << dendl;
@@ -9118,8 +10410,8 @@ BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
 void BlueStore::_queue_reap_collection(CollectionRef& c)
 {
   dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-  // _reap_collections and this in the same thread,
-  // so no need a lock.
+  // the kv_finalize threads all queue and reap
+  std::lock_guard l(removed_collections_lock);
   removed_collections.push_back(c);
 }
 
@@ -9128,8 +10420,7 @@ void BlueStore::_reap_collections()
 
   list<CollectionRef> removed_colls;
   {
-    // _queue_reap_collection and this in the same thread.
-    // So no need a lock.
+    std::lock_guard l(removed_collections_lock);
     if (!removed_collections.empty())
       removed_colls.swap(removed_collections);
     else
@@ -9159,6 +10450,7 @@ void BlueStore::_reap_collections()
   if (removed_colls.empty()) {
     dout(10) << __func__ << " all reaped" << dendl;
   } else {
+    std::lock_guard l(removed_collections_lock);
     removed_collections.splice(removed_collections.begin(), removed_colls);
   }
 }
@@ -9184,6 +10476,63 @@ void BlueStore::_update_cache_logger()
   logger->set(l_bluestore_buffer_bytes, num_buffer_bytes);
 }
 
+void BlueStore::dump_cache_pool_stats(Formatter *f)
+{
+  struct pool_cache_stats_t {
+    uint64_t onode_hits = 0;
+    uint64_t onode_misses = 0;
+    uint64_t buffer_hit_bytes = 0;
+    uint64_t buffer_miss_bytes = 0;
+  };
+  std::map<int64_t, pool_cache_stats_t> pools;
+  {
+    std::shared_lock l(coll_lock);
+    for (auto& [cid, c] : coll_map) {
+      auto& s = pools[c->pool()];
+      s.onode_hits += c->cache_stats.onode_hits;
+      s.onode_misses += c->cache_stats.onode_misses;
+      s.buffer_hit_bytes += c->cache_stats.buffer_hit_bytes;
+      s.buffer_miss_bytes += c->cache_stats.buffer_miss_bytes;
+    }
+  }
+
+  f->open_object_section("cache_pool_stats");
+  f->dump_string("cache_type", cct->_conf->bluestore_cache_type);
+  f->open_array_section("partitions");
+  for (auto& [pool, p] : cache_partitions) {
+    uint64_t onodes = 0, max_onodes = 0;
+    uint64_t bytes = 0, max_bytes = 0;
+    for (unsigned i = p.first; i < p.first + p.num; ++i) {
+      onodes += onode_cache_shards[i]->_get_num();
+      max_onodes += onode_cache_shards[i]->max;
+      bytes += buffer_cache_shards[i]->_get_bytes();
+      max_bytes += buffer_cache_shards[i]->max;
+    }
+    f->open_object_section("partition");
+    f->dump_int("pool", pool);
+    f->dump_float("reserved_ratio", p.ratio);
+    f->dump_unsigned("onodes", onodes);
+    f->dump_unsigned("max_onodes", max_onodes);
+    f->dump_unsigned("buffer_bytes", bytes);
+    f->dump_unsigned("max_buffer_bytes", max_bytes);
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("pools");
+  for (auto& [pool, s] : pools) {
+    f->open_object_section("pool");
+    f->dump_int("pool", pool);
+    f->dump_bool("partitioned", cache_partitions.count(pool));
+    f->dump_unsigned("onode_hits", s.onode_hits);
+    f->dump_unsigned("onode_misses", s.onode_misses);
+    f->dump_unsigned("buffer_hit_bytes", s.buffer_hit_bytes);
+    f->dump_unsigned("buffer_miss_bytes", s.buffer_miss_bytes);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
 // ---------------
 // read operations
 
@@ -9196,11 +10545,7 @@ ObjectStore::CollectionHandle BlueStore::create_new_collection(
   const coll_t& cid)
 {
   std::unique_lock l{coll_lock};
-  auto c = ceph::make_ref<Collection>(
-    this,
-    onode_cache_shards[cid.hash_to_shard(onode_cache_shards.size())],
-    buffer_cache_shards[cid.hash_to_shard(buffer_cache_shards.size())],
-    cid);
+  auto c = _new_collection(cid);
   new_coll_map[cid] = c;
   _osr_attach(c.get());
   return c;
@@ -9320,6 +10665,8 @@ int BlueStore::read(
     r = _do_read(c, o, offset, length, bl, op_flags);
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
+    } else if (r >= 0) {
+      _tier_note_read(o);
     }
   }
 
@@ -9377,6 +10724,8 @@ void BlueStore::_read_cache(
     bptr->shared_blob->bc.read(
       bptr->shared_blob->get_cache(), b_off, b_len, cache_res, cache_interval,
       read_cache_policy);
+    o->c->cache_stats.buffer_hit_bytes += cache_interval.size();
+    o->c->cache_stats.buffer_miss_bytes += b_len - cache_interval.size();
     dout(20) << __func__ << "  blob " << *bptr << std::hex
              << " need 0x" << b_off << "~" << b_len
              << " cache has 0x" << cache_interval
@@ -9521,6 +10870,12 @@ int BlueStore::_generate_read_result_bl(
   bool* csum_error,
   bufferlist& bl)
 {
+  // so far ready_regions only holds what _read_cache found in the cache
+  uint64_t cached_bytes = 0;
+  for (auto& r : ready_regions) {
+    cached_bytes += r.second.length();
+  }
+
  // enumerate and decompress desired blobs
   auto p = compressed_blob_bls.begin();
   blobs2read_t::iterator b2r_it = blobs2read.begin();
@@ -9572,7 +10927,8 @@ int BlueStore::_generate_read_result_bl(
     ++b2r_it;
   }
 
-  // generate a resulting buffer
+  // generate a resulting buffer; cached and freshly read data is
+  // passed on by reference, only the holes are materialized here
   auto pr = ready_regions.begin();
   auto pr_end = ready_regions.end();
   uint64_t pos = 0;
@@ -9600,6 +10956,7 @@ int BlueStore::_generate_read_result_bl(
   ceph_assert(bl.length() == length);
   ceph_assert(pos == length);
   ceph_assert(pr == pr_end);
+  logger->inc(l_bluestore_read_zero_copy_bytes, cached_bytes);
   return 0;
 }
 
@@ -9642,6 +10999,11 @@ int BlueStore::_do_read(
     length = o->onode.size - offset;
   }
 
+  if (o->onode.has_inline_data()) {
+    _read_inline(o, offset, length, bl);
+    return bl.length();
+  }
+
   auto start = mono_clock::now();
   o->extent_map.fault_range(db, offset, length);
   log_latency(__func__,
@@ -9804,9 +11166,269 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
   return r;
 }
 
-// this stores fiemap into interval_set, other variations
-// use it internally
-int BlueStore::_fiemap(
+int BlueStore::checksum_digest(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t length,
+  uint32_t *crc)
+{
+  auto start = mono_clock::now();
+  Collection *c = static_cast<Collection *>(c_.get());
+  const coll_t &cid = c->get_cid();
+  dout(15) << __func__ << " " << cid << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
+	   << dendl;
+  if (!c->exists)
+    return -ENOENT;
+
+  int r;
+  {
+    std::shared_lock l(c->lock);
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      r = -ENOENT;
+      goto out;
+    }
+    r = _do_checksum_digest(o, offset, length, crc);
+    if (r == -EIO) {
+      logger->inc(l_bluestore_read_eio);
+    }
+  }
+
+ out:
+  if (r >= 0 && _debug_data_eio(oid)) {
+    r = -EIO;
+    derr << __func__ << " " << c->cid << " " << oid << " INJECT EIO" << dendl;
+  }
+  dout(10) << __func__ << " " << cid << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length
+	   << " crc 0x" << *crc << std::dec
+	   << " = " << r << dendl;
+  log_latency(__func__,
+    l_bluestore_read_lat,
+    mono_clock::now() - start,
+    cct->_conf->bluestore_log_op_age);
+  return r;
+}
+
+int BlueStore::_do_checksum_digest(
+  OnodeRef o,
+  uint64_t offset,
+  size_t length,
+  uint32_t *crc,
+  uint64_t retry_count)
+{
+  int r = 0;
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+           << " size 0x" << o->onode.size << std::dec << dendl;
+  if (offset >= o->onode.size) {
+    return r;
+  }
+  if (offset + length > o->onode.size) {
+    length = o->onode.size - offset;
+  }
+  if (o->onode.has_inline_data()) {
+    bufferlist bl;
+    _read_inline(o, offset, length, bl);
+    *crc = bl.crc32c(*crc);
+    return bl.length();
+  }
+
+  o->extent_map.fault_range(db, offset, length);
+
+  // data that is not on the device yet comes from the cache, everything
+  // else is read back, as with CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE
+  ready_regions_t ready_regions;
+  blobs2read_t blobs2read;
+  _read_cache(o, offset, length, BufferSpace::BYPASS_CLEAN_CACHE,
+	      ready_regions, blobs2read);
+
+  // issue the reads in device order, so that a fragmented object still
+  // takes a single sweep of the disk
+  struct pending_read_t {
+    uint64_t disk_offset;
+    Blob *blob;
+    read_req_t *req;  ///< or null to read a whole compressed blob
+  };
+  vector<pending_read_t> pending;
+  map<Blob*, bufferlist> compressed_bls;
+  for (auto& p : blobs2read) {
+    const bluestore_blob_t& b = p.first->get_blob();
+    if (b.is_compressed()) {
+      pending.push_back(
+	pending_read_t{b.get_extents().front().offset, p.first.get(), nullptr});
+    } else {
+      for (auto& req : p.second) {
+	pending.push_back(
+	  pending_read_t{b.calc_offset(req.r_off, nullptr), p.first.get(),
+			 &req});
+      }
+    }
+  }
+  std::sort(pending.begin(), pending.end(),
+	    [](const pending_read_t& a, const pending_read_t& b) {
+	      return a.disk_offset < b.disk_offset;
+	    });
+
+  auto start = mono_clock::now();
+  IOContext ioc(cct, NULL, true); // allow EIO
+  for (auto& p : pending) {
+    const bluestore_blob_t& b = p.blob->get_blob();
+    bufferlist& bl = p.req ? p.req->bl : compressed_bls[p.blob];
+    r = b.map(
+      p.req ? p.req->r_off : 0,
+      p.req ? p.req->r_len : b.get_ondisk_length(),
+      [&](uint64_t offset, uint64_t length) {
+	return bdev->aio_read(offset, length, &bl, &ioc);
+      });
+    if (r < 0) {
+      derr << __func__ << " bdev-read failed: " << cpp_strerror(r) << dendl;
+      if (r == -EIO) {
+	return r;
+      }
+      ceph_assert(r == 0);
+    }
+  }
+  if (ioc.has_pending_aios()) {
+    bdev->aio_submit(&ioc);
+    dout(20) << __func__ << " waiting for aio" << dendl;
+    ioc.aio_wait();
+    r = ioc.get_return_value();
+    if (r < 0) {
+      ceph_assert(r == -EIO); // no other errors allowed
+      return -EIO;
+    }
+  }
+  log_latency(__func__,
+    l_bluestore_read_wait_aio_lat,
+    mono_clock::now() - start,
+    cct->_conf->bluestore_log_op_age);
+
+  // Verify everything, then digest in logical order.  The crc32c of a
+  // csum chunk is the checksum we just verified, so for whole chunks of
+  // crc32c blobs the digest is folded from those instead of hashing the
+  // data a second time.
+  struct csum_run_t {
+    const bluestore_blob_t *blob;
+    uint64_t blob_xoffset;
+    uint64_t length;
+  };
+  map<uint64_t, csum_run_t> csum_runs;
+  bool csum_error = false;
+  bool fold = !cct->_conf->bluestore_ignore_data_csum;
+  for (auto& p : blobs2read) {
+    const bluestore_blob_t& b = p.first->get_blob();
+    regions2read_t& r2r = p.second;
+    if (b.is_compressed()) {
+      bufferlist& compressed_bl = compressed_bls[p.first.get()];
+      if (_verify_csum(o, &b, 0, compressed_bl,
+		       r2r.front().regs.front().logical_offset) < 0) {
+	csum_error = true;
+	break;
+      }
+      bufferlist raw_bl;
+      r = _decompress(compressed_bl, &raw_bl);
+      if (r < 0)
+	return r;
+      for (auto& req : r2r) {
+	for (auto& reg : req.regs) {
+	  ready_regions[reg.logical_offset].substr_of(
+	    raw_bl, reg.blob_xoffset, reg.length);
+	}
+      }
+      continue;
+    }
+    uint64_t chunk_size = b.get_csum_chunk_size();
+    for (auto& req : r2r) {
+      if (_verify_csum(o, &b, req.r_off, req.bl,
+		       req.regs.front().logical_offset) < 0) {
+	csum_error = true;
+	break;
+      }
+      for (auto& reg : req.regs) {
+	uint64_t head = 0, tail = 0;
+	if (fold && b.csum_type == Checksummer::CSUM_CRC32C) {
+	  head = p2roundup(reg.blob_xoffset, chunk_size) - reg.blob_xoffset;
+	  tail = (reg.blob_xoffset + reg.length) % chunk_size;
+	}
+	if (head + tail >= reg.length) {
+	  ready_regions[reg.logical_offset].substr_of(
+	    req.bl, reg.front, reg.length);
+	  continue;
+	}
+	if (head) {
+	  ready_regions[reg.logical_offset].substr_of(req.bl, reg.front, head);
+	}
+	csum_runs[reg.logical_offset + head] = csum_run_t{
+	  &b, reg.blob_xoffset + head, reg.length - head - tail};
+	if (tail) {
+	  ready_regions[reg.logical_offset + reg.length - tail].substr_of(
+	    req.bl, reg.front + reg.length - tail, tail);
+	}
+      }
+    }
+    if (csum_error)
+      break;
+  }
+  if (csum_error) {
+    // see _do_read
+    if (retry_count >= cct->_conf->bluestore_retry_disk_reads) {
+      return -EIO;
+    }
+    return _do_checksum_digest(o, offset, length, crc, retry_count + 1);
+  }
+
+  uint32_t h = *crc;
+  uint64_t pos = offset;
+  uint64_t end = offset + length;
+  uint64_t folded = 0;
+  auto pr = ready_regions.begin();
+  auto pc = csum_runs.begin();
+  while (pos < end) {
+    if (pr != ready_regions.end() && pr->first == pos) {
+      h = pr->second.crc32c(h);
+      pos += pr->second.length();
+      ++pr;
+    } else if (pc != csum_runs.end() && pc->first == pos) {
+      const bluestore_blob_t *b = pc->second.blob;
+      uint64_t chunk_size = b->get_csum_chunk_size();
+      for (uint64_t x = pc->second.blob_xoffset;
+	   x < pc->second.blob_xoffset + pc->second.length;
+	   x += chunk_size) {
+	// crc(data, h) == crc(data, -1) ^ crc(zeros, h ^ -1)
+	h = b->get_csum_item(x / chunk_size) ^
+	  ceph_crc32c(h ^ 0xffffffff, nullptr, chunk_size);
+      }
+      pos += pc->second.length;
+      folded += pc->second.length;
+      ++pc;
+    } else {
+      // a hole
+      uint64_t l = end - pos;
+      if (pr != ready_regions.end()) {
+	l = std::min(l, pr->first - pos);
+      }
+      if (pc != csum_runs.end()) {
+	l = std::min(l, pc->first - pos);
+      }
+      h = ceph_crc32c(h, nullptr, l);
+      pos += l;
+    }
+  }
+  ceph_assert(pos == end);
+  *crc = h;
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << " folded 0x" << folded << " from checksums" << std::dec << dendl;
+  if (retry_count) {
+    logger->inc(l_bluestore_reads_with_retries);
+  }
+  return length;
+}
+
+// this stores fiemap into interval_set, other variations
+// use it internally
+int BlueStore::_fiemap(
   CollectionHandle &c_,
   const ghobject_t& oid,
   uint64_t offset,
@@ -9836,6 +11458,15 @@ int BlueStore::_fiemap(
       length = o->onode.size - offset;
     }
 
+    if (o->onode.has_inline_data()) {
+      // whatever is past the inline data reads as zeros, i.e. a hole
+      uint64_t inline_len = o->onode.inline_data.length();
+      if (offset < inline_len) {
+	destset.insert(offset, std::min<uint64_t>(length, inline_len - offset));
+      }
+      goto out;
+    }
+
     o->extent_map.fault_range(db, offset, length);
     eend = o->extent_map.extent_map.end();
     ep = o->extent_map.seek_lextent(offset);
@@ -9942,6 +11573,9 @@ int BlueStore::readv(
     }
 
     r = _do_readv(c, o, m, bl, op_flags);
+    if (r >= 0) {
+      _tier_note_read(o);
+    }
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
     }
@@ -10003,6 +11637,14 @@ int BlueStore::_do_readv(
   // call fiemap first!
   ceph_assert(m.range_start() <= o->onode.size);
   ceph_assert(m.range_end() <= o->onode.size);
+  if (o->onode.has_inline_data()) {
+    for (auto p = m.begin(); p != m.end(); ++p) {
+      bufferlist t;
+      _read_inline(o, p.get_start(), p.get_len(), t);
+      bl.claim_append(t);
+    }
+    return bl.length();
+  }
   auto start = mono_clock::now();
   o->extent_map.fault_range(db, m.range_start(), m.range_end() - m.range_start());
   log_latency(__func__,
@@ -10341,6 +11983,12 @@ int BlueStore::_collection_list(
       it->next();
       continue;
     }
+    if (!c->bulk_fences.empty() && c->is_bulk_stale(it->key(), it->value())) {
+      dout(20) << __func__ << " key " << pretty_binary_string(it->key())
+	       << " left by a bulk removal" << dendl;
+      it->next();
+      continue;
+    }
     ghobject_t oid;
     int r = get_key_object(it->key(), &oid);
     ceph_assert(r == 0);
@@ -10545,15 +12193,18 @@ int BlueStore::omap_get_values(
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
     size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
+    set<string> db_keys;
+    for (auto& k : keys) {
       final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
-      }
+      final_key += k;
+      db_keys.insert(db_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, db_keys, &vals);
+    for (auto& [key, val] : vals) {
+      dout(30) << __func__ << "  got " << pretty_binary_string(key)
+	       << " -> " << key.substr(base_key_len) << dendl;
+      out->emplace(key.substr(base_key_len), std::move(val));
     }
   }
  out:
@@ -10589,17 +12240,22 @@ int BlueStore::omap_check_keys(
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
     size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
+    set<string> db_keys;
+    for (auto& k : keys) {
       final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(*p);
+      final_key += k;
+      db_keys.insert(db_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, db_keys, &vals);
+    for (auto& k : db_keys) {
+      if (vals.count(k)) {
+	dout(30) << __func__ << "  have " << pretty_binary_string(k)
+		 << " -> " << k.substr(base_key_len) << dendl;
+	out->insert(k.substr(base_key_len));
       } else {
-	dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
+	dout(30) << __func__ << "  miss " << pretty_binary_string(k)
+		 << " -> " << k.substr(base_key_len) << dendl;
       }
     }
   }
@@ -10644,17 +12300,42 @@ void BlueStore::_prepare_ondisk_format_super(KeyValueDB::Transaction& t)
   dout(10) << __func__ << " ondisk_format " << ondisk_format
 	   << " min_compat_ondisk_format " << min_compat_ondisk_format
 	   << dendl;
-  ceph_assert(ondisk_format == latest_ondisk_format);
+  ceph_assert(ondisk_format <= latest_ondisk_format);
   {
     bufferlist bl;
     encode(ondisk_format, bl);
     t->set(PREFIX_SUPER, "ondisk_format", bl);
   }
   {
+    int32_t compat = std::max(min_compat_ondisk_format,
+                              compat_ondisk_format.load());
     bufferlist bl;
-    encode(min_compat_ondisk_format, bl);
+    encode(compat, bl);
     t->set(PREFIX_SUPER, "min_compat_ondisk_format", bl);
+    compat_ondisk_format = compat;
+  }
+}
+
+void BlueStore::_require_compat_ondisk_format(int32_t v)
+{
+  if (compat_ondisk_format >= v) {
+    return;
+  }
+  std::lock_guard l(compat_ondisk_format_lock);
+  if (compat_ondisk_format >= v) {
+    return;
   }
+  dout(1) << __func__ << " raising min_compat_ondisk_format from "
+	  << compat_ondisk_format << " to " << v << dendl;
+  ceph_assert(v <= ondisk_format);
+  // synchronously, so that nothing depending on it can commit first
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist bl;
+  encode(v, bl);
+  t->set(PREFIX_SUPER, "min_compat_ondisk_format", bl);
+  int r = db->submit_transaction_sync(t);
+  ceph_assert(r == 0);
+  compat_ondisk_format = v;
 }
 
 int BlueStore::_open_super_meta()
@@ -10708,7 +12389,7 @@ int BlueStore::_open_super_meta()
   }
 
   // ondisk format
-  int32_t compat_ondisk_format = 0;
+  compat_ondisk_format = 0;
   {
     bufferlist bl;
     int r = db->get(PREFIX_SUPER, "ondisk_format", &bl);
@@ -10732,7 +12413,9 @@ int BlueStore::_open_super_meta()
 	ceph_assert(!r);
 	auto p = bl.cbegin();
 	try {
-	  decode(compat_ondisk_format, p);
+	  int32_t compat;
+	  decode(compat, p);
+	  compat_ondisk_format = compat;
 	} catch (buffer::error& e) {
 	  derr << __func__ << " unable to read compat_ondisk_format" << dendl;
 	  return -EIO;
@@ -10786,6 +12469,8 @@ int BlueStore::_open_super_meta()
   _set_throttle_params();
 
   _set_csum();
+  _set_extent_map_encoding();
+  _set_tier_params();
   _set_compression();
   _set_blob_size();
 
@@ -10842,6 +12527,30 @@ int BlueStore::_upgrade_super()
       int r = db->submit_transaction_sync(t);
       ceph_assert(r == 0);
     }
+    if (ondisk_format == 3) {
+      // changes:
+      // - onode may keep the data of a small object inline
+      //   (FLAG_INLINE_DATA).  Older releases would read it as a hole, so
+      //   min_compat_ondisk_format is raised to 4 once the first such
+      //   onode is written; stores that never do stay readable by them.
+      ondisk_format = 4;
+      KeyValueDB::Transaction t = db->get_transaction();
+      _prepare_ondisk_format_super(t);
+      int r = db->submit_transaction_sync(t);
+      ceph_assert(r == 0);
+    }
+    if (ondisk_format == 4) {
+      // changes:
+      // - extent map shards may use the packed encoding (struct_v 3),
+      //   which older releases assert on.  As with inline data,
+      //   min_compat_ondisk_format is raised to 5 only once the first
+      //   such shard is written.
+      ondisk_format = 5;
+      KeyValueDB::Transaction t = db->get_transaction();
+      _prepare_ondisk_format_super(t);
+      int r = db->submit_transaction_sync(t);
+      ceph_assert(r == 0);
+    }
   }
   // done
   dout(1) << __func__ << " done" << dendl;
@@ -11282,6 +12991,20 @@ void BlueStore::_txc_finish(TransContext *txc)
     // blocks
     auto txc = &releasing_txc.front();
     _txc_release_alloc(txc);
+    if (!txc->bulk_removed_collections.empty() ||
+	!txc->bulk_claims.empty()) {
+      for (auto& o : txc->bulk_claims) {
+	o->c->onode_map.remove(o->oid);
+      }
+      std::lock_guard l(bulk_remove_lock);
+      for (auto& id : txc->bulk_removed_collections) {
+	bulk_removals[id].ready = true;
+      }
+      for (auto& o : txc->bulk_claims) {
+	bulk_claimed.erase(string(o->key.c_str(), o->key.size()));
+      }
+      bulk_remove_cond.notify_all();
+    }
     releasing_txc.pop_front();
     txc->log_state_latency(logger, l_bluestore_state_done_lat);
     delete txc;
@@ -11451,9 +13174,9 @@ void BlueStore::_osr_drain_all()
     std::lock_guard l(kv_lock);
     kv_cond.notify_one();
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_cond.notify_one();
+  for (auto& sh : kv_finalize_shards) {
+    std::lock_guard l(sh->lock);
+    sh->cond.notify_one();
   }
   for (auto osr : s) {
     dout(20) << __func__ << " drain " << osr << dendl;
@@ -11488,7 +13211,13 @@ void BlueStore::_kv_start()
 
   finisher.start();
   kv_sync_thread.create("bstore_kv_sync");
-  kv_finalize_thread.create("bstore_kv_final");
+  unsigned n = std::max<uint64_t>(
+    1, cct->_conf.get_val<uint64_t>("bluestore_kv_finalize_threads"));
+  dout(10) << __func__ << " " << n << " kv_finalize threads" << dendl;
+  for (unsigned i = 0; i < n; ++i) {
+    kv_finalize_shards.emplace_back(new KVFinalizeShard(this));
+    kv_finalize_shards.back()->thread.create("bstore_kv_final");
+  }
 }
 
 void BlueStore::_kv_stop()
@@ -11502,25 +13231,26 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
-  {
-    std::unique_lock l{kv_finalize_lock};
-    while (!kv_finalize_started) {
-      kv_finalize_cond.wait(l);
+  // the sync thread may still hand work to the finalize threads until
+  // it is gone
+  kv_sync_thread.join();
+  for (auto& sh : kv_finalize_shards) {
+    std::unique_lock l{sh->lock};
+    while (!sh->started) {
+      sh->cond.wait(l);
     }
-    kv_finalize_stop = true;
-    kv_finalize_cond.notify_all();
+    sh->stop = true;
+    sh->cond.notify_all();
   }
-  kv_sync_thread.join();
-  kv_finalize_thread.join();
+  for (auto& sh : kv_finalize_shards) {
+    sh->thread.join();
+  }
+  kv_finalize_shards.clear();
   ceph_assert(removed_collections.empty());
   {
     std::lock_guard l(kv_lock);
     kv_stop = false;
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_stop = false;
-  }
   dout(10) << __func__ << " stopping finishers" << dendl;
   finisher.wait_for_empty();
   finisher.stop();
@@ -11691,29 +13421,55 @@ void BlueStore::_kv_sync_thread()
       int committing_size = kv_committing.size();
       int deferred_size = deferred_stable.size();
 
-      {
-	std::unique_lock m{kv_finalize_lock};
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
+      logger->inc(l_bluestore_kv_sync_txcs, committing_size);
+      if (kv_finalize_shards.size() == 1) {
+	auto& sh = *kv_finalize_shards.front();
+	std::unique_lock m{sh.lock};
+	if (sh.kv_committing_to_finalize.empty()) {
+	  sh.kv_committing_to_finalize.swap(kv_committing);
 	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
+	  sh.kv_committing_to_finalize.insert(
+	      sh.kv_committing_to_finalize.end(),
 	      kv_committing.begin(),
 	      kv_committing.end());
 	  kv_committing.clear();
 	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
+	if (sh.deferred_stable_to_finalize.empty()) {
+	  sh.deferred_stable_to_finalize.swap(deferred_stable);
 	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
+	  sh.deferred_stable_to_finalize.insert(
+	      sh.deferred_stable_to_finalize.end(),
 	      deferred_stable.begin(),
 	      deferred_stable.end());
 	  deferred_stable.clear();
 	}
-	if (!kv_finalize_in_progress) {
-	  kv_finalize_in_progress = true;
-	  kv_finalize_cond.notify_one();
+	if (!sh.in_progress) {
+	  sh.in_progress = true;
+	  sh.cond.notify_one();
+	}
+      } else {
+	// each osr always lands on the same shard, so its txcs (and
+	// deferred batches) are still finalized in commit order
+	for (auto txc : kv_committing) {
+	  auto& sh = _kv_finalize_shard(txc->osr.get());
+	  std::lock_guard m{sh.lock};
+	  sh.kv_committing_to_finalize.push_back(txc);
+	}
+	kv_committing.clear();
+	for (auto b : deferred_stable) {
+	  auto& sh = _kv_finalize_shard(b->osr);
+	  std::lock_guard m{sh.lock};
+	  sh.deferred_stable_to_finalize.push_back(b);
+	}
+	deferred_stable.clear();
+	for (auto& sh : kv_finalize_shards) {
+	  std::lock_guard m{sh->lock};
+	  if (!sh->in_progress &&
+	      (!sh->kv_committing_to_finalize.empty() ||
+	       !sh->deferred_stable_to_finalize.empty())) {
+	    sh->in_progress = true;
+	    sh->cond.notify_one();
+	  }
 	}
       }
 
@@ -11782,34 +13538,35 @@ clear:
   kv_sync_started = false;
 }
 
-void BlueStore::_kv_finalize_thread()
+void BlueStore::_kv_finalize_thread(KVFinalizeShard& shard)
 {
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
   dout(10) << __func__ << " start" << dendl;
-  std::unique_lock l(kv_finalize_lock);
-  ceph_assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
+  std::unique_lock l(shard.lock);
+  ceph_assert(!shard.started);
+  shard.started = true;
+  shard.cond.notify_all();
   while (true) {
     ceph_assert(kv_committed.empty());
     ceph_assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
+    if (shard.kv_committing_to_finalize.empty() &&
+	shard.deferred_stable_to_finalize.empty()) {
+      if (shard.stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_in_progress = false;
-      kv_finalize_cond.wait(l);
+      shard.in_progress = false;
+      shard.cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
+      kv_committed.swap(shard.kv_committing_to_finalize);
+      deferred_stable.swap(shard.deferred_stable_to_finalize);
       l.unlock();
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
 
       auto start = mono_clock::now();
+      uint64_t num_committed = kv_committed.size();
 
       while (!kv_committed.empty()) {
 	TransContext *txc = kv_committed.front();
@@ -11848,10 +13605,11 @@ void BlueStore::_kv_finalize_thread()
 	cct->_conf->bluestore_log_op_age);
 
       l.lock();
+      shard.txcs_finalized += num_committed;
     }
   }
   dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
+  shard.started = false;
 }
 
 bluestore_deferred_op_t *BlueStore::_get_deferred_op(
@@ -11903,19 +13661,28 @@ void BlueStore::deferred_try_submit()
   vector<OpSequencerRef> osrs;
   osrs.reserve(deferred_queue.size());
   for (auto& osr : deferred_queue) {
-    osrs.push_back(&osr);
-  }
-  for (auto& osr : osrs) {
-    if (osr->deferred_pending) {
-      if (!osr->deferred_running) {
-	_deferred_submit_unlock(osr.get());
-	deferred_lock.lock();
+    if (osr.deferred_pending) {
+      if (!osr.deferred_running) {
+	osrs.push_back(&osr);
       } else {
-	dout(20) << __func__ << "  osr " << osr << " already has running"
+	dout(20) << __func__ << "  osr " << &osr << " already has running"
 		 << dendl;
       }
     } else {
-      dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
+      dout(20) << __func__ << "  osr " << &osr << " has no pending" << dendl;
+    }
+  }
+  if (osrs.size() > 1 &&
+      cct->_conf.get_val<bool>("bluestore_deferred_aggregate")) {
+    _deferred_submit_aggregate_unlock(osrs);
+    deferred_lock.lock();
+  } else {
+    for (auto& osr : osrs) {
+      // deferred_lock is dropped on every submit, recheck
+      if (osr->deferred_pending && !osr->deferred_running) {
+	_deferred_submit_unlock(osr.get());
+	deferred_lock.lock();
+      }
     }
   }
 
@@ -11942,11 +13709,95 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
   }
+  logger->inc(l_bluestore_deferred_merge_in_ops, b->iomap.size());
+  _deferred_write_iomap(b->iomap, &b->ioc);
+
+  bdev->aio_submit(&b->ioc);
+}
+
+void BlueStore::_deferred_submit_aggregate_unlock(
+  const vector<OpSequencerRef>& osrs)
+{
+  dout(10) << __func__ << " " << osrs.size() << " osrs" << dendl;
+
+  vector<DeferredBatch*> batches;
+  batches.reserve(osrs.size());
+  for (auto& osr : osrs) {
+    ceph_assert(osr->deferred_pending);
+    ceph_assert(!osr->deferred_running);
+    auto b = osr->deferred_pending;
+    deferred_queue_size -= b->seq_bytes.size();
+    osr->deferred_running = osr->deferred_pending;
+    osr->deferred_pending = nullptr;
+    batches.push_back(b);
+  }
+  ceph_assert(deferred_queue_size >= 0);
+
+  deferred_lock.unlock();
+
+  // sequencers never have overlapping deferred writes in flight (the space
+  // is released only once deferred io completes), so the batches can be
+  // merged into a single offset sorted map and written as large ios.
+  auto overlaps = [](const map<uint64_t,DeferredBatch::deferred_io>& m,
+		     uint64_t offset, uint64_t length) {
+    auto p = m.lower_bound(offset);
+    if (p != m.end() && p->first < offset + length) {
+      return true;
+    }
+    if (p != m.begin()) {
+      --p;
+      if (p->first + p->second.bl.length() > offset) {
+	return true;
+      }
+    }
+    return false;
+  };
+
+  auto a = new DeferredAggregate(cct);
+  map<uint64_t,DeferredBatch::deferred_io> iomap;
+  uint64_t in_ops = 0;
+  for (auto b : batches) {
+    for (auto& txc : b->txcs) {
+      txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
+    }
+    in_ops += b->iomap.size();
+    bool overlap = false;
+    for (auto& i : b->iomap) {
+      if (overlaps(iomap, i.first, i.second.bl.length())) {
+	overlap = true;
+	break;
+      }
+    }
+    if (overlap) {
+      dout(1) << __func__ << " osr " << b->osr
+	      << " overlaps with others, submitting separately" << dendl;
+      _deferred_write_iomap(b->iomap, &b->ioc);
+      bdev->aio_submit(&b->ioc);
+      continue;
+    }
+    iomap.merge(b->iomap);
+    a->osrs.push_back(b->osr);
+  }
+  logger->inc(l_bluestore_deferred_merge_in_ops, in_ops);
+  if (a->osrs.empty()) {
+    delete a;
+    return;
+  }
+  logger->inc(l_bluestore_deferred_merge_osrs, a->osrs.size());
+  _deferred_write_iomap(iomap, &a->ioc);
+
+  bdev->aio_submit(&a->ioc);
+}
+
+void BlueStore::_deferred_write_iomap(
+  map<uint64_t,DeferredBatch::deferred_io>& iomap,
+  IOContext *ioc)
+{
   uint64_t start = 0, pos = 0;
   bufferlist bl;
-  auto i = b->iomap.begin();
+  auto i = iomap.begin();
   while (true) {
-    if (i == b->iomap.end() || i->first != pos) {
+    if (i == iomap.end() || i->first != pos) {
       if (bl.length()) {
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
@@ -11954,11 +13805,11 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
 	  logger->inc(l_bluestore_deferred_write_ops);
 	  logger->inc(l_bluestore_deferred_write_bytes, bl.length());
-	  int r = bdev->aio_write(start, bl, &b->ioc, false);
+	  int r = bdev->aio_write(start, bl, ioc, false);
 	  ceph_assert(r == 0);
 	}
       }
-      if (i == b->iomap.end()) {
+      if (i == iomap.end()) {
 	break;
       }
       start = 0;
@@ -11975,8 +13826,6 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     bl.claim_append(i->second.bl);
     ++i;
   }
-
-  bdev->aio_submit(&b->ioc);
 }
 
 struct C_DeferredTrySubmit : public Context {
@@ -12039,6 +13888,15 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
   }
 }
 
+void BlueStore::_deferred_aggregate_aio_finish(DeferredAggregate *a)
+{
+  dout(10) << __func__ << " " << a->osrs.size() << " osrs" << dendl;
+  for (auto osr : a->osrs) {
+    _deferred_aio_finish(osr);
+  }
+  delete a;
+}
+
 int BlueStore::_deferred_replay()
 {
   dout(10) << __func__ << " start" << dendl;
@@ -12201,18 +14059,73 @@ void BlueStore::_txc_aio_submit(TransContext *txc)
   bdev->aio_submit(&txc->ioc);
 }
 
-void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
+void BlueStore::_txc_load_onodes(Transaction *t,
+				 const vector<CollectionRef>& cvec)
 {
+  // the objects each collection is about to look up
+  map<Collection*, vector<ghobject_t>> oids;
   Transaction::iterator i = t->begin();
-
-  _dump_transaction<30>(cct, t);
-
-  vector<CollectionRef> cvec(i.colls.size());
-  unsigned j = 0;
-  for (vector<coll_t>::iterator p = i.colls.begin(); p != i.colls.end();
-       ++p, ++j) {
-    cvec[j] = _get_collection(*p);
-  }
+  vector<bool> seen(i.objects.size());
+  while (i.have_op()) {
+    Transaction::Op *op = i.decode_op();
+    switch (op->op) {
+    case Transaction::OP_TOUCH:
+    case Transaction::OP_WRITE:
+    case Transaction::OP_ZERO:
+    case Transaction::OP_TRUNCATE:
+    case Transaction::OP_REMOVE:
+    case Transaction::OP_SETATTR:
+    case Transaction::OP_SETATTRS:
+    case Transaction::OP_RMATTR:
+    case Transaction::OP_RMATTRS:
+    case Transaction::OP_CLONE:
+    case Transaction::OP_CLONERANGE:
+    case Transaction::OP_CLONERANGE2:
+    case Transaction::OP_OMAP_CLEAR:
+    case Transaction::OP_OMAP_SETKEYS:
+    case Transaction::OP_OMAP_RMKEYS:
+    case Transaction::OP_OMAP_RMKEYRANGE:
+    case Transaction::OP_OMAP_SETHEADER:
+    case Transaction::OP_SETALLOCHINT:
+    case Transaction::OP_TRY_RENAME:
+    case Transaction::OP_COLL_MOVE_RENAME:
+      break;
+    case Transaction::OP_CREATE:
+      // not expected to exist
+      seen[op->oid] = true;
+      continue;
+    default:
+      // collection ops, which don't name an object
+      continue;
+    }
+    auto& c = cvec[op->cid];
+    if (!c || seen[op->oid]) {
+      continue;
+    }
+    seen[op->oid] = true;
+    oids[c.get()].push_back(i.get_oid(op->oid));
+  }
+  for (auto& [c, v] : oids) {
+    if (v.size() > 1) {
+      std::unique_lock l(c->lock);
+      c->load_onodes(v);
+    }
+  }
+}
+
+void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
+{
+  Transaction::iterator i = t->begin();
+
+  _dump_transaction<30>(cct, t);
+
+  vector<CollectionRef> cvec(i.colls.size());
+  unsigned j = 0;
+  for (vector<coll_t>::iterator p = i.colls.begin(); p != i.colls.end();
+       ++p, ++j) {
+    cvec[j] = _get_collection(*p);
+  }
+  _txc_load_onodes(t, cvec);
   
   vector<OnodeRef> ovec(i.objects.size());
 
@@ -12336,6 +14249,9 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
     OnodeRef &o = ovec[op->oid];
     if (!o) {
       ghobject_t oid = i.get_oid(op->oid);
+      if (create) {
+	_bulk_remove_claim(txc, c.get(), oid);
+      }
       o = c->get_onode(oid, create, op->op == Transaction::OP_CREATE);
     }
     if (!create && (!o || !o->exists)) {
@@ -12424,6 +14340,7 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 	OnodeRef& no = ovec[op->dest_oid];
 	if (!no) {
           const ghobject_t& noid = i.get_oid(op->dest_oid);
+	  _bulk_remove_claim(txc, c.get(), noid);
 	  no = c->get_onode(noid, true);
 	}
 	r = _clone(txc, c, o, no);
@@ -12439,6 +14356,7 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 	OnodeRef& no = ovec[op->dest_oid];
 	if (!no) {
 	  const ghobject_t& noid = i.get_oid(op->dest_oid);
+	  _bulk_remove_claim(txc, c.get(), noid);
 	  no = c->get_onode(noid, true);
 	}
         uint64_t srcoff = op->off;
@@ -12467,6 +14385,7 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 	const ghobject_t& noid = i.get_oid(op->dest_oid);
 	OnodeRef& no = ovec[op->dest_oid];
 	if (!no) {
+	  _bulk_remove_claim(txc, c.get(), noid);
 	  no = c->get_onode(noid, false);
 	}
 	r = _rename(txc, c, o, no, noid);
@@ -13097,6 +15016,105 @@ void BlueStore::_do_write_big(
   }
 }
 
+void BlueStore::_compress_start()
+{
+  unsigned n = cct->_conf.get_val<uint64_t>("bluestore_compression_threads");
+  dout(10) << __func__ << " " << n << " threads" << dendl;
+  {
+    std::lock_guard l(compress_lock);
+    compress_stop = false;
+  }
+  for (unsigned i = 0; i < n; ++i) {
+    compress_threads.emplace_back(new CompressThread(this));
+    compress_threads.back()->create("bstore_compress");
+  }
+}
+
+void BlueStore::_compress_stop()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(compress_lock);
+    compress_stop = true;
+    compress_cond.notify_all();
+  }
+  for (auto& t : compress_threads) {
+    t->join();
+  }
+  compress_threads.clear();
+  ceph_assert(compress_queue.empty());
+  dout(10) << __func__ << " stopped" << dendl;
+}
+
+void BlueStore::_compress_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(compress_lock);
+  while (true) {
+    if (compress_queue.empty()) {
+      if (compress_stop) {
+	break;
+      }
+      compress_cond.wait(l);
+      continue;
+    }
+    CompressJob *j = compress_queue.front();
+    compress_queue.pop_front();
+    l.unlock();
+    _compress_job(*j);
+    logger->inc(l_bluestore_compress_parallel_blobs);
+    l.lock();
+    if (--j->batch->pending == 0) {
+      j->batch->cond.notify_all();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_compress_job(CompressJob& j)
+{
+  auto start = mono_clock::now();
+  j.r = j.c->compress(*j.in, j.out);
+  j.lat = mono_clock::now() - start;
+}
+
+void BlueStore::_compress_blobs(vector<CompressJob>& jobs)
+{
+  if (compress_threads.empty() || jobs.size() < 2) {
+    for (auto& j : jobs) {
+      _compress_job(j);
+    }
+    return;
+  }
+  // hand the blobs over to the compression threads and pitch in with
+  // whatever they have not picked up yet; we return only once every blob
+  // is done, so the txc still proceeds in submission order.
+  CompressBatch batch;
+  std::unique_lock l(compress_lock);
+  for (auto& j : jobs) {
+    j.batch = &batch;
+    compress_queue.push_back(&j);
+  }
+  batch.pending = jobs.size();
+  compress_cond.notify_all();
+  dout(20) << __func__ << " queued " << jobs.size() << " blobs" << dendl;
+  while (batch.pending) {
+    auto p = std::find_if(
+      compress_queue.begin(), compress_queue.end(),
+      [&](CompressJob *j) { return j->batch == &batch; });
+    if (p == compress_queue.end()) {
+      batch.cond.wait(l);
+      continue;
+    }
+    CompressJob *j = *p;
+    compress_queue.erase(p);
+    l.unlock();
+    _compress_job(*j);
+    l.lock();
+    --batch.pending;
+  }
+}
+
 int BlueStore::_do_alloc_write(
   TransContext *txc,
   CollectionRef coll,
@@ -13110,6 +15128,7 @@ int BlueStore::_do_alloc_write(
     return 0;
   }
 
+  auto alloc_write_start = mono_clock::now();
   CompressorRef c;
   double crr = 0;
   if (wctx->compress) {
@@ -13162,20 +15181,34 @@ int BlueStore::_do_alloc_write(
     }
   );
 
-  // compress (as needed) and calc needed space
+  // compress (as needed), all the blobs at once
+  vector<CompressJob> jobs;
+  if (c) {
+    for (auto& wi : wctx->writes) {
+      if (wi.blob_length > min_alloc_size) {
+	ceph_assert(wi.b_off == 0);
+	ceph_assert(wi.blob_length == wi.bl.length());
+	jobs.emplace_back();
+	jobs.back().c = c;
+	jobs.back().in = &wi.bl;
+      }
+    }
+    _compress_blobs(jobs);
+  }
+
+  // calc needed space
   uint64_t need = 0;
+  uint64_t write_bytes = 0;
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
+  auto job = jobs.begin();
   for (auto& wi : wctx->writes) {
+    write_bytes += wi.blob_length;
     if (c && wi.blob_length > min_alloc_size) {
-      auto start = mono_clock::now();
-
-      // compress
-      ceph_assert(wi.b_off == 0);
-      ceph_assert(wi.blob_length == wi.bl.length());
-
+      ceph_assert(job != jobs.end());
+      ceph_assert(job->in == &wi.bl);
       // FIXME: memory alignment here is bad
-      bufferlist t;
-      int r = c->compress(wi.bl, t);
+      bufferlist& t = job->out;
+      int r = job->r;
       uint64_t want_len_raw = wi.blob_length * crr;
       uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
       bool rejected = false;
@@ -13237,8 +15270,9 @@ int BlueStore::_do_alloc_write(
       }
       log_latency("compress@_do_alloc_write",
 	l_bluestore_compress_lat,
-        mono_clock::now() - start,
+	job->lat,
 	cct->_conf->bluestore_log_op_age );
+      ++job;
     } else {
       need += wi.blob_length;
     }
@@ -13390,6 +15424,12 @@ int BlueStore::_do_alloc_write(
   }
   ceph_assert(prealloc_pos == prealloc.end());
   ceph_assert(prealloc_left == 0);
+  logger->hinc(wctx->compress ?
+		 l_bluestore_alloc_write_compressed_lat_histogram :
+		 l_bluestore_alloc_write_raw_lat_histogram,
+	       std::chrono::nanoseconds(
+		 mono_clock::now() - alloc_write_start).count(),
+	       write_bytes);
   return 0;
 }
 
@@ -13400,6 +15440,16 @@ void BlueStore::_wctx_finish(
   WriteContext *wctx,
   set<SharedBlob*> *maybe_unshared_blobs)
 {
+  {
+    // the shared blobs released from below are loaded at once
+    vector<SharedBlobRef> sbs;
+    for (auto& lo : wctx->old_extents) {
+      if (!lo.r.empty() && lo.e.blob->get_blob().is_shared()) {
+	sbs.push_back(lo.e.blob->shared_blob);
+      }
+    }
+    c->load_shared_blobs(sbs);
+  }
   auto oep = wctx->old_extents.begin();
   while (oep != wctx->old_extents.end()) {
     auto &lo = *oep;
@@ -13695,6 +15745,25 @@ int BlueStore::_do_write(
 
   uint64_t end = offset + length;
 
+  if (tier_promote_heat) {
+    r = _tier_place(txc, c, o, end);
+    if (r < 0) {
+      return r;
+    }
+  }
+  if (o->onode.has_inline_data() ? end <= inline_data_max :
+      _can_write_inline(o, end)) {
+    _do_write_inline(txc, o, offset, bl);
+    return 0;
+  }
+  if (o->onode.has_inline_data()) {
+    // grown past the threshold, the data moves out to a blob
+    r = _do_move_inline_data(txc, c, o);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   GarbageCollector gc(c->store->cct);
   int64_t benefit = 0;
   auto dirty_start = offset;
@@ -13759,6 +15828,348 @@ int BlueStore::_do_write(
   return r;
 }
 
+bool BlueStore::_can_write_inline(OnodeRef& o, uint64_t end) const
+{
+  // only objects without any blob may start keeping their data inline,
+  // and, when tiering, only while the DB device has room to spare
+  return end <= inline_data_max &&
+    (!tier_promote_heat || tier_fast_room) &&
+    o->onode.extent_map_shards.empty() &&
+    o->extent_map.extent_map.empty();
+}
+
+void BlueStore::_do_write_inline(
+  TransContext *txc,
+  OnodeRef& o,
+  uint64_t offset,
+  bufferlist& bl)
+{
+  if (!o->onode.has_inline_data()) {
+    _require_compat_ondisk_format(inline_data_ondisk_format);
+  }
+
+  auto& old = o->onode.inline_data;
+  uint64_t end = offset + bl.length();
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << offset
+	   << "~" << bl.length() << " inline 0x" << old.length() << std::dec
+	   << dendl;
+
+  // the inline data is rebuilt rather than modified in place, as readers
+  // may still hold on to its buffers
+  bufferlist n;
+  if (offset <= old.length()) {
+    n.substr_of(old, 0, offset);
+  } else {
+    n = old;
+    n.append_zero(offset - old.length());
+  }
+  n.append(bl);
+  if (end < old.length()) {
+    bufferlist tail;
+    tail.substr_of(old, end, old.length() - end);
+    n.claim_append(tail);
+  }
+  n.rebuild();
+
+  txc->statfs_delta.stored() += (int64_t)n.length() - (int64_t)old.length();
+  old.swap(n);
+  o->onode.set_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  if (end > o->onode.size) {
+    o->onode.size = end;
+  }
+  logger->inc(l_bluestore_write_inline);
+}
+
+int BlueStore::_do_move_inline_data(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef& o)
+{
+  bufferlist bl;
+  bl.swap(o->onode.inline_data);
+  o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+  txc->statfs_delta.stored() -= bl.length();
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << bl.length()
+	   << std::dec << dendl;
+  logger->inc(l_bluestore_write_inline_moved);
+  if (bl.length() == 0) {
+    return 0;
+  }
+
+  WriteContext wctx;
+  _choose_write_options(c, o, 0, &wctx);
+  _do_write_data(txc, c, o, 0, bl.length(), bl, &wctx);
+  int r = _do_alloc_write(txc, c, o, &wctx);
+  if (r < 0) {
+    derr << __func__ << " _do_alloc_write failed with " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  _wctx_finish(txc, c, o, &wctx);
+  o->extent_map.compress_extent_map(0, bl.length());
+  o->extent_map.dirty_range(0, bl.length());
+  return 0;
+}
+
+void BlueStore::_read_inline(
+  OnodeRef& o,
+  uint64_t offset,
+  uint64_t length,
+  bufferlist& bl)
+{
+  const auto& data = o->onode.inline_data;
+  if (offset < data.length()) {
+    uint64_t l = std::min<uint64_t>(length, data.length() - offset);
+    bufferlist t;
+    t.substr_of(data, offset, l);
+    bl.claim_append(t);
+    length -= l;
+  }
+  bl.append_zero(length);
+}
+
+uint32_t BlueStore::_tier_heat(OnodeRef& o, bool touch)
+{
+  uint32_t now = std::chrono::duration_cast<std::chrono::seconds>(
+    ceph::coarse_mono_clock::now().time_since_epoch()).count();
+  uint32_t stamp = o->heat_stamp.load(std::memory_order_relaxed);
+  uint32_t halvings = (now - stamp) / tier_heat_half_life;
+  uint32_t heat = o->heat.load(std::memory_order_relaxed);
+  heat = halvings < 32 ? heat >> halvings : 0;
+  if (touch) {
+    // racing readers may lose an increment; it is only a hint
+    if (halvings) {
+      o->heat_stamp.store(now, std::memory_order_relaxed);
+    }
+    o->heat.store(++heat, std::memory_order_relaxed);
+  }
+  return heat;
+}
+
+void BlueStore::_tier_note_read(OnodeRef& o)
+{
+  if (o->onode.has_inline_data()) {
+    logger->inc(l_bluestore_tier_fast_reads);
+  } else {
+    logger->inc(l_bluestore_tier_slow_reads);
+  }
+  if (tier_promote_heat) {
+    _tier_heat(o, true);
+  }
+}
+
+void BlueStore::_tier_update_room()
+{
+  if (!tier_promote_heat) {
+    return;
+  }
+  uint64_t total = bluefs->get_total(BlueFS::BDEV_DB);
+  uint64_t free = bluefs->get_free(BlueFS::BDEV_DB);
+  bool room = free > total *
+    cct->_conf.get_val<double>("bluestore_tier_db_min_free_ratio");
+  if (room != tier_fast_room) {
+    dout(5) << __func__ << " DB device 0x" << std::hex << free << "/0x"
+	    << total << std::dec << " free, "
+	    << (room ? "resuming" : "stopping") << " promotions" << dendl;
+    tier_fast_room = room;
+  }
+  if (!room) {
+    uint64_t want = total *
+      cct->_conf.get_val<double>("bluestore_tier_db_min_free_ratio") - free;
+    std::lock_guard l(tier_demote_lock);
+    if (want > tier_demote_want) {
+      tier_demote_want = want;
+      tier_demote_cond.notify_all();
+    }
+  }
+}
+
+int BlueStore::_tier_place(
+  TransContext *txc,
+  CollectionRef& c,
+  OnodeRef& o,
+  uint64_t end)
+{
+  // objects mostly change tiers as they get written; _tier_demote()
+  // only helps when the DB device runs short
+  uint32_t heat = _tier_heat(o, false);
+  if (o->onode.has_inline_data()) {
+    if (tier_fast_room || heat >= tier_promote_heat) {
+      return 0;
+    }
+    dout(20) << __func__ << " " << o->oid << " heat " << heat
+	     << ", demoting" << dendl;
+    logger->inc(l_bluestore_tier_demoted);
+    return _do_move_inline_data(txc, c, o);
+  }
+  uint64_t size = o->onode.size;
+  if (!tier_fast_room ||
+      heat < tier_promote_heat ||
+      std::max(end, size) > inline_data_max ||
+      o->extent_map.extent_map.empty() ||  // _can_write_inline() will do
+      !o->onode.extent_map_shards.empty()) {
+    return 0;
+  }
+  dout(20) << __func__ << " " << o->oid << " heat " << heat
+	   << ", promoting 0x" << std::hex << size << std::dec << dendl;
+  bufferlist bl;
+  int r = _do_read(c.get(), o, 0, size, bl);
+  if (r < 0) {
+    derr << __func__ << " " << o->oid << " read failed with "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  _do_truncate(txc, c, o, 0);
+  _do_write_inline(txc, o, 0, bl);
+  ceph_assert(o->onode.size == size);
+  logger->inc(l_bluestore_tier_promoted);
+  return 0;
+}
+
+void BlueStore::_tier_demote_start()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(tier_demote_lock);
+    tier_demote_stop = false;
+  }
+  tier_demote_thread.create("bstore_tier_dmt");
+}
+
+void BlueStore::_tier_demote_stop()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(tier_demote_lock);
+    tier_demote_stop = true;
+    tier_demote_cond.notify_all();
+  }
+  tier_demote_thread.join();
+  dout(10) << __func__ << " stopped" << dendl;
+}
+
+void BlueStore::_tier_demote_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(tier_demote_lock);
+  while (!tier_demote_stop) {
+    if (!tier_demote_want || !tier_promote_heat) {
+      dout(20) << __func__ << " sleep" << dendl;
+      tier_demote_cond.wait(l);
+      continue;
+    }
+    uint64_t want = tier_demote_want;
+    l.unlock();
+    vector<CollectionRef> colls;
+    {
+      std::shared_lock cl(coll_lock);
+      for (auto& p : coll_map) {
+	colls.push_back(p.second);
+      }
+    }
+    uint64_t demoted = 0;
+    for (auto& c : colls) {
+      if (demoted >= want) {
+	break;
+      }
+      demoted += _tier_demote(c, want - demoted);
+    }
+    dout(10) << __func__ << " demoted 0x" << std::hex << demoted << " of 0x"
+	     << want << std::dec << " bytes" << dendl;
+    l.lock();
+    // BlueFS only gets the space back once RocksDB compacts, so leave it
+    // a while before measuring again
+    tier_demote_cond.wait_for(
+      l, ceph::make_timespan(tier_heat_half_life), [this] {
+	return tier_demote_stop;
+      });
+    tier_demote_want = 0;
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+uint64_t BlueStore::_tier_demote(CollectionRef& c, uint64_t want)
+{
+  dout(15) << __func__ << " " << c->cid << " want 0x" << std::hex << want
+	   << std::dec << dendl;
+  const int max = 64;
+  ghobject_t pos;
+  uint64_t demoted = 0;
+  while (demoted < want) {
+    {
+      std::lock_guard l(tier_demote_lock);
+      if (tier_demote_stop) {
+	break;
+      }
+    }
+    vector<ghobject_t> ls;
+    ghobject_t next;
+    {
+      std::shared_lock l(c->lock);
+      if (!c->exists ||
+	  _collection_list(c.get(), pos, ghobject_t::get_max(), max,
+			   &ls, &next) < 0) {
+	break;
+      }
+    }
+    if (ls.empty()) {
+      break;
+    }
+
+    // queued behind the collection's own txcs, like any other
+    TransContext *txc = _txc_create(c.get(), c->osr.get(), nullptr);
+    bool busy;
+    {
+      std::unique_lock l(c->lock);
+      // any other txc still being prepared may have applied some of its
+      // ops to these onodes already; whether queued ahead of us or not,
+      // we would encode and commit them half done
+      busy = !c->osr->is_others_prepared(txc);
+      for (auto& oid : ls) {
+	if (busy || !c->exists || demoted >= want) {
+	  break;
+	}
+	OnodeRef o = c->get_onode(oid, false);
+	if (!o || !o->exists || !o->onode.has_inline_data()) {
+	  continue;
+	}
+	uint32_t heat = _tier_heat(o, false);
+	if (heat >= tier_promote_heat) {
+	  continue;
+	}
+	uint64_t length = o->onode.inline_data.length();
+	dout(20) << __func__ << " " << oid << " heat " << heat
+		 << ", demoting 0x" << std::hex << length << std::dec << dendl;
+	int r = _do_move_inline_data(txc, c, o);
+	if (r < 0) {
+	  derr << __func__ << " " << oid << " failed with " << cpp_strerror(r)
+	       << dendl;
+	  ceph_abort_msg("unexpected error");
+	}
+	txc->write_onode(o);
+	logger->inc(l_bluestore_tier_demoted);
+	demoted += length;
+      }
+      _txc_calc_cost(txc);
+      _txc_write_nodes(txc, txc->t);
+      _txc_finalize_kv(txc, txc->t);
+    }
+    throttle_bytes.get(txc->cost);
+    _txc_state_proc(txc);
+
+    if (busy) {
+      // try again on the next pass
+      dout(20) << __func__ << " " << c->cid << " busy" << dendl;
+      break;
+    }
+    if (next == ghobject_t::get_max()) {
+      break;
+    }
+    pos = next;
+  }
+  return demoted;
+}
+
 int BlueStore::_write(TransContext *txc,
 		      CollectionRef& c,
 		      OnodeRef& o,
@@ -13816,6 +16227,27 @@ int BlueStore::_do_zero(TransContext *txc,
 
   _dump_onode<30>(cct, *o);
 
+  if (o->onode.has_inline_data()) {
+    uint64_t inline_len = o->onode.inline_data.length();
+    if (offset + length <= inline_data_max) {
+      // only the part overlapping the data needs to be rewritten
+      if (offset < inline_len) {
+	bufferlist zeros;
+	zeros.append_zero(std::min<uint64_t>(length, inline_len - offset));
+	_do_write_inline(txc, o, offset, zeros);
+      }
+      if (length > 0 && offset + length > o->onode.size) {
+	o->onode.size = offset + length;
+      }
+      txc->write_onode(o);
+      return 0;
+    }
+    r = _do_move_inline_data(txc, c, o);
+    if (r < 0) {
+      return r;
+    }
+  }
+
   WriteContext wctx;
   o->extent_map.fault_range(db, offset, length);
   o->extent_map.punch_hole(c, offset, length, &wctx.old_extents);
@@ -13847,7 +16279,18 @@ void BlueStore::_do_truncate(
   if (offset == o->onode.size)
     return;
 
-  if (offset < o->onode.size) {
+  if (o->onode.has_inline_data()) {
+    auto& data = o->onode.inline_data;
+    if (offset < data.length()) {
+      bufferlist n;
+      n.substr_of(data, 0, offset);
+      txc->statfs_delta.stored() -= data.length() - offset;
+      data.swap(n);
+    }
+    if (offset == 0) {
+      o->onode.clear_flag(bluestore_onode_t::FLAG_INLINE_DATA);
+    }
+  } else if (offset < o->onode.size) {
     WriteContext wctx;
     uint64_t length = o->onode.size - offset;
     o->extent_map.fault_range(db, offset, length);
@@ -14314,7 +16757,9 @@ int BlueStore::_clone(TransContext *txc,
   oldo->flush();
   _do_truncate(txc, c, newo, 0);
   if (cct->_conf->bluestore_clone_cow) {
-    _do_clone_range(txc, c, oldo, newo, 0, oldo->onode.size, 0);
+    r = _do_clone_range(txc, c, oldo, newo, 0, oldo->onode.size, 0);
+    if (r < 0)
+      goto out;
   } else {
     bufferlist bl;
     r = _do_read(c.get(), oldo, 0, oldo->onode.size, bl, 0);
@@ -14389,6 +16834,16 @@ int BlueStore::_do_clone_range(
 	   << newo->oid
 	   << " 0x" << std::hex << srcoff << "~" << length << " -> "
 	   << " 0x" << dstoff << "~" << length << std::dec << dendl;
+  if (oldo->onode.has_inline_data() || newo->onode.has_inline_data()) {
+    // there is no blob to share, the data is copied instead
+    bufferlist bl;
+    int r = _do_read(c.get(), oldo, srcoff, length, bl, 0);
+    if (r < 0) {
+      return r;
+    }
+    return _do_write(txc, c, newo, dstoff, bl.length(), bl, 0);
+  }
+
   oldo->extent_map.fault_range(db, srcoff, length);
   newo->extent_map.fault_range(db, dstoff, length);
   _dump_onode<30>(cct, *oldo);
@@ -14426,7 +16881,9 @@ int BlueStore::_clone_range(TransContext *txc,
   if (length > 0) {
     if (cct->_conf->bluestore_clone_cow) {
       _do_zero(txc, c, newo, dstoff, length);
-      _do_clone_range(txc, c, oldo, newo, srcoff, length, dstoff);
+      r = _do_clone_range(txc, c, oldo, newo, srcoff, length, dstoff);
+      if (r < 0)
+	goto out;
     } else {
       bufferlist bl;
       r = _do_read(c.get(), oldo, srcoff, length, bl, 0);
@@ -14486,6 +16943,38 @@ int BlueStore::_rename(TransContext *txc,
     }
   }
 
+  // an object moved to where a bulk removal left objects behind must not
+  // pass for one of them, so it takes a new nid along with its omap
+  if (c->is_bulk_stale(string(new_okey.c_str(), new_okey.size()),
+		       oldo->onode.nid)) {
+    uint64_t nid = ++nid_last;
+    dout(20) << __func__ << " " << old_oid << " nid " << oldo->onode.nid
+	     << " -> " << nid << dendl;
+    txc->last_nid = nid;
+    if (oldo->onode.has_omap()) {
+      oldo->flush();
+      const string& prefix = oldo->get_omap_prefix();
+      string head, tail;
+      oldo->get_omap_header(&head);
+      oldo->get_omap_tail(&tail);
+      oldo->onode.nid = nid;
+      KeyValueDB::Iterator it = db->get_iterator(prefix);
+      for (it->lower_bound(head); it->valid() && it->key() < tail;
+	   it->next()) {
+	string key;
+	oldo->rewrite_omap_key(it->key(), &key);
+	txc->t->set(prefix, key, it->value());
+      }
+      string new_tail;
+      oldo->get_omap_tail(&new_tail);
+      txc->t->set(prefix, new_tail, bufferlist());
+      txc->t->rm_range_keys(prefix, head, tail);
+      txc->t->rmkey(prefix, tail);
+    } else {
+      oldo->onode.nid = nid;
+    }
+  }
+
   newo = oldo;
   txc->write_onode(newo);
 
@@ -14517,6 +17006,7 @@ int BlueStore::_create_collection(
   int r;
   bufferlist bl;
 
+  bool drain = false;
   {
     std::unique_lock l(coll_lock);
     if (*c) {
@@ -14527,9 +17017,18 @@ int BlueStore::_create_collection(
     ceph_assert(p != new_coll_map.end());
     *c = p->second;
     (*c)->cnode.bits = bits;
+    {
+      // the new collection must not see the objects a bulk removal
+      // left in its key range
+      std::unique_lock l2((*c)->lock);
+      drain = _bulk_remove_fence(c->get());
+    }
     coll_map[cid] = *c;
     new_coll_map.erase(p);
   }
+  if (drain) {
+    bulk_remove_osr->drain();
+  }
   encode((*c)->cnode, bl);
   txc->t->set(PREFIX_COLL, stringify(cid), bl);
   r = 0;
@@ -14592,6 +17091,38 @@ int BlueStore::_remove_collection(TransContext *txc, const coll_t &cid,
       if (!exists) {
 	_do_remove_collection(txc, c);
         r = 0;
+      } else if (can_bulk_remove_collection()) {
+        dout(10) << __func__ << " " << cid
+                 << " is non-empty, removing in bulk" << dendl;
+	// the cached onodes go away with the collection, while their
+	// keys and space are reclaimed by bulk_remove_thread
+	(*c)->onode_map.map_any([&](OnodeRef o) {
+	  o->exists = false;
+	  return false;
+	});
+	auto rc = _new_collection(cid);
+	rc->cnode = (*c)->cnode;
+	rc->exists = false;
+	// the objects are told from those of a later collection with the
+	// same keys by their nid; the removal takes one of its own so that
+	// it can be told from another one of the same cid
+	uint64_t nid = ++nid_last;
+	txc->last_nid = nid;
+	string id = get_bulk_remove_key(cid, nid);
+	bufferlist bl;
+	encode(rc->cnode, bl);
+	txc->t->set(PREFIX_BULK_REMOVE, id, bl);
+	txc->bulk_removed_collections.push_back(id);
+	{
+	  std::lock_guard l(bulk_remove_lock);
+	  auto& br = bulk_removals[id];
+	  ceph_assert(!br.c);
+	  br.c = rc;
+	  br.nid = nid;
+	  _bulk_remove_update_logger();
+	}
+	_do_remove_collection(txc, c);
+        r = 0;
       } else {
         dout(10) << __func__ << " " << cid
                  << " is non-empty" << dendl;
@@ -14616,6 +17147,396 @@ void BlueStore::_do_remove_collection(TransContext *txc,
   c->reset();
 }
 
+void BlueStore::_bulk_remove_start()
+{
+  dout(10) << __func__ << " " << bulk_removals.size() << " pending" << dendl;
+  {
+    std::lock_guard l(bulk_remove_lock);
+    bulk_remove_stop = false;
+    _bulk_remove_update_logger();
+  }
+  bulk_remove_thread.create("bstore_bulk_rm");
+}
+
+void BlueStore::_bulk_remove_stop()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(bulk_remove_lock);
+    bulk_remove_stop = true;
+    bulk_remove_cond.notify_all();
+  }
+  bulk_remove_thread.join();
+  dout(10) << __func__ << " stopped" << dendl;
+}
+
+void BlueStore::_bulk_remove_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(bulk_remove_lock);
+  while (!bulk_remove_stop) {
+    bool paused = cct->_conf.get_val<bool>("bluestore_bulk_remove_paused");
+    auto p = bulk_removals.begin();
+    while (p != bulk_removals.end() && !p->second.ready) {
+      ++p;
+    }
+    if (paused || p == bulk_removals.end()) {
+      dout(20) << __func__ << " sleep" << (paused ? " (paused)" : "") << dendl;
+      bulk_remove_cond.wait(l);
+      continue;
+    }
+    // only this thread erases from bulk_removals, so p stays valid
+    string id = p->first;
+    BulkRemoval& r = p->second;
+    if (r.objects < 0) {
+      l.unlock();
+      uint64_t n = _bulk_remove_count(r.c.get());
+      l.lock();
+      dout(10) << __func__ << " " << id << " has " << n << " objects"
+	       << dendl;
+      r.objects = n;
+      _bulk_remove_update_logger();
+    }
+    unsigned max = std::max<uint64_t>(
+      1, cct->_conf.get_val<uint64_t>("bluestore_bulk_remove_batch_objects"));
+    l.unlock();
+    bool done = false;
+    unsigned n = _bulk_remove_batch(r, max, &done);
+    l.lock();
+    if (n) {
+      logger->inc(l_bluestore_bulk_removed_objects, n);
+      r.objects = std::max<int64_t>(0, r.objects - n);
+    }
+    if (done) {
+      // the objects other txcs reclaim for us must be gone for good
+      // before we forget about the removal
+      string temp_start, temp_end, start, end;
+      get_coll_key_range(r.c->cid, r.c->cnode.bits, &temp_start, &temp_end,
+			 &start, &end);
+      auto claimed = [&](const string& first, const string& last) {
+	auto q = bulk_claimed.lower_bound(first);
+	return q != bulk_claimed.end() && *q < last;
+      };
+      bulk_remove_cond.wait(l, [&] {
+	return bulk_remove_stop ||
+	  !(claimed(temp_start, temp_end) || claimed(start, end));
+      });
+      if (bulk_remove_stop) {
+	break;
+      }
+      l.unlock();
+      _bulk_remove_finish(id, r);
+      l.lock();
+    }
+    _bulk_remove_update_logger();
+
+    double sleep = cct->_conf.get_val<double>("bluestore_bulk_remove_sleep");
+    if (n && sleep > 0) {
+      bulk_remove_cond.wait_for(l, ceph::make_timespan(sleep), [this] {
+	return bulk_remove_stop;
+      });
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+uint64_t BlueStore::_bulk_remove_count(Collection *c)
+{
+  string temp_start, temp_end, start, end;
+  get_coll_key_range(c->cid, c->cnode.bits, &temp_start, &temp_end,
+		     &start, &end);
+  const std::pair<string,string> ranges[] = {
+    {temp_start, temp_end}, {start, end}
+  };
+  uint64_t n = 0;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  for (auto& [first, last] : ranges) {
+    for (it->lower_bound(first); it->valid() && it->key() < last; it->next()) {
+      if (!is_extent_shard_key(it->key())) {
+	++n;
+      }
+    }
+  }
+  return n;
+}
+
+unsigned BlueStore::_bulk_remove_batch(
+  BulkRemoval& r,
+  unsigned max,
+  bool *done)
+{
+  CollectionRef& c = r.c;
+  dout(15) << __func__ << " " << c->cid << " max " << max << dendl;
+  CollectionRef bc = _bulk_remove_coll(c->cid);
+  TransContext *txc = _txc_create(bc.get(), bc->osr.get(), nullptr);
+  spg_t pgid;
+  if (c->cid.is_pg(&pgid)) {
+    txc->osd_pool_id = pgid.pool();
+  }
+  bool fenced;
+  {
+    // only looked at once the txc is queued, see _bulk_remove_fence()
+    std::lock_guard l(bulk_remove_lock);
+    fenced = r.fenced;
+  }
+
+  string temp_start, temp_end, start, end;
+  get_coll_key_range(c->cid, c->cnode.bits, &temp_start, &temp_end,
+		     &start, &end);
+  const std::pair<string,string> ranges[] = {
+    {temp_start, temp_end}, {start, end}
+  };
+  unsigned n = 0, seen = 0;
+  vector<OnodeRef> removed;
+  vector<string> claimed;
+  *done = true;
+  {
+    std::unique_lock l(bc->lock);
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+    for (auto& [first, last] : ranges) {
+      // the temp range sorts first, so this skips it once we are past it
+      if (r.cursor >= last) {
+	continue;
+      }
+      string from = std::max(first, r.cursor);
+      it->lower_bound(from);
+      while (it->valid() && it->key() < last) {
+	string key = it->key();
+	if (is_extent_shard_key(key)) {
+	  it->next();
+	  continue;
+	}
+	// stop at the first onode key past the batch, so that the extent
+	// shards of the last object taken are covered by the tombstone
+	if (seen >= max) {
+	  r.cursor = key;
+	  *done = false;
+	  break;
+	}
+	++seen;
+	ghobject_t oid;
+	if (get_key_object(key, &oid) < 0) {
+	  derr << __func__ << " bad object key " << pretty_binary_string(key)
+	       << dendl;
+	  it->next();
+	  continue;
+	}
+	if (fenced) {
+	  // the objects of the collections overlapping the range stay
+	  bluestore_onode_t onode;
+	  bufferlist v = it->value();
+	  auto p = v.front().begin_deep();
+	  onode.decode(p);
+	  if (onode.nid > r.nid) {
+	    it->next();
+	    continue;
+	  }
+	}
+	{
+	  std::lock_guard l(bulk_remove_lock);
+	  if (!bulk_claimed.insert(key).second) {
+	    // a txc of an overlapping collection is reclaiming it
+	    it->next();
+	    continue;
+	  }
+	}
+	claimed.push_back(key);
+	if (OnodeRef o = bc->get_onode(oid, false); o && o->exists) {
+	  dout(20) << __func__ << "  " << oid << dendl;
+	  if (fenced) {
+	    _do_remove(txc, bc, o);
+	  } else {
+	    _do_truncate(txc, bc, o, 0);
+	    if (o->onode.has_omap()) {
+	      _do_omap_clear(txc, o);
+	    }
+	    o->exists = false;
+	    txc->note_removed_object(o);
+	  }
+	  removed.push_back(o);
+	  ++n;
+	}
+	it->next();
+      }
+      if (!fenced) {
+	// with no live collection in the range, a single tombstone covers
+	// the onode and extent shard keys of all the objects taken
+	string stop = it->valid() && it->key() < last ? it->key() : last;
+	txc->t->rm_range_keys(PREFIX_OBJ, from, stop);
+      }
+      if (!*done) {
+	break;
+      }
+    }
+  }
+
+  _txc_calc_cost(txc);
+  _txc_write_nodes(txc, txc->t);
+  _txc_finalize_kv(txc, txc->t);
+  throttle_bytes.get(txc->cost);
+  _txc_state_proc(txc);
+
+  // wait for the space to be released before dropping the onodes, and
+  // before anyone looks at their keys again
+  bc->osr->drain();
+  for (auto& o : removed) {
+    bc->onode_map.remove(o->oid);
+  }
+  {
+    std::lock_guard l(bulk_remove_lock);
+    for (auto& key : claimed) {
+      bulk_claimed.erase(key);
+    }
+    bulk_remove_cond.notify_all();
+  }
+  dout(10) << __func__ << " " << c->cid << " reclaimed " << n << " objects"
+	   << (*done ? ", done" : "") << dendl;
+  return n;
+}
+
+void BlueStore::_bulk_remove_finish(const string& id, BulkRemoval& r)
+{
+  dout(10) << __func__ << " " << id << dendl;
+  CollectionRef bc = _bulk_remove_coll(r.c->cid);
+  TransContext *txc = _txc_create(bc.get(), bc->osr.get(), nullptr);
+  txc->t->rmkey(PREFIX_BULK_REMOVE, id);
+  _txc_calc_cost(txc);
+  _txc_write_nodes(txc, txc->t);
+  _txc_finalize_kv(txc, txc->t);
+  throttle_bytes.get(txc->cost);
+  _txc_state_proc(txc);
+  bc->osr->drain();
+
+  {
+    std::lock_guard l(bulk_remove_lock);
+    bulk_removals.erase(id);
+    bulk_remove_cond.notify_all();
+  }
+  // nothing is left to hide from the collections overlapping the range
+  vector<CollectionRef> colls;
+  {
+    std::shared_lock l(coll_lock);
+    for (auto& [cid, c] : coll_map) {
+      colls.push_back(c);
+    }
+  }
+  for (auto& c : colls) {
+    std::unique_lock l(c->lock);
+    c->bulk_fences.erase(
+      std::remove_if(c->bulk_fences.begin(), c->bulk_fences.end(),
+		     [&](auto& f) { return f.id == id; }),
+      c->bulk_fences.end());
+  }
+}
+
+BlueStore::CollectionRef BlueStore::_bulk_remove_coll(const coll_t& cid)
+{
+  // the onodes left by every removal from a pool go into a single
+  // collection, so that those of overlapping removals are loaded once
+  std::lock_guard l(bulk_remove_lock);
+  auto& bc = bulk_remove_colls[cid.pool()];
+  if (!bc) {
+    spg_t pgid;
+    coll_t bcid = cid;
+    if (cid.is_pg(&pgid)) {
+      bcid = coll_t(spg_t(pg_t(0, pgid.pool()), shard_id_t::NO_SHARD));
+    }
+    bc = _new_collection(bcid);
+    bc->cnode.bits = 0;
+    bc->exists = false;
+    bc->osr = bulk_remove_osr;
+  }
+  return bc;
+}
+
+bool BlueStore::_bulk_remove_fence(Collection *c)
+{
+  // caller must hold c->lock
+  string temp_start, temp_end, start, end;
+  get_coll_key_range(c->cid, c->cnode.bits, &temp_start, &temp_end,
+		     &start, &end);
+  bool drain = false;
+  c->bulk_fences.clear();
+  std::lock_guard l(bulk_remove_lock);
+  for (auto& [id, r] : bulk_removals) {
+    Collection::bulk_fence_t f;
+    get_coll_key_range(r.c->cid, r.c->cnode.bits, &f.temp_start, &f.temp_end,
+		       &f.start, &f.end);
+    if (!(f.temp_start < temp_end && temp_start < f.temp_end) &&
+	!(f.start < end && start < f.end)) {
+      continue;
+    }
+    dout(10) << __func__ << " " << c->cid << " overlaps bulk removal " << id
+	     << dendl;
+    f.id = id;
+    f.nid = r.nid;
+    c->bulk_fences.push_back(std::move(f));
+    // a batch that missed this may still drop the whole range; the
+    // caller waits it out before anything is written there
+    drain |= !r.fenced;
+    r.fenced = true;
+  }
+  return drain;
+}
+
+void BlueStore::_bulk_remove_claim(
+  TransContext *txc,
+  Collection *c,
+  const ghobject_t& oid)
+{
+  // caller must hold c->lock
+  if (c->bulk_fences.empty()) {
+    return;
+  }
+  string key;
+  get_object_key(cct, oid, &key);
+  if (!c->is_bulk_stale(key, 0)) {
+    return;
+  }
+  for (auto& o : txc->bulk_claims) {
+    if (o->oid == oid) {
+      return;
+    }
+  }
+  {
+    // whoever reclaims it now is done with it within a batch
+    std::unique_lock l(bulk_remove_lock);
+    bulk_remove_cond.wait(l, [&] { return !bulk_claimed.count(key); });
+    bulk_claimed.insert(key);
+  }
+  // an object left there by a bulk removal goes away along with the
+  // creation of its namesake, which would otherwise take over its keys
+  bufferlist v;
+  db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
+  if (v.length() && c->is_bulk_stale(key, v)) {
+    CollectionRef bc = _bulk_remove_coll(c->cid);
+    std::unique_lock l(bc->lock);
+    OnodeRef o = bc->get_onode(oid, false);
+    if (o && o->exists) {
+      dout(10) << __func__ << " " << oid << " left by a bulk removal" << dendl;
+      _do_remove(txc, bc, o);
+      txc->bulk_claims.push_back(o);
+      return;
+    }
+  }
+  std::lock_guard l(bulk_remove_lock);
+  bulk_claimed.erase(key);
+  bulk_remove_cond.notify_all();
+}
+
+void BlueStore::_bulk_remove_update_logger()
+{
+  // caller must hold bulk_remove_lock
+  uint64_t objects = 0;
+  for (auto& [cid, r] : bulk_removals) {
+    if (r.objects > 0) {
+      objects += r.objects;
+    }
+  }
+  logger->set(l_bluestore_bulk_remove_colls, bulk_removals.size());
+  logger->set(l_bluestore_bulk_remove_objects, objects);
+}
+
 int BlueStore::_split_collection(TransContext *txc,
 				CollectionRef& c,
 				CollectionRef& d,
@@ -14657,6 +17578,11 @@ int BlueStore::_split_collection(TransContext *txc,
   // split call for this parent (first child).
   c->cnode.bits = bits;
   ceph_assert(d->cnode.bits == bits);
+  bool drain = _bulk_remove_fence(c.get());
+  drain |= _bulk_remove_fence(d.get());
+  if (drain) {
+    bulk_remove_osr->drain();
+  }
   r = 0;
 
   bufferlist bl;
@@ -14703,6 +17629,10 @@ int BlueStore::_merge_collection(
   // adjust bits.  note that this will be redundant for all but the first
   // merge call for the parent/target.
   d->cnode.bits = bits;
+  // the grown range may reach where a bulk removal left objects
+  if (_bulk_remove_fence(d.get())) {
+    bulk_remove_osr->drain();
+  }
 
   // behavior depends on target (d) bits, so this after that is updated.
   (*c)->split_cache(d.get());
@@ -14958,6 +17888,10 @@ void BlueStore::_flush_cache()
     ceph_assert(p.second->shared_blob_set.empty());
   }
   coll_map.clear();
+  bulk_removals.clear();
+  bulk_claimed.clear();
+  bulk_remove_colls.clear();
+  bulk_remove_osr.reset();
 }
 
 // For external caller.
@@ -14996,6 +17930,11 @@ void BlueStore::_apply_padding(uint64_t head_pad,
 
 void BlueStore::_record_onode(OnodeRef &o, KeyValueDB::Transaction &txn)
 {
+  if (extent_map_struct_v >= 3) {
+    // older releases can't decode packed shards
+    _require_compat_ondisk_format(packed_extent_map_ondisk_format);
+  }
+
   // finalize extent_map shards
   o->extent_map.update(txn, false);
   if (o->extent_map.needs_reshard()) {
@@ -67,6 +67,7 @@ enum {
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_sync_lat,
   l_bluestore_kv_final_lat,
+  l_bluestore_kv_sync_txcs,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -89,9 +90,14 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_parallel_blobs,
+  l_bluestore_alloc_write_compressed_lat_histogram,
+  l_bluestore_alloc_write_raw_lat_histogram,
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_merge_in_ops,
+  l_bluestore_deferred_merge_osrs,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -109,6 +115,7 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_read_zero_copy_bytes,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -118,6 +125,12 @@ enum {
   l_bluestore_write_small_deferred,
   l_bluestore_write_small_pre_read,
   l_bluestore_write_small_new,
+  l_bluestore_write_inline,
+  l_bluestore_write_inline_moved,
+  l_bluestore_tier_fast_reads,
+  l_bluestore_tier_slow_reads,
+  l_bluestore_tier_promoted,
+  l_bluestore_tier_demoted,
   l_bluestore_txc,
   l_bluestore_onode_reshard,
   l_bluestore_blob_split,
@@ -131,6 +144,9 @@ enum {
   l_bluestore_omap_lower_bound_lat,
   l_bluestore_omap_next_lat,
   l_bluestore_clist_lat,
+  l_bluestore_bulk_remove_colls,
+  l_bluestore_bulk_remove_objects,
+  l_bluestore_bulk_removed_objects,
   l_bluestore_last
 };
 
@@ -151,6 +167,7 @@ public:
   void handle_discard(interval_set<uint64_t>& to_release);
 
   void _set_csum();
+  void _set_extent_map_encoding();
   void _set_compression();
   void _set_throttle_params();
   int _set_cache_sizes();
@@ -158,6 +175,7 @@ public:
     max_defer_interval =
 	cct->_conf.get_val<double>("bluestore_max_defer_interval");
   }
+  void _set_tier_params();
 
   class TransContext;
 
@@ -207,6 +225,8 @@ public:
     uint32_t flags;             ///< FLAG_*
     uint64_t seq;
     uint32_t offset, length;
+    /// cached data is shared with readers by reference and is never
+    /// modified in place; any change replaces (a part of) the Buffer
     bufferlist data;
 
     boost::intrusive::list_member_hook<> lru_item;
@@ -833,6 +853,9 @@ public:
     bool encode_some(uint32_t offset, uint32_t length, bufferlist& bl,
 		     unsigned *pn);
     unsigned decode_some(bufferlist& bl);
+    void _encode_some_packed(extent_map_t::iterator start, uint32_t end,
+			     unsigned n, bufferlist::contiguous_appender& app);
+    unsigned _decode_some_packed(bufferptr::const_iterator& p, unsigned num);
 
     void bound_encode_spanning_blobs(size_t& p);
     void encode_spanning_blobs(bufferlist::contiguous_appender& p);
@@ -1069,6 +1092,9 @@ public:
     // effects cannot be read via the kvdb read methods)
     std::atomic<int> flushing_count = {0};
     std::atomic<int> waiting_count = {0};
+    /// decayed count of reads, for data tiering
+    std::atomic<uint32_t> heat = {0};
+    std::atomic<uint32_t> heat_stamp = {0}; ///< when heat last decayed (sec)
     /// protect flush_txns
     ceph::mutex flush_lock = ceph::make_mutex("BlueStore::Onode::flush_lock");
     ceph::condition_variable flush_cond;   ///< wait here for uncommitted txns
@@ -1288,7 +1314,30 @@ public:
     pool_opts_t pool_opts;
     ContextQueue *commit_queue;
 
+    /// cache effectiveness, summed up per pool by dump_cache_pool_stats()
+    struct cache_stats_t {
+      std::atomic<uint64_t> onode_hits = {0};
+      std::atomic<uint64_t> onode_misses = {0};
+      std::atomic<uint64_t> buffer_hit_bytes = {0};
+      std::atomic<uint64_t> buffer_miss_bytes = {0};
+    } cache_stats;
+
+    /// a pending bulk removal our key range overlaps; the objects it
+    /// left there, those with a nid up to the last one it saw, are not ours
+    struct bulk_fence_t {
+      string id;          ///< the bulk removal key
+      uint64_t nid = 0;
+      string temp_start, temp_end, start, end;
+    };
+    vector<bulk_fence_t> bulk_fences;
+
+    /// whether the onode @v at @key was left behind by a bulk removal
+    bool is_bulk_stale(const string& key, const bufferlist& v) const;
+    bool is_bulk_stale(const string& key, uint64_t nid) const;
+
     OnodeRef get_onode(const ghobject_t& oid, bool create, bool is_createop=false);
+    /// bring the onodes of @oids into the cache with a single lookup
+    void load_onodes(const vector<ghobject_t>& oids);
 
     // the terminology is confusing here, sorry!
     //
@@ -1303,6 +1352,8 @@ public:
     //  loaded = SharedBlob::shared_blob_t is loaded from kv store
     void open_shared_blob(uint64_t sbid, BlobRef b);
     void load_shared_blob(SharedBlobRef sb);
+    /// load the shared blobs in @sbs that aren't yet with a single lookup
+    void load_shared_blobs(const vector<SharedBlobRef>& sbs);
     void make_blob_shared(uint64_t sbid, BlobRef b);
     uint64_t make_blob_unshared(SharedBlob *sb);
 
@@ -1534,6 +1585,8 @@ public:
     KeyValueDB::Transaction t; ///< then we will commit this
     list<Context*> oncommits;  ///< more commit completions
     list<CollectionRef> removed_collections; ///< colls we removed
+    list<string> bulk_removed_collections; ///< of those, ones left non-empty
+    list<OnodeRef> bulk_claims; ///< leftovers of bulk removals we reclaim
 
     boost::intrusive::list_member_hook<> deferred_queue_item;
     bluestore_deferred_transaction_t *deferred_txn = nullptr; ///< if any
@@ -1627,6 +1680,19 @@ public:
     }
   };
 
+  /// pending batches of several sequencers submitted as a whole
+  struct DeferredAggregate final : public AioContext {
+    std::vector<OpSequencer*> osrs;  ///< their batches are deferred_running
+    IOContext ioc;                   ///< our aios
+
+    explicit DeferredAggregate(CephContext *cct)
+      : ioc(cct, this) {}
+
+    void aio_finish(BlueStore *store) override {
+      store->_deferred_aggregate_aio_finish(this);
+    }
+  };
+
   class OpSequencer : public RefCountedObject {
   public:
     ceph::mutex qlock = ceph::make_mutex("BlueStore::OpSequencer::qlock");
@@ -1671,6 +1737,17 @@ public:
 	qcond.wait(l);
     }
 
+    /// true if the txcs other than txc are all done preparing
+    bool is_others_prepared(TransContext *txc) {
+      std::lock_guard l(qlock);
+      for (auto& p : q) {
+	if (&p != txc && p.state == TransContext::STATE_PREPARE) {
+	  return false;
+	}
+      }
+      return true;
+    }
+
     void drain_preceding(TransContext *txc) {
       std::unique_lock l(qlock);
       while (&q.front() != txc)
@@ -1765,11 +1842,70 @@ public:
       return NULL;
     }
   };
+  struct KVFinalizeShard;
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
-    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    KVFinalizeShard *shard;
+    KVFinalizeThread(BlueStore *s, KVFinalizeShard *sh)
+      : store(s), shard(sh) {}
     void *entry() {
-      store->_kv_finalize_thread();
+      store->_kv_finalize_thread(*shard);
+      return NULL;
+    }
+  };
+  /// committed txcs and stable deferred batches of the OpSequencers
+  /// hashed to one finalize thread
+  struct KVFinalizeShard {
+    KVFinalizeThread thread;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
+    ceph::condition_variable cond;
+    deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
+    deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
+    bool started = false;
+    bool stop = false;
+    bool in_progress = false;
+    uint64_t txcs_finalized = 0;  ///< committed txcs handled so far
+    explicit KVFinalizeShard(BlueStore *s) : thread(s, this) {}
+  };
+
+  struct CompressThread : public Thread {
+    BlueStore *store;
+    explicit CompressThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_compress_thread();
+      return NULL;
+    }
+  };
+
+  /// blobs of a single write handed over to the compression threads
+  struct CompressBatch {
+    unsigned pending = 0;
+    ceph::condition_variable cond;
+  };
+  /// a blob to compress
+  struct CompressJob {
+    CompressorRef c;
+    const bufferlist *in = nullptr;
+    bufferlist out;
+    int r = 0;
+    ceph::timespan lat;
+    CompressBatch *batch = nullptr;
+  };
+
+  struct BulkRemoveThread : public Thread {
+    BlueStore *store;
+    explicit BulkRemoveThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_bulk_remove_thread();
+      return NULL;
+    }
+  };
+
+  struct TierDemoteThread : public Thread {
+    BlueStore *store;
+    explicit TierDemoteThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_tier_demote_thread();
       return NULL;
     }
   };
@@ -1810,6 +1946,8 @@ private:
   std::string freelist_type;
   FreelistManager *fm = nullptr;
   Allocator *alloc = nullptr;
+  bool alloc_snapshot_loaded = false; ///< alloc was initialized from snapshot
+  uint64_t alloc_fm_size = 0;         ///< freelist size alloc was built for
   uuid_d fsid;
   int path_fd = -1;  ///< open handle to $path
   int fsid_fd = -1;  ///< open handle (locked) to $path/fsid
@@ -1823,6 +1961,16 @@ private:
   vector<OnodeCacheShard*> onode_cache_shards;
   vector<BufferCacheShard*> buffer_cache_shards;
 
+  /// cache shards dedicated to a single pool
+  struct cache_partition_t {
+    unsigned first = 0;  ///< index of our first onode/buffer cache shard
+    unsigned num = 0;    ///< number of shards
+    double ratio = 0;    ///< share of the meta and data caches reserved
+  };
+  /// pool -> partition; shards shared by all other pools come first
+  std::map<int64_t, cache_partition_t> cache_partitions;
+  unsigned num_shared_cache_shards = 0;
+
   /// protect zombie_osr_set
   ceph::mutex zombie_osr_lock = ceph::make_mutex("BlueStore::zombie_osr_lock");
   std::map<coll_t,OpSequencerRef> zombie_osr_set; ///< set of OpSequencers for deleted collections
@@ -1852,31 +2000,59 @@ private:
   bool _kv_only = false;
   bool kv_sync_started = false;
   bool kv_stop = false;
-  bool kv_finalize_started = false;
-  bool kv_finalize_stop = false;
   deque<TransContext*> kv_queue;             ///< ready, already submitted
   deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
   deque<TransContext*> kv_committing;        ///< currently syncing
   deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
   bool kv_sync_in_progress = false;
 
-  KVFinalizeThread kv_finalize_thread;
-  ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
-  ceph::condition_variable kv_finalize_cond;
-  deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
-  deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
-  bool kv_finalize_in_progress = false;
+  std::vector<std::unique_ptr<KVFinalizeShard>> kv_finalize_shards;
 
   PerfCounters *logger = nullptr;
 
+  ceph::mutex removed_collections_lock =
+    ceph::make_mutex("BlueStore::removed_collections_lock");
   list<CollectionRef> removed_collections;
 
+  /// a collection removed along with its objects, which are yet to be
+  /// reclaimed by bulk_remove_thread
+  struct BulkRemoval {
+    CollectionRef c;     ///< stand-in for the removed collection
+    uint64_t nid = 0;    ///< the objects are those up to this nid
+    bool ready = false;  ///< all txcs up to the removal are done
+    bool fenced = false; ///< a live collection overlaps the key range
+    int64_t objects = -1; ///< objects left, once counted
+    string cursor;       ///< where the next batch starts
+  };
+  std::vector<std::unique_ptr<CompressThread>> compress_threads;
+  ceph::mutex compress_lock = ceph::make_mutex("BlueStore::compress_lock");
+  ceph::condition_variable compress_cond;
+  std::deque<CompressJob*> compress_queue;
+  bool compress_stop = false;
+
+  BulkRemoveThread bulk_remove_thread;
+  ceph::mutex bulk_remove_lock = ceph::make_mutex("BlueStore::bulk_remove_lock");
+  ceph::condition_variable bulk_remove_cond;
+  map<string, BulkRemoval> bulk_removals;
+  set<string> bulk_claimed;  ///< object keys being reclaimed
+  /// per pool, the onodes being reclaimed, whichever removal left them
+  map<int64_t, CollectionRef> bulk_remove_colls;
+  OpSequencerRef bulk_remove_osr;
+  bool bulk_remove_stop = false;
+
+  TierDemoteThread tier_demote_thread;
+  ceph::mutex tier_demote_lock = ceph::make_mutex("BlueStore::tier_demote_lock");
+  ceph::condition_variable tier_demote_cond;
+  uint64_t tier_demote_want = 0; ///< inline bytes to move off the DB device
+  bool tier_demote_stop = false;
+
   ceph::shared_mutex debug_read_error_lock =
     ceph::make_shared_mutex("BlueStore::debug_read_error_lock");
   set<ghobject_t> debug_data_error_objects;
   set<ghobject_t> debug_mdata_error_objects;
 
   std::atomic<int> csum_type = {Checksummer::CSUM_CRC32C};
+  std::atomic<uint8_t> extent_map_struct_v = {2}; ///< for new shards
 
   uint64_t block_size = 0;     ///< block size of block device (power of 2)
   uint64_t block_mask = 0;     ///< mask to get just the block offset
@@ -1900,6 +2076,15 @@ private:
   ///< size threshold for forced deferred writes
   std::atomic<uint64_t> prefer_deferred_size = {0};
 
+  ///< max object size kept inline in the onode (0 = disabled)
+  std::atomic<uint64_t> inline_data_max = {0};
+
+  ///< heat that moves small objects inline, onto the DB device (0 = off)
+  std::atomic<uint32_t> tier_promote_heat = {0};
+  std::atomic<uint32_t> tier_heat_half_life = {60}; ///< seconds
+  ///< the DB device has more free space than BlueFS' headroom
+  std::atomic<bool> tier_fast_room = {true};
+
   ///< approx cost per io, in bytes
   std::atomic<uint64_t> throttle_cost_per_io = {0};
 
@@ -1956,16 +2141,24 @@ private:
       MempoolCache(BlueStore *s) : store(s) {};
 
       virtual uint64_t _get_used_bytes() const = 0;
+      /// bytes used by pools with a cache partition, up to their reservation
+      virtual uint64_t _get_reserved_bytes() const = 0;
 
       virtual int64_t request_cache_bytes(
           PriorityCache::Priority pri, uint64_t total_cache) const {
         int64_t assigned = get_cache_bytes(pri);
 
         switch (pri) {
-        // All cache items are currently shoved into the PRI1 priority 
+        // Reserved pool partitions are served ahead of everything else
+        case PriorityCache::Priority::PRI0:
+          {
+            int64_t request = _get_reserved_bytes();
+            return(request > assigned) ? request - assigned : 0;
+          }
+        // All other cache items are currently shoved into the PRI1 priority
         case PriorityCache::Priority::PRI1:
           {
-            int64_t request = _get_used_bytes();
+            int64_t request = _get_used_bytes() - _get_reserved_bytes();
             return(request > assigned) ? request - assigned : 0;
           }
         default:
@@ -2030,6 +2223,26 @@ private:
       double get_bytes_per_onode() const {
         return (double)_get_used_bytes() / (double)_get_num_onodes();
       }
+
+      virtual uint64_t _get_reserved_bytes() const {
+        uint64_t bytes = 0;
+        double bytes_per_onode = get_bytes_per_onode();
+        if (!(bytes_per_onode > 0)) {
+          return 0;
+        }
+        for (auto& [pool, p] : store->cache_partitions) {
+          uint64_t onodes = 0;
+          for (unsigned i = p.first; i < p.first + p.num; ++i) {
+            onodes += store->onode_cache_shards[i]->_get_num();
+          }
+          if (onodes == 0) {
+            continue;
+          }
+          bytes += std::min<uint64_t>(onodes * bytes_per_onode,
+                                      p.ratio * get_committed_size());
+        }
+        return bytes;
+      }
     };
     std::shared_ptr<MetaCache> meta_cache;
 
@@ -2043,6 +2256,17 @@ private:
         }
         return bytes; 
       }
+      virtual uint64_t _get_reserved_bytes() const {
+        uint64_t bytes = 0;
+        for (auto& [pool, p] : store->cache_partitions) {
+          uint64_t used = 0;
+          for (unsigned i = p.first; i < p.first + p.num; ++i) {
+            used += store->buffer_cache_shards[i]->_get_bytes();
+          }
+          bytes += std::min<uint64_t>(used, p.ratio * get_committed_size());
+        }
+        return bytes;
+      }
       virtual string get_cache_name() const {
         return "BlueStore Data Cache";
       }
@@ -2116,6 +2340,7 @@ private:
   * opens both DB and dependant super_meta, FreelistManager and allocator
   * in the proper order
   */
+  bool db_resharding = false;  ///< the db is opened to be resharded
   int _open_db_and_around(bool read_only);
   void _close_db_and_around();
 
@@ -2135,6 +2360,10 @@ private:
   void _close_fm();
   int _open_alloc();
   void _close_alloc();
+  int _load_alloc_snapshot();
+  int _write_alloc_snapshot();
+  void _invalidate_alloc_snapshot();
+  int64_t _fsck_check_alloc_snapshot();
   int _open_collections();
   void _fsck_collections(int64_t* errors);
   void _close_collections();
@@ -2167,6 +2396,7 @@ private:
   int _balance_bluefs_freespace();
 
   CollectionRef _get_collection(const coll_t& cid);
+  CollectionRef _new_collection(const coll_t& cid);
   void _queue_reap_collection(CollectionRef& c);
   void _reap_collections();
   void _update_cache_logger();
@@ -2184,6 +2414,7 @@ private:
   TransContext *_txc_create(Collection *c, OpSequencer *osr,
 			    list<Context*> *on_commits);
   void _txc_update_store_statfs(TransContext *txc);
+  void _txc_load_onodes(Transaction *t, const vector<CollectionRef>& cvec);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
@@ -2210,7 +2441,34 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
-  void _kv_finalize_thread();
+  void _kv_finalize_thread(KVFinalizeShard& shard);
+  KVFinalizeShard& _kv_finalize_shard(const OpSequencer *osr) {
+    return *kv_finalize_shards[
+      osr->cid.hash_to_shard(kv_finalize_shards.size())];
+  }
+
+  void _compress_start();
+  void _compress_stop();
+  void _compress_thread();
+  void _compress_job(CompressJob& j);
+  void _compress_blobs(std::vector<CompressJob>& jobs);
+
+  void _tier_demote_start();
+  void _tier_demote_stop();
+  void _tier_demote_thread();
+  uint64_t _tier_demote(CollectionRef& c, uint64_t want);
+
+  void _bulk_remove_start();
+  void _bulk_remove_stop();
+  void _bulk_remove_thread();
+  uint64_t _bulk_remove_count(Collection *c);
+  unsigned _bulk_remove_batch(BulkRemoval& r, unsigned max, bool *done);
+  void _bulk_remove_finish(const string& id, BulkRemoval& r);
+  CollectionRef _bulk_remove_coll(const coll_t& cid);
+  bool _bulk_remove_fence(Collection *c);
+  void _bulk_remove_claim(TransContext *txc, Collection *c,
+			  const ghobject_t& oid);
+  void _bulk_remove_update_logger();
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc);
   void _deferred_queue(TransContext *txc);
@@ -2218,7 +2476,13 @@ public:
   void deferred_try_submit();
 private:
   void _deferred_submit_unlock(OpSequencer *osr);
+  void _deferred_submit_aggregate_unlock(
+    const std::vector<OpSequencerRef>& osrs);
+  void _deferred_write_iomap(
+    std::map<uint64_t,DeferredBatch::deferred_io>& iomap,
+    IOContext *ioc);
   void _deferred_aio_finish(OpSequencer *osr);
+  void _deferred_aggregate_aio_finish(DeferredAggregate *a);
   int _deferred_replay();
 
 public:
@@ -2288,16 +2552,28 @@ private:
 
   // -- ondisk version ---
 public:
-  const int32_t latest_ondisk_format = 3;        ///< our version
+  const int32_t latest_ondisk_format = 5;        ///< our version
   const int32_t min_readable_ondisk_format = 1;  ///< what we can read
   const int32_t min_compat_ondisk_format = 3;    ///< who can read us
+  const int32_t inline_data_ondisk_format = 4;   ///< who can read inline data
+  const int32_t packed_extent_map_ondisk_format = 5; ///< ... extent map v3
+
+  int32_t get_compat_ondisk_format() const {
+    return compat_ondisk_format;
+  }
 
 private:
   int32_t ondisk_format = 0;  ///< value detected on mount
+  /// who can read us, as persisted; raised by features that need it
+  std::atomic<int32_t> compat_ondisk_format = {0};
+  ceph::mutex compat_ondisk_format_lock =
+    ceph::make_mutex("BlueStore::compat_ondisk_format_lock");
 
   int _upgrade_super();  ///< upgrade (called during open_super)
   uint64_t _get_ondisk_reserved() const;
   void _prepare_ondisk_format_super(KeyValueDB::Transaction& t);
+  /// persist that only releases understanding format v can read us
+  void _require_compat_ondisk_format(int32_t v);
 
   // --- public interface ---
 public:
@@ -2362,9 +2638,13 @@ public:
   int write_meta(const std::string& key, const std::string& value) override;
   int read_meta(const std::string& key, std::string *value) override;
 
-  int cold_open();
+  int cold_open(bool read_only = true);
   int cold_close();
 
+  /// move the db keys to the column families described by @new_cfs,
+  /// in bluestore_rocksdb_cfs syntax, with the store not mounted
+  int reshard_db(const std::string& new_cfs, std::ostream& out);
+
   int fsck(bool deep) override {
     return _fsck(deep ? FSCK_DEEP : FSCK_REGULAR, false);
   }
@@ -2398,6 +2678,7 @@ public:
     ss << "bluestore_onode: " << onode_count;
     ss << "bluestore_buffers: " << buffers_bytes;
   }
+  void dump_cache_pool_stats(Formatter *f) override;
 
   int validate_hobject_key(const hobject_t &obj) const override {
     return 0;
@@ -2454,6 +2735,12 @@ public:
     size_t len,
     bufferlist& bl,
     uint32_t op_flags = 0) override;
+  int checksum_digest(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    uint32_t *crc) override;
 
 private:
 
@@ -2538,6 +2825,13 @@ private:
     uint32_t op_flags = 0,
     uint64_t retry_count = 0);
 
+  int _do_checksum_digest(
+    OnodeRef o,
+    uint64_t offset,
+    size_t len,
+    uint32_t *crc,
+    uint64_t retry_count = 0);
+
   int _do_readv(
     Collection *c,
     OnodeRef o,
@@ -2696,6 +2990,16 @@ public:
 			   coll_t cid2, ghobject_t oid2,
 			   uint64_t offset);
 
+  /// committed txcs each kv finalize thread has handled, for tests
+  std::vector<uint64_t> get_kv_finalized_txcs() {
+    std::vector<uint64_t> r;
+    for (auto& sh : kv_finalize_shards) {
+      std::lock_guard l(sh->lock);
+      r.push_back(sh->txcs_finalized);
+    }
+    return r;
+  }
+
   void compact() override {
     ceph_assert(db);
     db->compact();
@@ -2703,6 +3007,9 @@ public:
   bool has_builtin_csum() const override {
     return true;
   }
+  bool can_bulk_remove_collection() const override {
+    return cct->_conf.get_val<bool>("bluestore_bulk_remove_collection");
+  }
 
   /*
   Allocate space for BlueFS from slow device.
@@ -2948,6 +3255,24 @@ private:
                       uint64_t length,
                       bufferlist& bl,
                       WriteContext *wctx);
+  bool _can_write_inline(OnodeRef& o, uint64_t end) const;
+  void _do_write_inline(TransContext *txc,
+			OnodeRef& o,
+			uint64_t offset,
+			bufferlist& bl);
+  int _do_move_inline_data(TransContext *txc,
+			   CollectionRef& c,
+			   OnodeRef& o);
+  void _read_inline(OnodeRef& o, uint64_t offset, uint64_t length,
+		    bufferlist& bl);
+
+  uint32_t _tier_heat(OnodeRef& o, bool touch);
+  void _tier_note_read(OnodeRef& o);
+  int _tier_place(TransContext *txc,
+		  CollectionRef& c,
+		  OnodeRef& o,
+		  uint64_t end);
+  void _tier_update_room();
 
   int _touch(TransContext *txc,
 	     CollectionRef& c,
@@ -3155,6 +3480,37 @@ public:
 private:
   void _fsck_check_objects(FSCKDepth depth,
     FSCK_ObjectCtx& ctx);
+
+  /// hands an onode over to a shallow fsck worker, false if all are busy
+  typedef std::function<bool(int64_t pool_id,
+                             CollectionRef c,
+                             const ghobject_t& oid,
+                             const string& key,
+                             const bufferlist& value)> fsck_offload_t;
+  /// check onodes with keys in [start, end), an empty end means no limit
+  size_t _fsck_check_object_range(FSCKDepth depth,
+    const string& start,
+    const string& end,
+    uint64_t_btree_t& used_nids,
+    FSCK_ObjectCtx& ctx,
+    fsck_offload_t offload);
+  /// false if the objects need a serial walk to account for errors found
+  bool _fsck_check_objects_parallel(FSCKDepth depth,
+    size_t thread_count,
+    FSCK_ObjectCtx& ctx);
+
+public:
+  /// how far the object walk of a running fsck has come
+  struct fsck_progress_t {
+    std::atomic<uint64_t> objects = {0};      ///< onodes walked
+    std::atomic<uint64_t> ranges = {0};       ///< key ranges to check
+    std::atomic<uint64_t> ranges_done = {0};  ///< key ranges checked
+  };
+  const fsck_progress_t& get_fsck_progress() const {
+    return fsck_progress;
+  }
+private:
+  fsck_progress_t fsck_progress;
 };
 
 inline ostream& operator<<(ostream& out, const BlueStore::volatile_statfs& s) {
@@ -20,6 +20,7 @@
 #include <sys/file.h>
 
 #include "KernelDevice.h"
+#include "io_uring.h"
 #include "include/intarith.h"
 #include "include/types.h"
 #include "include/compat.h"
@@ -31,6 +32,8 @@
 #endif
 #include "common/debug.h"
 #include "common/numa.h"
+#include "common/perf_counters.h"
+#include "include/hash.h"
 
 #include "global/global_context.h"
 
@@ -42,13 +45,11 @@
 KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, aio_callback_t d_cb, void *d_cbpriv)
   : BlockDevice(cct, cb, cbpriv),
     aio(false), dio(false),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
     discard_callback(d_cb),
     discard_callback_priv(d_cbpriv),
     aio_stop(false),
     discard_started(false),
     discard_stop(false),
-    aio_thread(this),
     discard_thread(this),
     injecting_crash(0)
 {
@@ -56,6 +57,59 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   fd_buffereds.resize(WRITE_LIFE_MAX, -1);
 }
 
+std::unique_ptr<io_queue_t> KernelDevice::_create_io_queue()
+{
+  bool use_ioring = cct->_conf.get_val<bool>("bdev_ioring");
+  unsigned int iodepth = cct->_conf->bdev_aio_max_queue_depth;
+
+  if (use_ioring && ioring_queue_t::supported()) {
+    return std::make_unique<ioring_queue_t>(
+      iodepth,
+      cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll"));
+  } else {
+    static bool once;
+    if (use_ioring && !once) {
+      derr << "WARNING: io_uring API is not supported! Fallback to libaio!"
+	   << dendl;
+      once = true;
+    }
+    return std::make_unique<aio_queue_t>(iodepth);
+  }
+}
+
+KernelDevice::AioQueue& KernelDevice::_get_aio_queue(const IOContext *ioc)
+{
+  ceph_assert(!aio_queues.empty());
+  if (aio_queues.size() == 1) {
+    return *aio_queues[0];
+  }
+  auto h = rjhash64(reinterpret_cast<uintptr_t>(ioc));
+  return *aio_queues[h % aio_queues.size()];
+}
+
+void KernelDevice::_init_aio_queue_logger(AioQueue& q)
+{
+  string name = "bdev";
+  if (auto pos = path.find_last_of('/'); pos != string::npos) {
+    name += "-" + path.substr(pos + 1);
+  }
+  name += "-aioq" + stringify(q.id);
+
+  PerfCountersBuilder b(cct, name,
+			l_bdev_aioq_first, l_bdev_aioq_last);
+  b.add_u64_counter(l_bdev_aioq_submitted_ios, "submitted_ios",
+		    "IOs submitted to this queue");
+  b.add_u64_counter(l_bdev_aioq_reaped_ios, "reaped_ios",
+		    "IOs reaped by this queue's completion thread");
+  b.add_time_avg(l_bdev_aioq_reap_lat, "reap_lat",
+		 "Average latency from IO submission to its reaping",
+		 "rlat", PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_avg(l_bdev_aioq_reap_batch, "reap_batch",
+		"Average number of IOs reaped per wakeup");
+  q.logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(q.logger);
+}
+
 int KernelDevice::_lock()
 {
   dout(10) << __func__ << " " << fd_directs[WRITE_LIFE_NOT_SET] << dendl;
@@ -417,17 +471,61 @@ int KernelDevice::_aio_start()
 {
   if (aio) {
     dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
-    if (r < 0) {
-      if (r == -EAGAIN) {
-	derr << __func__ << " io_setup(2) failed with EAGAIN; "
-	     << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
+    unsigned num_queues = std::max<uint64_t>(
+      1, cct->_conf.get_val<uint64_t>("bdev_aio_reap_threads"));
+    std::set<int> cpus;
+    auto cpu_list = cct->_conf.get_val<std::string>("bdev_aio_reap_cpus");
+    if (!cpu_list.empty()) {
+      cpu_set_t cpu_set;
+      size_t cpu_set_size;
+      if (parse_cpu_set_list(cpu_list.c_str(), &cpu_set_size, &cpu_set) < 0) {
+	derr << __func__ << " unable to parse bdev_aio_reap_cpus '"
+	     << cpu_list << "', not pinning aio threads" << dendl;
       } else {
-	derr << __func__ << " io_setup(2) failed: " << cpp_strerror(r) << dendl;
+	cpus = cpu_set_to_set(cpu_set_size, &cpu_set);
       }
-      return r;
     }
-    aio_thread.create("bstore_aio");
+
+    auto cpu = cpus.begin();
+    for (unsigned i = 0; i < num_queues; ++i) {
+      auto q = std::make_unique<AioQueue>(this, i);
+      q->io_queue = _create_io_queue();
+      int r = q->io_queue->init(fd_directs);
+      if (r < 0) {
+	if (r == -EAGAIN) {
+	  derr << __func__ << " io_setup(2) failed with EAGAIN; "
+	       << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
+	} else {
+	  derr << __func__ << " io_setup(2) failed: " << cpp_strerror(r) << dendl;
+	}
+	for (auto& queue : aio_queues) {
+	  queue->io_queue->shutdown();
+	}
+	aio_queues.clear();
+	return r;
+      }
+      if (cpu != cpus.end()) {
+	q->cpu = *cpu;
+	if (++cpu == cpus.end()) {
+	  cpu = cpus.begin();
+	}
+      }
+      aio_queues.push_back(std::move(q));
+    }
+
+    for (auto& q : aio_queues) {
+      _init_aio_queue_logger(*q);
+      q->thread_name = "bstore_aio";
+      if (q->id) {
+	q->thread_name += "_" + stringify(q->id);
+      }
+      if (q->cpu >= 0) {
+	q->aio_thread.set_affinity(q->cpu);
+      }
+      dout(10) << __func__ << " aio queue " << q->id
+	       << " cpu " << q->cpu << dendl;
+      q->aio_thread.create(q->thread_name.c_str());
+    }
   }
   return 0;
 }
@@ -437,9 +535,18 @@ void KernelDevice::_aio_stop()
   if (aio) {
     dout(10) << __func__ << dendl;
     aio_stop = true;
-    aio_thread.join();
+    for (auto& q : aio_queues) {
+      q->aio_thread.join();
+    }
     aio_stop = false;
-    aio_queue.shutdown();
+    for (auto& q : aio_queues) {
+      q->io_queue->shutdown();
+      _reap_ioc(*q);
+      cct->get_perfcounters_collection()->remove(q->logger);
+      delete q->logger;
+    }
+    aio_queues.clear();
+    reap_ioc();
   }
 }
 
@@ -491,24 +598,28 @@ static bool is_expected_ioerr(const int r)
 	  );
 }
 
-void KernelDevice::_aio_thread()
+void KernelDevice::_aio_thread(AioQueue& q)
 {
-  dout(10) << __func__ << " start" << dendl;
+  dout(10) << __func__ << " " << q.id << " start" << dendl;
   int inject_crash_count = 0;
   while (!aio_stop) {
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
-					 aio, max);
+    int r = q.io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
+					   aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
       ceph_abort_msg("got unexpected error from io_getevents");
     }
     if (r > 0) {
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
+      auto now = mono_clock::now();
+      q.logger->inc(l_bdev_aioq_reaped_ios, r);
+      q.logger->inc(l_bdev_aioq_reap_batch, r);
       for (int i = 0; i < r; ++i) {
 	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
+	q.logger->tinc(l_bdev_aioq_reap_lat, now - aio[i]->submit_stamp);
 	_aio_log_finish(ioc, aio[i]->offset, aio[i]->length);
 	if (aio[i]->queue_item.is_linked()) {
 	  std::lock_guard l(debug_queue_lock);
@@ -598,7 +709,7 @@ void KernelDevice::_aio_thread()
 	}
       }
     }
-    reap_ioc();
+    _reap_ioc(q);
     if (cct->_conf->bdev_inject_crash) {
       ++inject_crash_count;
       if (inject_crash_count * cct->_conf->bdev_aio_poll_ms / 1000 >
@@ -610,8 +721,34 @@ void KernelDevice::_aio_thread()
       }
     }
   }
-  reap_ioc();
-  dout(10) << __func__ << " end" << dendl;
+  _reap_ioc(q);
+  dout(10) << __func__ << " " << q.id << " end" << dendl;
+}
+
+void KernelDevice::queue_reap_ioc(IOContext *ioc)
+{
+  if (aio_queues.empty()) {
+    BlockDevice::queue_reap_ioc(ioc);
+    return;
+  }
+  // only the reaper of the queue the ioc is bound to might still be
+  // touching it
+  auto& q = _get_aio_queue(ioc);
+  std::lock_guard l(q.reap_lock);
+  q.reap_queue.push_back(ioc);
+}
+
+void KernelDevice::_reap_ioc(AioQueue& q)
+{
+  std::vector<IOContext*> to_reap;
+  {
+    std::lock_guard l(q.reap_lock);
+    to_reap.swap(q.reap_queue);
+  }
+  for (auto p : to_reap) {
+    dout(20) << __func__ << " reap ioc " << p << dendl;
+    delete p;
+  }
 }
 
 void KernelDevice::_discard_thread()
@@ -762,10 +899,17 @@ void KernelDevice::aio_submit(IOContext *ioc)
     }
   }
 
+  auto& q = _get_aio_queue(ioc);
+  auto now = mono_clock::now();
+  for (auto p = ioc->running_aios.begin(); p != e; ++p) {
+    p->submit_stamp = now;
+  }
+  q.logger->inc(l_bdev_aioq_submitted_ios, pending);
+
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e,
-			     pending, priv, &retries);
+  r = q.io_queue->submit_batch(ioc->running_aios.begin(), e,
+			       pending, priv, &retries);
 
   if (retries)
     derr << __func__ << " retries " << retries << dendl;
@@ -27,6 +27,16 @@
 
 #define RW_IO_MAX (INT_MAX & CEPH_PAGE_MASK)
 
+class PerfCounters;
+
+enum {
+  l_bdev_aioq_first = 732700,
+  l_bdev_aioq_submitted_ios,
+  l_bdev_aioq_reaped_ios,
+  l_bdev_aioq_reap_lat,
+  l_bdev_aioq_reap_batch,
+  l_bdev_aioq_last
+};
 
 class KernelDevice : public BlockDevice {
   std::vector<int> fd_directs, fd_buffereds;
@@ -45,7 +55,6 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   ceph::mutex flush_mutex = ceph::make_mutex("KernelDevice::flush_mutex");
 
-  aio_queue_t aio_queue;
   aio_callback_t discard_callback;
   void *discard_callback_priv;
   bool aio_stop;
@@ -58,14 +67,33 @@ class KernelDevice : public BlockDevice {
   interval_set<uint64_t> discard_queued;
   interval_set<uint64_t> discard_finishing;
 
-  struct AioCompletionThread : public Thread {
+  /// an aio context along with the thread reaping its completions
+  struct AioQueue {
     KernelDevice *bdev;
-    explicit AioCompletionThread(KernelDevice *b) : bdev(b) {}
-    void *entry() override {
-      bdev->_aio_thread();
-      return NULL;
-    }
-  } aio_thread;
+    unsigned id;
+    int cpu = -1;          ///< cpu the reaper is pinned to, if any
+    std::string thread_name;
+    std::unique_ptr<io_queue_t> io_queue;
+    PerfCounters *logger = nullptr;
+
+    /// IOContexts to be freed once this reaper is done with them
+    ceph::mutex reap_lock = ceph::make_mutex("KernelDevice::AioQueue::reap_lock");
+    std::vector<IOContext*> reap_queue;
+
+    struct AioCompletionThread : public Thread {
+      AioQueue *q;
+      explicit AioCompletionThread(AioQueue *q) : q(q) {}
+      void *entry() override {
+        q->bdev->_aio_thread(*q);
+        return NULL;
+      }
+    } aio_thread;
+
+    AioQueue(KernelDevice *b, unsigned id)
+      : bdev(b), id(id), aio_thread(this) {}
+  };
+  /// IOContexts are sharded across the queues by their address
+  std::vector<std::unique_ptr<AioQueue>> aio_queues;
 
   struct DiscardThread : public Thread {
     KernelDevice *bdev;
@@ -78,10 +106,14 @@ class KernelDevice : public BlockDevice {
 
   std::atomic_int injecting_crash;
 
-  void _aio_thread();
+  void _aio_thread(AioQueue& q);
   void _discard_thread();
   int queue_discard(interval_set<uint64_t> &to_release) override;
 
+  std::unique_ptr<io_queue_t> _create_io_queue();
+  AioQueue& _get_aio_queue(const IOContext *ioc);
+  void _init_aio_queue_logger(AioQueue& q);
+  void _reap_ioc(AioQueue& q);
   int _aio_start();
   void _aio_stop();
 
@@ -112,6 +144,7 @@ public:
   KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, aio_callback_t d_cb, void *d_cbpriv);
 
   void aio_submit(IOContext *ioc) override;
+  void queue_reap_ioc(IOContext *ioc) override;
   void discard_drain() override;
 
   int collect_metadata(const std::string& prefix, map<std::string,std::string> *pm) const override;
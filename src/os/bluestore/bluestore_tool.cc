@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <thread>
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -27,6 +28,21 @@ void usage(po::options_description &desc)
   cout << desc << std::endl;
 }
 
+void print_fsck_progress(const BlueStore& bluestore,
+			 const string& action,
+			 ceph::mono_time start)
+{
+  auto& p = bluestore.get_fsck_progress();
+  double secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  uint64_t objects = p.objects;
+  cerr << action << ": " << objects << " objects"
+       << ", " << p.ranges_done << "/" << p.ranges << " key ranges"
+       << " in " << (int)secs << "s"
+       << ", " << (uint64_t)(secs > 0 ? objects / secs : 0) << " objects/s"
+       << std::endl;
+}
+
 void validate_path(CephContext *cct, const string& path, bool bluefs)
 {
   BlueStore bluestore(cct, path);
@@ -225,9 +241,11 @@ int main(int argc, char **argv)
   string action;
   string log_file;
   string key, value;
+  string new_sharding;
   vector<string> allocs_name;
   int log_level = 30;
   bool fsck_deep = false;
+  int progress_interval = 10;
   po::options_description po_options("Options");
   po_options.add_options()
     ("help,h", "produce help message")
@@ -239,9 +257,11 @@ int main(int argc, char **argv)
     ("devs-source", po::value<vector<string>>(&devs_source), "bluefs-dev-migrate source device(s)")
     ("dev-target", po::value<string>(&dev_target), "target/resulting device")
     ("deep", po::value<bool>(&fsck_deep), "deep fsck (read all data)")
+    ("progress", po::value<int>(&progress_interval), "report fsck/repair progress every N seconds (0 to disable)")
     ("key,k", po::value<string>(&key), "label metadata key name")
     ("value,v", po::value<string>(&value), "label metadata value")
     ("allocator", po::value<vector<string>>(&allocs_name), "allocator to inspect: 'block'/'bluefs-wal'/'bluefs-db'/'bluefs-slow'")
+    ("sharding", po::value<string>(&new_sharding), "new column families, in bluestore_rocksdb_cfs syntax")
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
@@ -261,7 +281,8 @@ int main(int argc, char **argv)
         "prime-osd-dir, "
         "bluefs-log-dump, "
         "free-dump, "
-        "free-score")
+        "free-score, "
+        "reshard")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -376,6 +397,16 @@ int main(int argc, char **argv)
       exit(EXIT_FAILURE);
     }
   }
+  if (action == "reshard") {
+    if (path.empty()) {
+      cerr << "must specify bluestore path" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (new_sharding.empty()) {
+      cerr << "must specify new sharding" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   if (action == "free-score" || action == "free-dump") {
     if (path.empty()) {
       cerr << "must specify bluestore path" << std::endl;
@@ -422,6 +453,20 @@ int main(int argc, char **argv)
       action == "quick-fix") {
     validate_path(cct.get(), path, false);
     BlueStore bluestore(cct.get(), path);
+    auto start = ceph::mono_clock::now();
+    ceph::mutex progress_lock = ceph::make_mutex("bluestore_tool::progress");
+    ceph::condition_variable progress_cond;
+    bool done = false;
+    std::thread progress;
+    if (progress_interval > 0) {
+      progress = std::thread([&] {
+	std::unique_lock l{progress_lock};
+	while (!progress_cond.wait_for(l, std::chrono::seconds(progress_interval),
+				       [&] { return done; })) {
+	  print_fsck_progress(bluestore, action, start);
+	}
+      });
+    }
     int r;
     if (action == "fsck") {
       r = bluestore.fsck(fsck_deep);
@@ -430,6 +475,15 @@ int main(int argc, char **argv)
     } else {
       r = bluestore.quick_fix();
     }
+    if (progress.joinable()) {
+      {
+	std::lock_guard l{progress_lock};
+	done = true;
+      }
+      progress_cond.notify_all();
+      progress.join();
+      print_fsck_progress(bluestore, action, start);
+    }
     if (r < 0) {
       cerr << "error from fsck: " << cpp_strerror(r) << std::endl;
       exit(EXIT_FAILURE);
@@ -856,6 +910,15 @@ int main(int argc, char **argv)
     }
 
     bluestore.cold_close();
+  } else if (action == "reshard") {
+    validate_path(cct.get(), path, false);
+    BlueStore bluestore(cct.get(), path);
+    int r = bluestore.reshard_db(new_sharding, cout);
+    if (r < 0) {
+      cerr << "error resharding: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << "reshard success" << std::endl;
   } else {
     cerr << "unrecognized action " << action << std::endl;
     return 1;
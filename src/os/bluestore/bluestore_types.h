@@ -912,10 +912,13 @@ struct bluestore_onode_t {
 
   uint8_t flags = 0;
 
+  bufferlist inline_data;  ///< object data up to its last written byte, if inline
+
   enum {
     FLAG_OMAP = 1,       ///< object may have omap data
     FLAG_PGMETA_OMAP = 2,  ///< omap data is in meta omap prefix
     FLAG_PERPOOL_OMAP = 4, ///< omap data is in per-pool prefix; per-pool keys
+    FLAG_INLINE_DATA = 8,  ///< data is in inline_data rather than in blobs
   };
 
   string get_flags_string() const {
@@ -929,6 +932,9 @@ struct bluestore_onode_t {
     if (flags & FLAG_PERPOOL_OMAP) {
       s += "+perpool_omap";
     }
+    if (flags & FLAG_INLINE_DATA) {
+      s += "+inline_data";
+    }
     return s;
   }
 
@@ -953,6 +959,9 @@ struct bluestore_onode_t {
   bool is_perpool_omap() const {
     return has_flag(FLAG_PERPOOL_OMAP);
   }
+  bool has_inline_data() const {
+    return has_flag(FLAG_INLINE_DATA);
+  }
 
   void set_omap_flags() {
     set_flag(FLAG_OMAP | FLAG_PERPOOL_OMAP);
@@ -966,7 +975,8 @@ struct bluestore_onode_t {
   }
 
   DENC(bluestore_onode_t, v, p) {
-    DENC_START(1, 1, p);
+    // only inline data needs v2 to be read back
+    DENC_START(2, v.has_inline_data() ? 2 : 1, p);
     denc_varint(v.nid, p);
     denc_varint(v.size, p);
     denc(v.attrs, p);
@@ -975,6 +985,9 @@ struct bluestore_onode_t {
     denc_varint(v.expected_object_size, p);
     denc_varint(v.expected_write_size, p);
     denc_varint(v.alloc_hint_flags, p);
+    if (struct_v >= 2 && v.has_inline_data()) {
+      denc(v.inline_data, p);
+    }
     DENC_FINISH(p);
   }
   void dump(Formatter *f) const;
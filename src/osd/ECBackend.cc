@@ -155,6 +155,8 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
       << " plan.will_write=" << rhs.plan.will_write
+      << " plan.parity_delta=" << rhs.plan.parity_delta.size()
+      << " parity_delta_r=" << rhs.parity_delta_r
       << ")";
   return lhs;
 }
@@ -1831,6 +1833,14 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
 {
   ceph_assert(op);
 
+  unsigned parity_delta_m = 0;
+  if (get_parent()->get_pool().allows_ecoverwrites() &&
+      cct->_conf.get_val<bool>("osd_ec_parity_delta_writes") &&
+      get_osdmap()->require_osd_release >= ceph_release_t::mimic &&
+      ECUtil::supports_parity_delta(ec_impl)) {
+    parity_delta_m = ec_impl->get_coding_chunk_count();
+  }
+
   op->plan = ECTransaction::get_write_plan(
     sinfo,
     std::move(t),
@@ -1845,7 +1855,8 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
       }
       return ref;
     },
-    get_parent()->get_dpp());
+    get_parent()->get_dpp(),
+    parity_delta_m);
 
   dout(10) << __func__ << ": " << *op << dendl;
 
@@ -1868,6 +1879,16 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
+  if (op->requires_parity_delta() && !waiting_reads.empty()) {
+    // the old chunks are read straight off the shards, so the writes
+    // ahead of us must have been sent first
+    dout(20) << __func__ << ": blocking " << *op
+	     << " because it requires a parity delta and there are"
+	     << " writes ahead of it still reading"
+	     << dendl;
+    return false;
+  }
+
   if (!pipeline_state.caching_enabled()) {
     op->using_cache = false;
   } else if (op->invalidates_cache()) {
@@ -1924,9 +1945,127 @@ bool ECBackend::try_state_to_reads()
       });
   }
 
+  if (op->requires_parity_delta()) {
+    start_parity_delta_reads(op);
+  }
+
   return true;
 }
 
+void ECBackend::start_parity_delta_reads(Op *op)
+{
+  ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  map<hobject_t, set<int>> want_to_read;
+  map<hobject_t, read_request_t> for_read_op;
+  for (auto &&i: op->plan.parity_delta) {
+    const hobject_t &hoid = i.first;
+    set<int> want = i.second.data_chunks;
+    for (unsigned j = ec_impl->get_data_chunk_count();
+	 j < ec_impl->get_chunk_count();
+	 ++j) {
+      want.insert(j);
+    }
+
+    have.clear();
+    shards.clear();
+    get_all_avail_shards(hoid, set<pg_shard_t>(), have, shards, false);
+    map<pg_shard_t, vector<pair<int, int>>> need;
+    for (int j: want) {
+      if (!have.count(j))
+	break;
+      need[shards[shard_id_t(j)]].push_back(
+	make_pair(0, ec_impl->get_sub_chunk_count()));
+    }
+    if (need.size() < want.size()) {
+      dout(10) << __func__ << ": " << hoid << " shards " << want
+	       << " not all available (have " << have << ")" << dendl;
+      read_parity_delta_stripe(op, hoid);
+      continue;
+    }
+
+    auto c = make_gen_lambda_context<
+      pair<RecoveryMessages*, read_result_t&>&>(
+	[this, op, hoid, want](pair<RecoveryMessages*, read_result_t&> &in) {
+	  read_result_t &res = in.second;
+	  map<int, bufferlist> chunks;
+	  if (res.r == 0 && !res.returned.empty()) {
+	    for (auto &&j: res.returned.front().get<2>()) {
+	      chunks[j.first.shard].claim(j.second);
+	    }
+	  }
+	  for (int j: want) {
+	    if (!chunks.count(j) ||
+		chunks[j].length() != sinfo.get_chunk_size()) {
+	      dout(10) << __func__ << ": " << hoid << " shard " << j
+		       << " not read, r=" << res.r << dendl;
+	      read_parity_delta_stripe(op, hoid);
+	      return;
+	    }
+	  }
+	  op->parity_delta_chunks[hoid] = std::move(chunks);
+	  check_ops();
+	});
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    to_read.push_back(
+      boost::make_tuple(i.second.stripe_off, sinfo.get_stripe_width(), 0));
+    for_read_op.insert(
+      make_pair(
+	hoid,
+	read_request_t(to_read, need, false, c.release())));
+    want_to_read.insert(make_pair(hoid, std::move(want)));
+  }
+
+  if (!for_read_op.empty()) {
+    start_read_op(
+      CEPH_MSG_PRIO_DEFAULT,
+      want_to_read,
+      for_read_op,
+      OpRequestRef(),
+      false, false);
+  }
+}
+
+void ECBackend::read_parity_delta_stripe(Op *op, const hobject_t &hoid)
+{
+  // decode the whole stripe off whichever shards we can get, and encode it
+  // again for the chunks we wanted
+  auto &pd = op->plan.parity_delta.at(hoid);
+  map<hobject_t, extent_set> to_read;
+  to_read[hoid].insert(pd.stripe_off, sinfo.get_stripe_width());
+  objects_read_async_no_cache(
+    to_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	if (i.second.first < 0) {
+	  derr << __func__ << ": " << i.first << " stripe read failed: "
+	       << cpp_strerror(i.second.first) << dendl;
+	  get_parent()->clog_error() << "Error " << i.second.first
+				     << " reading " << i.first
+				     << " for a parity delta write";
+	  if (op->parity_delta_r == 0) {
+	    op->parity_delta_r = i.second.first;
+	  }
+	  // done reading; try_reads_to_commit() sees the error
+	  op->parity_delta_chunks[i.first];
+	  continue;
+	}
+	ceph_assert(i.second.second.ext_count() == 1);
+	bufferlist stripe = i.second.second.begin().get_val();
+	ceph_assert(stripe.length() == sinfo.get_stripe_width());
+	set<int> want;
+	for (unsigned j = 0; j < ec_impl->get_chunk_count(); ++j) {
+	  want.insert(j);
+	}
+	int r = ECUtil::encode(
+	  sinfo, ec_impl, stripe, want, &op->parity_delta_chunks[i.first]);
+	ceph_assert(r == 0);
+      }
+      check_ops();
+    });
+}
+
 bool ECBackend::try_reads_to_commit()
 {
   if (waiting_reads.empty())
@@ -1934,6 +2073,14 @@ bool ECBackend::try_reads_to_commit()
   Op *op = &(waiting_reads.front());
   if (op->read_in_progress())
     return false;
+  if (op->parity_delta_r < 0) {
+    // without the old stripe there is nothing to encode the write
+    // against; hold it and the writes behind it until on_change()
+    // drops them and the client ops are requeued
+    dout(10) << __func__ << ": " << *op << " failed to read parity delta"
+	     << " stripe, r=" << op->parity_delta_r << dendl;
+    return false;
+  }
   waiting_reads.pop_front();
   waiting_commit.push_back(*op);
 
@@ -1975,6 +2122,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->parity_delta_chunks,
       op->log_entries,
       &written,
       &trans,
@@ -2013,6 +2161,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->parity_delta_chunks.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2485,30 +2634,20 @@ int ECBackend::be_deep_scrub(
   if (stride % sinfo.get_chunk_size())
     stride += sinfo.get_chunk_size() - (stride % sinfo.get_chunk_size());
 
-  bufferlist bl;
-  r = store->read(
-    ch,
-    ghobject_t(
-      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-    pos.data_pos,
-    stride, bl,
-    fadvise_flags);
+  r = be_deep_scrub_data(poid, pos, stride, fadvise_flags);
   if (r < 0) {
     dout(20) << __func__ << "  " << poid << " got "
 	     << r << " on read, read_error" << dendl;
     o.read_error = true;
     return 0;
   }
-  if (bl.length() % sinfo.get_chunk_size()) {
+  if (r % sinfo.get_chunk_size()) {
     dout(20) << __func__ << "  " << poid << " got "
 	     << r << " on read, not chunk size " << sinfo.get_chunk_size() << " aligned"
 	     << dendl;
     o.read_error = true;
     return 0;
   }
-  if (r > 0) {
-    pos.data_hash << bl;
-  }
   pos.data_pos += r;
   if (r == (int)stride) {
     return -EINPROGRESS;
@@ -485,8 +485,15 @@ public:
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+    /// old data and coding chunks of the plan.parity_delta stripes, by shard
+    map<hobject_t,map<int,bufferlist>> parity_delta_chunks;
+    /// set if a parity_delta stripe could not be read; the op can't be
+    /// encoded and waits for the interval change to requeue it
+    int parity_delta_r = 0;
+    bool requires_parity_delta() const { return !plan.parity_delta.empty(); }
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return (!remote_read.empty() && remote_read_result.empty()) ||
+	parity_delta_chunks.size() < plan.parity_delta.size();
     }
 
     /// In progress write state.
@@ -566,6 +573,8 @@ public:
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
   bool try_state_to_reads();
+  void start_parity_delta_reads(Op *op);
+  void read_parity_delta_stripe(Op *op, const hobject_t &hoid);
   bool try_reads_to_commit();
   bool try_finish_rmw();
   void check_ops();
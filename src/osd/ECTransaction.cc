@@ -81,6 +81,98 @@ void encode_and_write(
   }
 }
 
+void write_parity_delta(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const ECTransaction::WritePlan::ParityDelta &pd,
+  const PGTransaction::ObjectOperation::buffer_update_type &buffer_updates,
+  const map<int, bufferlist> &old_chunks,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+
+  // lay the new data over the old chunks it lands on
+  map<int, bufferptr> new_chunks;
+  for (int c : pd.data_chunks) {
+    auto p = old_chunks.find(c);
+    ceph_assert(p != old_chunks.end());
+    ceph_assert(p->second.length() == chunk_size);
+    bufferptr bp(buffer::create(chunk_size));
+    p->second.begin().copy(chunk_size, bp.c_str());
+    new_chunks[c] = std::move(bp);
+  }
+  uint32_t fadvise_flags = 0;
+  for (auto &&extent: buffer_updates) {
+    using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
+    bufferlist bl;
+    match(
+      extent.get_val(),
+      [&](const BufferUpdate::Write &op) {
+	bl = op.buffer;
+	fadvise_flags |= op.fadvise_flags;
+      },
+      [&](const BufferUpdate::Zero &) {
+	bl.append_zero(extent.get_len());
+      },
+      [&](const BufferUpdate::CloneRange &) {
+	ceph_assert(
+	  0 ==
+	  "CloneRange is not allowed, do_op should have returned ENOTSUPP");
+      });
+    ceph_assert(bl.length() == extent.get_len());
+    uint64_t off = extent.get_off() - pd.stripe_off;
+    auto bi = bl.cbegin();
+    while (bi.get_remaining()) {
+      uint64_t in_chunk = off % chunk_size;
+      uint64_t len = std::min<uint64_t>(chunk_size - in_chunk,
+					bi.get_remaining());
+      auto p = new_chunks.find(off / chunk_size);
+      ceph_assert(p != new_chunks.end());
+      bi.copy(len, p->second.c_str() + in_chunk);
+      off += len;
+    }
+  }
+
+  map<int, bufferlist> data_delta;
+  map<int, bufferlist> to_write;
+  for (auto &&i : new_chunks) {
+    to_write[i.first].append(i.second);
+    data_delta[i.first] = old_chunks.at(i.first);
+    ECUtil::xor_into(data_delta[i.first], to_write[i.first]);
+  }
+  map<int, bufferlist> parity_delta;
+  int r = ECUtil::encode_parity_delta(sinfo, ecimpl, data_delta, &parity_delta);
+  ceph_assert(r == 0);
+  for (auto &&i : parity_delta) {
+    auto p = old_chunks.find(i.first);
+    ceph_assert(p != old_chunks.end());
+    to_write[i.first] = p->second;
+    ECUtil::xor_into(to_write[i.first], i.second);
+  }
+
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		     << " stripe " << pd.stripe_off
+		     << " writing shards " << to_write.size()
+		     << " of " << transactions->size()
+		     << dendl;
+  uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(
+    pd.stripe_off);
+  for (auto &&i : *transactions) {
+    auto p = to_write.find(i.first);
+    if (p == to_write.end())
+      continue;
+    i.second.write(
+      coll_t(spg_t(pgid, i.first)),
+      ghobject_t(oid, ghobject_t::NO_GEN, i.first),
+      chunk_off,
+      p->second.length(),
+      p->second,
+      fadvise_flags);
+  }
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -100,6 +192,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,bufferlist>> &parity_delta_chunks,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -466,6 +559,46 @@ void ECTransaction::generate_transactions(
 	}
       }
 
+      auto pditer = plan.parity_delta.find(oid);
+      if (pditer != plan.parity_delta.end()) {
+	const auto &pd = pditer->second;
+	ceph_assert(op.is_none());
+	ceph_assert(!op.truncate);
+	ceph_assert(pd.stripe_off + sinfo.get_stripe_width() <= orig_size);
+	if (entry) {
+	  // every shard stashes its chunk: rollback is the same everywhere
+	  uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
+	    pd.stripe_off);
+	  rollback_extents.emplace_back(
+	    make_pair(restore_from, sinfo.get_chunk_size()));
+	  for (auto &&st : *transactions) {
+	    st.second.touch(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, entry->version.version, st.first));
+	    st.second.clone_range(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	      ghobject_t(oid, entry->version.version, st.first),
+	      restore_from,
+	      sinfo.get_chunk_size(),
+	      restore_from);
+	  }
+	}
+	auto rditer = parity_delta_chunks.find(oid);
+	ceph_assert(rditer != parity_delta_chunks.end());
+	write_parity_delta(
+	  pgid,
+	  oid,
+	  sinfo,
+	  ecimpl,
+	  pd,
+	  op.buffer_updates,
+	  rditer->second,
+	  transactions,
+	  dpp);
+	op.buffer_updates.clear();
+      }
+
       uint32_t fadvise_flags = 0;
       for (auto &&extent: op.buffer_updates) {
 	using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
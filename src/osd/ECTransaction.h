@@ -30,6 +30,16 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// objects overwritten in place within a single stripe: rather than
+    /// reading and re-encoding the stripe, we read the old data chunks
+    /// being changed along with the coding chunks and update both by the
+    /// delta.  These are neither in to_read nor in will_write.
+    struct ParityDelta {
+      uint64_t stripe_off = 0;
+      set<int> data_chunks;  ///< shards of the data chunks written to
+    };
+    map<hobject_t,ParityDelta> parity_delta;
   };
 
   bool requires_overwrite(
@@ -41,7 +51,9 @@ namespace ECTransaction {
     const ECUtil::stripe_info_t &sinfo,
     PGTransactionUPtr &&t,
     F &&get_hinfo,
-    DoutPrefixProvider *dpp) {
+    DoutPrefixProvider *dpp,
+    unsigned parity_delta_m = 0 ///< coding chunks if parity delta allowed
+    ) {
     WritePlan plan;
     t->safe_create_traverse(
       [&](pair<const hobject_t, PGTransaction::ObjectOperation> &i) {
@@ -97,6 +109,44 @@ namespace ECTransaction {
 	}
 
 	auto orig_size = projected_size;
+	if (parity_delta_m &&
+	    i.second.is_none() &&
+	    !i.second.truncate &&
+	    !raw_write_set.empty()) {
+	  uint64_t stripe_off =
+	    sinfo.logical_to_prev_stripe_offset(raw_write_set.range_start());
+	  uint64_t stripe_end = stripe_off + sinfo.get_stripe_width();
+	  if (raw_write_set.range_end() <= stripe_end &&
+	      stripe_end <= orig_size &&
+	      raw_write_set.size() < sinfo.get_stripe_width()) {
+	    WritePlan::ParityDelta pd;
+	    pd.stripe_off = stripe_off;
+	    for (auto extent = raw_write_set.begin();
+		 extent != raw_write_set.end();
+		 ++extent) {
+	      uint64_t first = extent.get_start() - stripe_off;
+	      uint64_t last = first + extent.get_len() - 1;
+	      for (uint64_t c = first / sinfo.get_chunk_size();
+		   c <= last / sinfo.get_chunk_size();
+		   ++c) {
+		pd.data_chunks.insert(c);
+	      }
+	    }
+	    // t chunks read and written each way against k read and k + m
+	    // written for the rmw
+	    uint64_t k = sinfo.get_stripe_width() / sinfo.get_chunk_size();
+	    if (2 * pd.data_chunks.size() + parity_delta_m < 2 * k) {
+	      ldpp_dout(dpp, 20) << __func__ << ": parity delta on stripe "
+				 << stripe_off << " chunks "
+				 << pd.data_chunks << dendl;
+	      plan.parity_delta[i.first] = std::move(pd);
+	      // the cache only knows whole stripes
+	      plan.invalidates_cache = true;
+	      return;
+	    }
+	  }
+	}
+
 	for (auto extent = raw_write_set.begin();
 	     extent != raw_write_set.end();
 	     ++extent) {
@@ -188,6 +238,7 @@ namespace ECTransaction {
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,map<int,bufferlist>> &parity_delta_chunks,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
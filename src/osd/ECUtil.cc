@@ -158,6 +158,66 @@ int ECUtil::encode(
   return 0;
 }
 
+bool ECUtil::supports_parity_delta(const ErasureCodeInterfaceRef &ec_impl) {
+  // the stripe layout below assumes data shard i holds chunk i, whole
+  if (!ec_impl->get_chunk_mapping().empty() ||
+      ec_impl->get_sub_chunk_count() != 1)
+    return false;
+  const auto &profile = ec_impl->get_profile();
+  auto p = profile.find("plugin");
+  return p != profile.end() &&
+    (p->second == "jerasure" || p->second == "isa");
+}
+
+int ECUtil::encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const map<int, bufferlist> &data_delta,
+  map<int, bufferlist> *parity_delta) {
+  ceph_assert(parity_delta);
+  ceph_assert(parity_delta->empty());
+
+  // the code is linear, so the coding chunks of a stripe holding only the
+  // delta are the delta of the coding chunks
+  const unsigned k = ec_impl->get_data_chunk_count();
+  bufferlist stripe;
+  for (unsigned i = 0; i < k; ++i) {
+    auto p = data_delta.find(i);
+    if (p == data_delta.end()) {
+      stripe.append_zero(sinfo.get_chunk_size());
+    } else {
+      ceph_assert(p->second.length() == sinfo.get_chunk_size());
+      stripe.append(p->second);
+    }
+  }
+  ceph_assert(stripe.length() == sinfo.get_stripe_width());
+
+  set<int> want;
+  for (unsigned i = k; i < ec_impl->get_chunk_count(); ++i)
+    want.insert(i);
+  int r = ec_impl->encode(want, stripe, parity_delta);
+  if (r < 0)
+    return r;
+  for (auto &&i : *parity_delta)
+    ceph_assert(i.second.length() == sinfo.get_chunk_size());
+  return 0;
+}
+
+void ECUtil::xor_into(bufferlist &lhs, const bufferlist &rhs) {
+  ceph_assert(lhs.length() == rhs.length());
+  bufferptr out(buffer::create(lhs.length()));
+  char *o = out.c_str();
+  lhs.begin().copy(lhs.length(), o);
+  for (auto &&p : rhs.buffers()) {
+    const char *r = p.c_str();
+    for (unsigned i = 0; i < p.length(); ++i)
+      o[i] ^= r[i];
+    o += p.length();
+  }
+  lhs.clear();
+  lhs.append(std::move(out));
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
   ceph_assert(old_size == total_chunk_size);
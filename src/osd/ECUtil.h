@@ -98,6 +98,26 @@ int encode(
   const std::set<int> &want,
   std::map<int, bufferlist> *out);
 
+/// true if the coding chunks of a stripe are xor-linear in its data chunks
+/// (Reed-Solomon and friends), so they can be updated from a delta alone
+bool supports_parity_delta(const ErasureCodeInterfaceRef &ec_impl);
+
+/**
+ * encode the change to the coding chunks of one stripe
+ *
+ * @param data_delta [in] old ^ new for the data chunks that change, by
+ *                        shard, one chunk each; the others are unchanged
+ * @param parity_delta [out] old ^ new for every coding chunk, by shard
+ */
+int encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const std::map<int, bufferlist> &data_delta,
+  std::map<int, bufferlist> *parity_delta);
+
+/// lhs ^= rhs, both of the same length
+void xor_into(bufferlist &lhs, const bufferlist &rhs);
+
 class HashInfo {
   uint64_t total_chunk_size = 0;
   std::vector<uint32_t> cumulative_shard_hashes;
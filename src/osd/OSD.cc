@@ -2526,6 +2526,8 @@ will start to track new ops received afterwards.";
     f->close_section();
   } else if (admin_command == "dump_objectstore_kv_stats") {
     store->get_db_statistics(f);
+  } else if (admin_command == "dump_objectstore_cache_pool_stats") {
+    store->dump_cache_pool_stats(f);
   } else if (admin_command == "dump_scrubs") {
     service.dumps_scrub(f);
   } else if (admin_command == "calc_objectstore_db_histogram") {
@@ -3376,6 +3378,12 @@ void OSD::final_init()
 				     "print statistics of kvdb which used by bluestore");
   ceph_assert(r == 0);
 
+  r = admin_socket->register_command("dump_objectstore_cache_pool_stats",
+				     "dump_objectstore_cache_pool_stats",
+				     asok_hook,
+				     "print per-pool onode and buffer cache statistics of bluestore");
+  ceph_assert(r == 0);
+
   r = admin_socket->register_command("dump_scrubs",
 				     "dump_scrubs",
 				     asok_hook,
@@ -8106,14 +8114,27 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
-        bool got = get_map_bl(e - 1, obl);
-	if (!got) {
-	  auto p = added_maps_bl.find(e - 1);
-	  ceph_assert(p != added_maps_bl.end());
-	  obl = p->second;
+	// start from the previous map we hold, if any, so that whatever the
+	// incremental leaves alone stays shared between the two epochs
+	OSDMapRef prev;
+	auto q = added_maps.find(e - 1);
+	if (q != added_maps.end()) {
+	  prev = q->second;
+	} else {
+	  prev = service.try_get_map(e - 1);
+	}
+	if (prev) {
+	  o->deepish_copy_from(*prev);
+	} else {
+	  bufferlist obl;
+	  bool got = get_map_bl(e - 1, obl);
+	  if (!got) {
+	    auto p = added_maps_bl.find(e - 1);
+	    ceph_assert(p != added_maps_bl.end());
+	    obl = p->second;
+	  }
+	  o->decode(obl);
 	}
-	o->decode(obl);
       }
 
       OSDMap::Incremental inc;
@@ -10740,10 +10761,34 @@ void OSD::ShardedOpWQ::_add_slot_waiter(
 #undef dout_prefix
 #define dout_prefix *_dout << "osd." << osd->whoami << " op_wq(" << shard_index << ") "
 
+OSDShard *OSD::ShardedOpWQ::_pick_overloaded_shard(uint32_t shard_index)
+{
+  OSDShard *victim = nullptr;
+  unsigned depth = 0;
+  for (auto s : osd->shards) {
+    if (s->shard_id != shard_index && s->overloaded &&
+	s->queue_depth > depth) {
+      victim = s;
+      depth = s->queue_depth;
+    }
+  }
+  return victim;
+}
+
+void OSD::ShardedOpWQ::_wake_idle_shards(uint32_t shard_index)
+{
+  for (auto s : osd->shards) {
+    if (s->shard_id != shard_index && s->queue_depth == 0) {
+      std::lock_guard l{s->sdata_wait_lock};
+      s->sdata_cond.notify_one();
+    }
+  }
+}
+
 void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 {
   uint32_t shard_index = thread_index % osd->num_shards;
-  auto& sdata = osd->shards[shard_index];
+  OSDShard *sdata = osd->shards[shard_index];
   ceph_assert(sdata);
 
   // If all threads of shards do oncommits, there is a out-of-order
@@ -10754,12 +10799,40 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // peek at spg_t
   sdata->shard_lock.lock();
+  OSDShard *victim;
+  if (sdata->pqueue->empty() &&
+      (!is_smallest_thread_index || sdata->context_queue.empty()) &&
+      (victim = _pick_overloaded_shard(shard_index))) {
+    // Nothing to do here, so serve one item of a backed up shard instead,
+    // as if we were one of its threads.  Its oncommits stay with its own
+    // thread.
+    sdata->shard_lock.unlock();
+    sdata = victim;
+    shard_index = victim->shard_id;
+    is_smallest_thread_index = false;
+    sdata->shard_lock.lock();
+    if (sdata->pqueue->empty()) {
+      sdata->shard_lock.unlock();
+      return;
+    }
+    dout(20) << __func__ << " thread " << thread_index << " helping, depth "
+	     << sdata->queue_depth << dendl;
+    ++sdata->num_stolen;
+    osd->logger->inc(l_osd_op_wq_steal);
+  }
   if (sdata->pqueue->empty() &&
       (!is_smallest_thread_index || sdata->context_queue.empty())) {
     std::unique_lock wait_lock{sdata->sdata_wait_lock};
     if (is_smallest_thread_index && !sdata->context_queue.empty()) {
       // we raced with a context_queue addition, don't wait
       wait_lock.unlock();
+    } else if (_pick_overloaded_shard(shard_index)) {
+      // we raced with another shard becoming overloaded; its wakeup
+      // needs our sdata_wait_lock, so it can't be missed past this point
+      dout(20) << __func__ << " empty q, other shard overloaded" << dendl;
+      wait_lock.unlock();
+      sdata->shard_lock.unlock();
+      return;
     } else if (!sdata->stop_waiting) {
       dout(20) << __func__ << " empty q, waiting" << dendl;
       osd->cct->get_heartbeat_map()->clear_timeout(hb);
@@ -10801,7 +10874,9 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
     return;
   }
 
+  osd->logger->hinc(l_osd_op_wq_depth_hist, shard_index, sdata->queue_depth);
   OpQueueItem item = sdata->pqueue->dequeue();
+  sdata->_note_dequeued();
   if (osd->is_stopping()) {
     sdata->shard_lock.unlock();
     for (auto c : oncommits) {
@@ -11052,12 +11127,18 @@ void OSD::ShardedOpWQ::_enqueue(OpQueueItem&& item) {
   else
     sdata->pqueue->enqueue(
       item.get_owner(), priority, cost, std::move(item));
+  bool overloaded = sdata->_note_queued();
   sdata->shard_lock.unlock();
 
   if (empty) {
     std::lock_guard l{sdata->sdata_wait_lock};
     sdata->sdata_cond.notify_one();
   }
+  if (overloaded) {
+    dout(10) << __func__ << " shard " << shard_index << " overloaded, depth "
+	     << sdata->queue_depth << dendl;
+    _wake_idle_shards(shard_index);
+  }
 }
 
 void OSD::ShardedOpWQ::_enqueue_front(OpQueueItem&& item)
@@ -1025,6 +1025,41 @@ struct OSDShard {
   /// priority queue
   std::unique_ptr<OpQueue<OpQueueItem, uint64_t>> pqueue;
 
+  /// @name work stealing
+  /// Threads of other shards that would otherwise sleep may serve this
+  /// shard's pqueue while it is overloaded.  They go through the same
+  /// shard_lock/pg_slots/pg lock dance as our own threads, so per-pg
+  /// ordering holds; they just add to this shard's thread count.
+  /// @{
+  const unsigned steal_high;  ///< become overloaded at this depth (0: never)
+  const unsigned steal_low;   ///< and stop being so at this one
+  std::atomic<unsigned> queue_depth = {0};  ///< items in pqueue
+  std::atomic<bool> overloaded = {false};
+  std::atomic<uint64_t> num_stolen = {0};  ///< served by other shards' threads
+
+  /// note an item queued (shard_lock held); true if other shards should help
+  bool _note_queued() {
+    unsigned depth = ++queue_depth;
+    if (steal_high && !overloaded && depth >= steal_high) {
+      overloaded = true;
+      return true;
+    }
+    return false;
+  }
+  /// note an item requeued (shard_lock held); old work coming back
+  /// doesn't call for help
+  void _note_requeued() {
+    ++queue_depth;
+  }
+  /// note an item dequeued (shard_lock held)
+  void _note_dequeued() {
+    unsigned depth = --queue_depth;
+    if (overloaded && depth <= steal_low) {
+      overloaded = false;
+    }
+  }
+  /// @}
+
   bool stop_waiting = false;
 
   ContextQueue context_queue;
@@ -1040,6 +1075,7 @@ struct OSDShard {
       pqueue->enqueue_front(
 	item.get_owner(),
 	priority, cost, std::move(item));
+    _note_requeued();
   }
 
   void _attach_pg(OSDShardPGSlot *slot, PG *pg);
@@ -1087,6 +1123,10 @@ struct OSDShard {
       osdmap_lock{make_mutex(osdmap_lock_name)},
       shard_lock_name(shard_name + "::shard_lock"),
       shard_lock{make_mutex(shard_lock_name)},
+      steal_high(cct->_conf.get_val<uint64_t>("osd_op_shard_steal_high")),
+      steal_low(std::min<uint64_t>(
+	cct->_conf.get_val<uint64_t>("osd_op_shard_steal_low"),
+	steal_high ? steal_high - 1 : 0)),
       context_queue(sdata_wait_lock, sdata_cond) {
     if (opqueue == io_queue::weightedpriority) {
       pqueue = std::make_unique<
@@ -1634,6 +1674,11 @@ protected:
     /// try to do some work
     void _process(uint32_t thread_index, heartbeat_handle_d *hb) override;
 
+    /// the most backed up overloaded shard other than ours, if any
+    OSDShard *_pick_overloaded_shard(uint32_t shard_index);
+    /// get idle threads of other shards to look for work
+    void _wake_idle_shards(uint32_t shard_index);
+
     /// enqueue a new item
     void _enqueue(OpQueueItem&& item) override;
 
@@ -1669,6 +1714,9 @@ protected:
 
 	std::scoped_lock l{sdata->shard_lock};
 	f->open_object_section(queue_name);
+	f->dump_unsigned("queue_depth", sdata->queue_depth);
+	f->dump_bool("overloaded", sdata->overloaded);
+	f->dump_unsigned("num_stolen", sdata->num_stolen);
 	sdata->pqueue->dump(f);
 	f->close_section();
       }
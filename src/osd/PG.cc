@@ -3764,13 +3764,16 @@ void PG::do_delete_work(ObjectStore::Transaction &t)
 
   delete_needs_sleep = true;
 
+  // if the store can drop the objects along with the collection, only
+  // walk them to clean up the snap mapper
+  bool bulk = osd->store->can_bulk_remove_collection();
   vector<ghobject_t> olist;
   int max = std::min(osd->store->get_ideal_list_max(),
 		     (int)cct->_conf->osd_target_transaction_size);
   ghobject_t next;
   osd->store->collection_list(
     ch,
-    next,
+    bulk ? delete_next : next,
     ghobject_t::get_max(),
     max,
     &olist,
@@ -3791,15 +3794,21 @@ void PG::do_delete_work(ObjectStore::Transaction &t)
     if (r != 0 && r != -ENOENT) {
       ceph_abort();
     }
-    t.remove(coll, oid);
+    if (!bulk) {
+      t.remove(coll, oid);
+    }
     ++num;
   }
-  if (num) {
+  if (bulk) {
+    delete_next = next;
+  }
+  if (num || (bulk && !next.is_max())) {
     dout(20) << __func__ << " deleting " << num << " objects" << dendl;
     Context *fin = new C_DeleteMore(this, get_osdmap_epoch());
     t.register_on_commit(fin);
   } else {
     dout(20) << __func__ << " finished" << dendl;
+    delete_next = ghobject_t();
     if (cct->_conf->osd_inject_failure_on_pg_removal) {
       _exit(1);
     }
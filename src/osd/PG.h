@@ -1373,6 +1373,7 @@ public:
   int pg_stat_adjust(osd_stat_t *new_stat);
 protected:
   bool delete_needs_sleep = false;
+  ghobject_t delete_next;  ///< listing position, when removing in bulk
 
 protected:
   bool state_test(uint64_t m) const { return recovery_state.state_test(m); }
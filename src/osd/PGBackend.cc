@@ -617,6 +617,31 @@ int PGBackend::be_scan_list(
   return 0;
 }
 
+int PGBackend::be_deep_scrub_data(
+  const hobject_t &poid,
+  ScrubMapBuilder &pos,
+  uint64_t stride,
+  uint32_t fadvise_flags)
+{
+  ghobject_t goid(poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard);
+  if (cct->_conf.get_val<bool>("osd_deep_scrub_store_checksums")) {
+    uint32_t crc = pos.data_hash.digest();
+    int r = store->checksum_digest(ch, goid, pos.data_pos, stride, &crc);
+    if (r != -EOPNOTSUPP) {
+      if (r >= 0) {
+	pos.data_hash = bufferhash(crc);
+      }
+      return r;
+    }
+  }
+  bufferlist bl;
+  int r = store->read(ch, goid, pos.data_pos, stride, bl, fadvise_flags);
+  if (r > 0) {
+    pos.data_hash << bl;
+  }
+  return r;
+}
+
 bool PGBackend::be_compare_scrub_objects(
   pg_shard_t auth_shard,
   const ScrubMap::object &auth,
@@ -617,6 +617,12 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      ScrubMap &map,
      ScrubMapBuilder &pos,
      ScrubMap::object &o) = 0;
+   /// hash the next stride of an object's data into pos.data_hash
+   int be_deep_scrub_data(
+     const hobject_t &poid,
+     ScrubMapBuilder &pos,
+     uint64_t stride,
+     uint32_t fadvise_flags);
    void be_omap_checks(
      const map<pg_shard_t,ScrubMap*> &maps,
      const set<hobject_t> &master_set,
@@ -77,7 +77,6 @@ void PGLog::IndexedLog::trim(
 	*write_from_dups = e.version;
       }
       dups.push_back(pg_log_dup_t(e));
-      index(dups.back());
       uint32_t idx = 0;
       for (const auto& extra : e.extra_reqids) {
 	int return_code = e.return_code;
@@ -92,7 +91,6 @@ void PGLog::IndexedLog::trim(
 	// note: extras have the same version as outer op
 	dups.push_back(pg_log_dup_t(e.version, extra.second,
 				    extra.first, return_code));
-	index(dups.back());
       }
     }
 
@@ -121,13 +119,12 @@ void PGLog::IndexedLog::trim(
   }
 
   while (!dups.empty()) {
-    const auto& e = *dups.begin();
+    const auto e = dups.front();
     if (e.version.version >= earliest_dup_version)
       break;
     lgeneric_subdout(cct, osd, 20) << "trim dup " << e << dendl;
     if (trimmed_dups)
       trimmed_dups->insert(e.get_key_name());
-    unindex(e);
     dups.pop_front();
   }
 
@@ -148,10 +145,8 @@ ostream& PGLog::IndexedLog::print(ostream& out) const
     ceph_assert(!p->reqid_is_indexed() || logged_req(p->reqid));
   }
 
-  for (list<pg_log_dup_t>::const_iterator p = dups.begin();
-       p != dups.end();
-       ++p) {
-    out << *p << std::endl;
+  for (const auto& dup : dups) {
+    out << dup << std::endl;
   }
 
   return out;
@@ -513,10 +508,7 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
       dirty_from_dups = eversion_t();
       dirty_to_dups = eversion_t::max();
       // since our log.dups is empty just copy them
-      for (const auto& i : olog.dups) {
-	log.dups.push_back(i);
-	log.index(log.dups.back());
-      }
+      log.dups = olog.dups;
     } else {
       // since our log.dups is not empty try to extend on each end
 
@@ -528,19 +520,14 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 
 	auto log_tail_version = log.dups.back().version;
 
-	auto insert_cursor = log.dups.end();
-	eversion_t last_shared = eversion_t::max();
-	for (auto i = olog.dups.crbegin(); i != olog.dups.crend(); ++i) {
-	  if (i->version <= log_tail_version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last_shared = i->version;
-
-	  auto prev = insert_cursor;
-	  --prev;
-	  // be sure to pass reference of copy in log.dups
-	  log.index(*prev);
-
-	  --insert_cursor; // make sure we insert in reverse order
+	// find the oldest of the newer dups, and append from there
+	size_t from = olog.dups.size();
+	while (from > 0 && olog.dups[from - 1].version > log_tail_version) {
+	  --from;
+	}
+	eversion_t last_shared = olog.dups[from].version;
+	for (size_t i = from; i < olog.dups.size(); ++i) {
+	  log.dups.push_back(olog.dups[i]);
 	}
 	mark_dirty_from_dups(last_shared);
       }
@@ -551,16 +538,16 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 	  olog.dups.front().version << dendl;
 	changed = true;
 
-	eversion_t last;
-	auto insert_cursor = log.dups.begin();
-	for (auto i = olog.dups.cbegin(); i != olog.dups.cend(); ++i) {
-	  if (i->version >= insert_cursor->version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last = i->version;
-	  auto prev = insert_cursor;
-	  --prev;
-	  // be sure to pass address of copy in log.dups
-	  log.index(*prev);
+	// prepend the older dups, newest first
+	auto log_head_version = log.dups.front().version;
+	size_t to = 0;
+	while (to < olog.dups.size() &&
+	       olog.dups[to].version < log_head_version) {
+	  ++to;
+	}
+	eversion_t last = olog.dups[to - 1].version;
+	for (size_t i = to; i > 0; --i) {
+	  log.dups.push_front(olog.dups[i - 1]);
 	}
 	mark_dirty_to_dups(last);
       }
@@ -574,7 +561,6 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
     changed = true;
 
     while (!log.dups.empty() && log.dups.back().version > log.tail) {
-      log.unindex(log.dups.back());
       mark_dirty_from_dups(log.dups.back().version);
       log.dups.pop_back();
     }
@@ -782,7 +768,7 @@ void PGLog::_write_log_and_missing_wo_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
@@ -911,7 +897,7 @@ void PGLog::_write_log_and_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
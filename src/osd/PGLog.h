@@ -31,11 +31,9 @@
 constexpr auto PGLOG_INDEXED_OBJECTS          = 1 << 0;
 constexpr auto PGLOG_INDEXED_CALLER_OPS       = 1 << 1;
 constexpr auto PGLOG_INDEXED_EXTRA_CALLER_OPS = 1 << 2;
-constexpr auto PGLOG_INDEXED_DUPS             = 1 << 3;
 constexpr auto PGLOG_INDEXED_ALL              = PGLOG_INDEXED_OBJECTS 
                                               | PGLOG_INDEXED_CALLER_OPS 
-                                              | PGLOG_INDEXED_EXTRA_CALLER_OPS 
-                                              | PGLOG_INDEXED_DUPS;
+                                              | PGLOG_INDEXED_EXTRA_CALLER_OPS;
 
 class CephContext;
 
@@ -76,7 +74,6 @@ public:
     mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
     mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
     mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
@@ -311,14 +308,12 @@ public:
 	ceph_abort_msg("in extra_caller_ops but not extra_reqids");
       }
 
-      if (!(indexed_data & PGLOG_INDEXED_DUPS)) {
-        index_dups();
-      }
-      auto q = dup_index.find(r);
-      if (q != dup_index.end()) {
-	*version = q->second->version;
-	*user_version = q->second->user_version;
-	*return_code = q->second->return_code;
+      // pg_log_dups_t keeps its own index
+      pg_log_dup_t dup;
+      if (dups.find(r, &dup)) {
+	*version = dup.version;
+	*user_version = dup.user_version;
+	*return_code = dup.return_code;
 	return true;
       }
 
@@ -372,12 +367,6 @@ public:
 	caller_ops.clear();
       if (to_index & PGLOG_INDEXED_EXTRA_CALLER_OPS)
 	extra_caller_ops.clear();
-      if (to_index & PGLOG_INDEXED_DUPS) {
-	dup_index.clear();
-	for (auto& i : dups) {
-	  dup_index[i.reqid] = const_cast<pg_log_dup_t*>(&i);
-	}
-      }
 
       constexpr __u16 any_log_entry_index =
 	PGLOG_INDEXED_OBJECTS |
@@ -426,10 +415,6 @@ public:
       index(PGLOG_INDEXED_EXTRA_CALLER_OPS);
     }
 
-    void index_dups() const {
-      index(PGLOG_INDEXED_DUPS);
-    }
-
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
         if (objects.count(e.soid) == 0 ||
@@ -455,7 +440,6 @@ public:
       objects.clear();
       caller_ops.clear();
       extra_caller_ops.clear();
-      dup_index.clear();
       indexed_data = 0;
     }
 
@@ -491,21 +475,6 @@ public:
       }
     }
 
-    void index(pg_log_dup_t& e) {
-      if (indexed_data & PGLOG_INDEXED_DUPS) {
-	dup_index[e.reqid] = &e;
-      }
-    }
-
-    void unindex(const pg_log_dup_t& e) {
-      if (indexed_data & PGLOG_INDEXED_DUPS) {
-	auto i = dup_index.find(e.reqid);
-	if (i != dup_index.end()) {
-	  dup_index.erase(i);
-	}
-      }
-    }
-
     // actors
     void add(const pg_log_entry_t& e, bool applied = true) {
       if (!applied) {
@@ -1365,7 +1334,7 @@ public:
     bool must_rebuild = false;
     missing.may_include_deletes = false;
     list<pg_log_entry_t> entries;
-    list<pg_log_dup_t> dups;
+    pg_log_dups_t dups;
     if (p) {
       for (p->seek_to_first(); p->valid() ; p->next()) {
 	// non-log pgmeta_oid keys are prefixed with _; skip those
@@ -1610,7 +1579,7 @@ public:
     std::map<eversion_t, hobject_t> divergent_priors;
     bool must_rebuild = false;
     std::list<pg_log_entry_t> entries;
-    std::list<pg_log_dup_t> dups;
+    pg_log_dups_t dups;
 
     std::optional<std::string> next;
 
@@ -276,6 +276,29 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_steal, "op_wq_steal",
+    "Op queue items served by a thread of another shard");
+
+  PerfHistogramCommon::axis_config_d op_wq_shard_axis_config{
+    "Shard",
+    PerfHistogramCommon::SCALE_LINEAR,
+    0,                               ///< Start at shard 0
+    1,                               ///< One bucket per shard
+    66,                              ///< Up to 64 shards
+  };
+  PerfHistogramCommon::axis_config_d op_wq_depth_axis_config{
+    "Queue depth",
+    PerfHistogramCommon::SCALE_LOG2,
+    0,
+    1,
+    20,
+  };
+  osd_plb.add_u64_counter_histogram(
+    l_osd_op_wq_depth_hist, "op_wq_depth_histogram",
+    op_wq_shard_axis_config, op_wq_depth_axis_config,
+    "Op queue depth of each shard, sampled at every dequeue");
+
   return osd_plb.create_perf_counters();
 }
  
@@ -117,6 +117,9 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_op_wq_steal,
+  l_osd_op_wq_depth_hist,
+
   l_osd_last,
 };
 
@@ -4797,6 +4797,223 @@ std::ostream& operator<<(std::ostream& out, const pg_log_dup_t& e) {
     " rc=" << e.return_code << ")";
 }
 
+// -- pg_log_dups_t --
+
+void pg_log_dups_t::packed_t::pack(const pg_log_dup_t &d)
+{
+  name_num = d.reqid.name.num();
+  tid = d.reqid.tid;
+  version = d.version.version;
+  user_version = d.user_version;
+  epoch = d.version.epoch;
+  inc = d.reqid.inc;
+  return_code = d.return_code;
+  name_type = d.reqid.name.type();
+}
+
+pg_log_dup_t pg_log_dups_t::packed_t::unpack() const
+{
+  return pg_log_dup_t(
+    eversion_t(epoch, version),
+    user_version,
+    osd_reqid_t(entity_name_t(name_type, name_num), inc, tid),
+    return_code);
+}
+
+size_t pg_log_dups_t::_hash(int64_t num, ceph_tid_t tid, int32_t inc)
+{
+  // tids of one client are sequential, so mix well enough for linear
+  // probing by the low bits
+  uint64_t h = (uint64_t)num * 0x9e3779b97f4a7c15ull;
+  h ^= tid + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2);
+  h ^= (uint64_t)(uint32_t)inc << 32;
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 29;
+  return h;
+}
+
+void pg_log_dups_t::_reserve(size_t n)
+{
+  // grow by doubling, shrink back to between a quarter and half full
+  size_t cap = ring.size();
+  if (n > cap) {
+    cap = std::max<size_t>(cap, 8);
+    while (cap < n)
+      cap <<= 1;
+  } else if (cap > 16 && n * 4 <= cap) {
+    while (cap > 16 && n * 4 <= cap)
+      cap >>= 1;
+  } else {
+    return;
+  }
+  mempool::osd_pglog::vector<packed_t> r(cap);
+  for (size_t i = 0; i < count; ++i)
+    r[i] = ring[_slot(i)];
+  ring.swap(r);
+  first = 0;
+  _rebuild_index();
+}
+
+void pg_log_dups_t::_rebuild_index()
+{
+  index.assign(ring.size() * 2, 0);
+  shadowed = 0;
+  for (size_t i = 0; i < count; ++i)
+    _index(_slot(i), true);
+}
+
+void pg_log_dups_t::_index(size_t slot, bool newer)
+{
+  const size_t mask = index.size() - 1;
+  for (size_t i = _hash(ring[slot]) & mask; ; i = (i + 1) & mask) {
+    if (!index[i]) {
+      index[i] = slot + 1;
+      return;
+    }
+    const packed_t &o = ring[index[i] - 1];
+    if (o.same_reqid(ring[slot])) {
+      // the same reqid again; the older entry stays, unindexed
+      if (newer)
+	index[i] = slot + 1;
+      ++shadowed;
+      return;
+    }
+  }
+}
+
+bool pg_log_dups_t::_unindex(size_t slot)
+{
+  const size_t mask = index.size() - 1;
+  size_t i = _hash(ring[slot]) & mask;
+  for (; index[i] != slot + 1; i = (i + 1) & mask) {
+    if (!index[i]) {
+      // shadowed by a newer entry for the same reqid
+      --shadowed;
+      return false;
+    }
+  }
+  // backward shift deletion, so that probes never see a hole
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!index[j])
+      break;
+    size_t home = _hash(ring[index[j] - 1]) & mask;
+    if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+    index[i] = index[j];
+    i = j;
+  }
+  index[i] = 0;
+  return true;
+}
+
+bool pg_log_dups_t::find(const osd_reqid_t &r, pg_log_dup_t *out) const
+{
+  if (!count)
+    return false;
+  const size_t mask = index.size() - 1;
+  for (size_t i = _hash(r) & mask; index[i]; i = (i + 1) & mask) {
+    const packed_t &p = ring[index[i] - 1];
+    if (p.reqid_is(r)) {
+      *out = p.unpack();
+      return true;
+    }
+  }
+  return false;
+}
+
+void pg_log_dups_t::push_back(const pg_log_dup_t &d)
+{
+  _reserve(count + 1);
+  size_t slot = _slot(count);
+  ring[slot].pack(d);
+  ++count;
+  _index(slot, true);
+}
+
+void pg_log_dups_t::push_front(const pg_log_dup_t &d)
+{
+  _reserve(count + 1);
+  first = (first - 1) & (ring.size() - 1);
+  ring[first].pack(d);
+  ++count;
+  _index(first, false);
+}
+
+void pg_log_dups_t::pop_front()
+{
+  ceph_assert(count);
+  _unindex(first);
+  first = (first + 1) & (ring.size() - 1);
+  --count;
+  _reserve(count);
+}
+
+void pg_log_dups_t::pop_back()
+{
+  ceph_assert(count);
+  size_t slot = _slot(count - 1);
+  if (_unindex(slot) && shadowed) {
+    // an older entry for the same reqid may be visible again
+    for (size_t i = count - 1; i > 0; --i) {
+      size_t s = _slot(i - 1);
+      if (ring[s].same_reqid(ring[slot])) {
+	--shadowed;
+	_index(s, true);
+	break;
+      }
+    }
+  }
+  --count;
+  _reserve(count);
+}
+
+void pg_log_dups_t::clear()
+{
+  ring.clear();
+  ring.shrink_to_fit();
+  index.clear();
+  index.shrink_to_fit();
+  first = 0;
+  count = 0;
+  shadowed = 0;
+}
+
+bool pg_log_dups_t::operator==(const pg_log_dups_t &rhs) const
+{
+  if (count != rhs.count)
+    return false;
+  for (size_t i = 0; i < count; ++i) {
+    if ((*this)[i] != rhs[i])
+      return false;
+  }
+  return true;
+}
+
+void pg_log_dups_t::encode(ceph::buffer::list &bl) const
+{
+  // same as a list<pg_log_dup_t>
+  using ceph::encode;
+  encode((uint32_t)count, bl);
+  for (size_t i = 0; i < count; ++i)
+    encode((*this)[i], bl);
+}
+
+void pg_log_dups_t::decode(ceph::buffer::list::const_iterator &bl)
+{
+  using ceph::decode;
+  clear();
+  uint32_t n;
+  decode(n, bl);
+  while (n--) {
+    pg_log_dup_t d;
+    decode(d, bl);
+    push_back(d);
+  }
+}
+
 
 // -- pg_log_t --
 
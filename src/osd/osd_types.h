@@ -4002,6 +4002,181 @@ WRITE_CLASS_ENCODER(pg_log_dup_t)
 
 std::ostream& operator<<(std::ostream& out, const pg_log_dup_t& e);
 
+/**
+ * pg_log_dups_t - dup entries of a pg log, oldest to newest
+ *
+ * A pg tracks up to osd_pg_log_dups_tracked of these, and an osd has
+ * thousands of pgs, so rather than a list of pg_log_dup_t plus a hash map
+ * on the side they live in a ring of packed records (48 bytes each) with
+ * an open addressing index by reqid into it (two slots of 4 bytes per
+ * record), both accounted to mempool osd_pglog.  Entries can only be
+ * added or removed at either end.  A reqid that shows up twice is found
+ * as its newest entry.
+ *
+ * Encodes as a list<pg_log_dup_t>.
+ */
+class pg_log_dups_t {
+  struct packed_t {
+    int64_t name_num;
+    ceph_tid_t tid;
+    version_t version;
+    version_t user_version;
+    epoch_t epoch;
+    int32_t inc;
+    int32_t return_code;
+    entity_type_t name_type;
+
+    void pack(const pg_log_dup_t &d);
+    pg_log_dup_t unpack() const;
+    bool reqid_is(const osd_reqid_t &r) const {
+      return tid == r.tid && name_num == r.name.num() && inc == r.inc &&
+	name_type == r.name.type();
+    }
+    bool same_reqid(const packed_t &o) const {
+      return tid == o.tid && name_num == o.name_num && inc == o.inc &&
+	name_type == o.name_type;
+    }
+  };
+
+  mempool::osd_pglog::vector<packed_t> ring;  ///< power of 2 or empty
+  mempool::osd_pglog::vector<uint32_t> index; ///< ring slot + 1, or 0
+  size_t first = 0;   ///< ring slot of the oldest entry
+  size_t count = 0;
+  size_t shadowed = 0;  ///< entries hidden by a newer one for their reqid
+
+  size_t _slot(size_t i) const {
+    return (first + i) & (ring.size() - 1);
+  }
+  static size_t _hash(int64_t num, ceph_tid_t tid, int32_t inc);
+  static size_t _hash(const osd_reqid_t &r) {
+    return _hash(r.name.num(), r.tid, r.inc);
+  }
+  static size_t _hash(const packed_t &p) {
+    return _hash(p.name_num, p.tid, p.inc);
+  }
+  void _reserve(size_t n);
+  void _rebuild_index();
+  void _index(size_t slot, bool newer);
+  bool _unindex(size_t slot);
+
+public:
+  /// dereferences to a copy unpacked into the iterator
+  template <bool Reverse>
+  class iterator_impl {
+    const pg_log_dups_t *dups = nullptr;
+    size_t pos = 0;
+    mutable pg_log_dup_t cur;
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = pg_log_dup_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const pg_log_dup_t*;
+    using reference = const pg_log_dup_t&;
+
+    iterator_impl() = default;
+    iterator_impl(const pg_log_dups_t *dups, size_t pos)
+      : dups(dups), pos(pos) {}
+    reference operator*() const {
+      cur = (*dups)[Reverse ? dups->size() - 1 - pos : pos];
+      return cur;
+    }
+    pointer operator->() const {
+      return &**this;
+    }
+    iterator_impl& operator++() {
+      ++pos;
+      return *this;
+    }
+    iterator_impl operator++(int) {
+      iterator_impl r = *this;
+      ++pos;
+      return r;
+    }
+    bool operator==(const iterator_impl &rhs) const {
+      return pos == rhs.pos;
+    }
+    bool operator!=(const iterator_impl &rhs) const {
+      return pos != rhs.pos;
+    }
+  };
+  using const_iterator = iterator_impl<false>;
+  using iterator = const_iterator;
+  using const_reverse_iterator = iterator_impl<true>;
+  using value_type = pg_log_dup_t;
+
+  pg_log_dups_t() = default;
+  pg_log_dups_t(const pg_log_dups_t &o) = default;
+  pg_log_dups_t(pg_log_dups_t &&o) noexcept {
+    *this = std::move(o);
+  }
+  pg_log_dups_t& operator=(const pg_log_dups_t &o) = default;
+  pg_log_dups_t& operator=(pg_log_dups_t &&o) noexcept {
+    ring.swap(o.ring);
+    index.swap(o.index);
+    std::swap(first, o.first);
+    std::swap(count, o.count);
+    std::swap(shadowed, o.shadowed);
+    return *this;
+  }
+
+  size_t size() const {
+    return count;
+  }
+  bool empty() const {
+    return count == 0;
+  }
+  pg_log_dup_t operator[](size_t i) const {
+    return ring[_slot(i)].unpack();
+  }
+  pg_log_dup_t front() const {
+    return (*this)[0];
+  }
+  pg_log_dup_t back() const {
+    return (*this)[count - 1];
+  }
+  const_iterator begin() const {
+    return const_iterator(this, 0);
+  }
+  const_iterator end() const {
+    return const_iterator(this, count);
+  }
+  const_iterator cbegin() const {
+    return begin();
+  }
+  const_iterator cend() const {
+    return end();
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(this, 0);
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(this, count);
+  }
+
+  /// look up the newest entry for a reqid
+  bool find(const osd_reqid_t &r, pg_log_dup_t *out) const;
+
+  void push_back(const pg_log_dup_t &d);
+  void push_front(const pg_log_dup_t &d);
+  void pop_front();
+  void pop_back();
+  void clear();
+
+  size_t get_memory_usage() const {
+    return ring.capacity() * sizeof(packed_t) +
+      index.capacity() * sizeof(uint32_t);
+  }
+
+  bool operator==(const pg_log_dups_t &rhs) const;
+  bool operator!=(const pg_log_dups_t &rhs) const {
+    return !(*this == rhs);
+  }
+
+  void encode(ceph::buffer::list &bl) const;
+  void decode(ceph::buffer::list::const_iterator &bl);
+};
+WRITE_CLASS_ENCODER(pg_log_dups_t)
+
 /**
  * pg_log_t - incremental log of recent pg changes.
  *
@@ -4030,7 +4205,7 @@ public:
   mempool::osd_pglog::list<pg_log_entry_t> log;
 
   // entries just for dup op detection ordered oldest to newest
-  mempool::osd_pglog::list<pg_log_dup_t> dups;
+  pg_log_dups_t dups;
 
   pg_log_t() = default;
   pg_log_t(const eversion_t &last_update,
@@ -4038,7 +4213,7 @@ public:
 	   const eversion_t &can_rollback_to,
 	   const eversion_t &rollback_info_trimmed_to,
 	   mempool::osd_pglog::list<pg_log_entry_t> &&entries,
-	   mempool::osd_pglog::list<pg_log_dup_t> &&dup_entries)
+	   pg_log_dups_t &&dup_entries)
     : head(last_update), tail(log_tail), can_rollback_to(can_rollback_to),
       rollback_info_trimmed_to(rollback_info_trimmed_to),
       log(std::move(entries)), dups(std::move(dup_entries)) {}
@@ -4047,15 +4222,13 @@ public:
 	   const eversion_t &can_rollback_to,
 	   const eversion_t &rollback_info_trimmed_to,
 	   const std::list<pg_log_entry_t> &entries,
-	   const std::list<pg_log_dup_t> &dup_entries)
+	   pg_log_dups_t &&dup_entries)
     : head(last_update), tail(log_tail), can_rollback_to(can_rollback_to),
-      rollback_info_trimmed_to(rollback_info_trimmed_to) {
+      rollback_info_trimmed_to(rollback_info_trimmed_to),
+      dups(std::move(dup_entries)) {
     for (auto &&entry: entries) {
       log.push_back(entry);
     }
-    for (auto &&entry: dup_entries) {
-      dups.push_back(entry);
-    }
   }
 
   void clear() {
@@ -4148,11 +4321,11 @@ public:
 
     // sort and merge dups
     std::multimap<eversion_t,pg_log_dup_t> sorted;
-    for (auto& d : dups) {
+    for (const auto& d : dups) {
       sorted.emplace(d.version, d);
     }
     for (auto l : slogs) {
-      for (auto& d : l->dups) {
+      for (const auto& d : l->dups) {
 	sorted.emplace(d.version, d);
       }
     }
@@ -49,6 +49,7 @@ struct Options {
   unsigned simulate_pglog;
   unsigned single_pool_mode;
   unsigned preallocate_files;
+  unsigned bdev_ioring;
 };
 
 template <class Func> // void Func(fio_option&)
@@ -144,6 +145,14 @@ static std::vector<fio_option> ceph_options{
     o.off1   = offsetof(Options, preallocate_files);
     o.def    = "1";
   }),
+  make_option([] (fio_option& o) {
+    o.name   = "bdev_ioring";
+    o.lname  = "use io_uring for block devices";
+    o.type   = FIO_OPT_BOOL;
+    o.help   = "Enables io_uring for block devices, otherwise bdev_ioring from the ceph configuration file applies";
+    o.off1   = offsetof(Options, bdev_ioring);
+    o.def    = "0";
+  }),
   {} // fio expects a 'null'-terminated list
 };
 
@@ -327,6 +336,10 @@ Engine::Engine(thread_data* td)
     args.emplace_back("--fio_dir");
     args.emplace_back(td->o.directory);
   }
+  if (o->bdev_ioring) {
+    args.emplace_back("--bdev_ioring");
+    args.emplace_back("true");
+  }
 
   // claim the g_ceph_context reference and release it on destruction
   cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
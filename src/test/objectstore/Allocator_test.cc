@@ -242,6 +242,8 @@ TEST_P(AllocTest, test_alloc_fragmentation)
   init_alloc(capacity, alloc_unit);
   alloc->init_add_free(0, capacity);
   bool bitmap_alloc = GetParam() == std::string("bitmap");
+  bool avl_alloc = GetParam() == std::string("avl");
+  bool hybrid_alloc = GetParam() == std::string("hybrid");
   
   EXPECT_EQ(0.0, alloc->get_fragmentation());
 
@@ -295,7 +297,7 @@ TEST_P(AllocTest, test_alloc_fragmentation)
   // Hence leaving just two 
   // digits after decimal point due to this.
   EXPECT_EQ(0u, uint64_t(alloc->get_fragmentation() * 100));
-  if (bitmap_alloc) {
+  if (bitmap_alloc || avl_alloc || hybrid_alloc) {
     EXPECT_EQ(0u, uint64_t(alloc->get_fragmentation_score() * 100));
   } else {
     EXPECT_EQ(11u, uint64_t(alloc->get_fragmentation_score() * 100));
@@ -438,4 +440,4 @@ TEST_P(AllocTest, test_alloc_big3)
 INSTANTIATE_TEST_SUITE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl", "hybrid"));
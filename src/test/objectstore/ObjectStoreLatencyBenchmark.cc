@@ -0,0 +1,545 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Drives an ObjectStore (whatever osd_objectstore names: memstore,
+ * bluestore on a file backed device, kstore, ...) with a mix of
+ * operations, one at a time, and reports the latency percentiles and the
+ * cpu cost of each operation type, along with how the allocator
+ * fragmentation evolves over the run.  With --json the report is
+ * machine readable, so that runs of different releases can be compared.
+ */
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/Cond.h"
+#include "common/Formatter.h"
+#include "common/ceph_argparse.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/strtol.h"
+#include "global/global_init.h"
+#include "os/ObjectStore.h"
+#if defined(WITH_BLUESTORE)
+#include "os/bluestore/BlueStore.h"
+#endif
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_filestore
+
+using namespace std;
+
+enum op_type_t {
+  OP_WRITE,      ///< create an object
+  OP_OVERWRITE,  ///< overwrite a block of an object
+  OP_OMAP_SET,
+  OP_OMAP_GET,
+  OP_CLONE,
+  OP_SETATTR,
+  OP_REMOVE,
+  OP_MAX
+};
+
+static const char *op_names[OP_MAX] = {
+  "write", "overwrite", "omap_set", "omap_get", "clone", "setattr", "remove"
+};
+
+struct Config {
+  uint64_t ops = 10000;
+  uint64_t object_size = 65536;
+  uint64_t block_size = 4096;
+  uint64_t max_objects = 1000;
+  unsigned omap_keys = 8;
+  uint64_t omap_value_size = 128;
+  uint64_t attr_size = 256;
+  double sample_interval = 1.0;
+  unsigned seed = 0;
+  double mix[OP_MAX] = { 10, 40, 15, 15, 5, 10, 5 };
+  string json;
+};
+
+static void usage()
+{
+  cout << "usage: ceph_perf_objectstore_latency [flags]\n"
+    "	 --ops <n>\n"
+    "	       number of operations to run (default 10000)\n"
+    "	 --object-size <bytes>\n"
+    "	       size of newly written objects (default 64K)\n"
+    "	 --block-size <bytes>\n"
+    "	       size of each overwrite (default 4K)\n"
+    "	 --max-objects <n>\n"
+    "	       objects at most, past that writes and clones overwrite\n"
+    "	 --omap-keys <n>, --omap-value-size <bytes>\n"
+    "	       omap entries set and read by each omap op\n"
+    "	 --attr-size <bytes>\n"
+    "	       size of the attribute set by setattr\n"
+    "	 --mix <op>=<weight>[,<op>=<weight>...]\n"
+    "	       relative frequency of write, overwrite, omap_set, omap_get,\n"
+    "	       clone, setattr and remove\n"
+    "	 --sample-interval <seconds>\n"
+    "	       how often to sample allocator fragmentation (default 1)\n"
+    "	 --seed <n>\n"
+    "	       random seed, for repeatable runs\n"
+    "	 --json <file>\n"
+    "	       write the report as json to file, or - for stdout\n"
+       << std::endl;
+  generic_server_usage();
+}
+
+static bool parse_mix(const string& s, Config *cfg)
+{
+  std::fill(cfg->mix, cfg->mix + OP_MAX, 0);
+  vector<string> items;
+  get_str_vec(s, ",", items);
+  for (auto& item : items) {
+    auto eq = item.find('=');
+    if (eq == string::npos) {
+      return false;
+    }
+    auto p = std::find(op_names, op_names + OP_MAX, item.substr(0, eq));
+    if (p == op_names + OP_MAX) {
+      return false;
+    }
+    string err;
+    cfg->mix[p - op_names] = strict_strtod(item.c_str() + eq + 1, &err);
+    if (!err.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t thread_cpu_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t process_cpu_ns()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+struct OpStats {
+  vector<uint64_t> lat_ns;
+  uint64_t cpu_ns = 0;  ///< on the submitting thread
+
+  uint64_t percentile(double q) const {
+    ceph_assert(!lat_ns.empty());
+    size_t i = std::min<size_t>(lat_ns.size() - 1, q * lat_ns.size());
+    return lat_ns[i];
+  }
+};
+
+struct Sample {
+  double elapsed;
+  uint64_t ops;
+  double fragmentation;  ///< < 0 if the store has no allocator
+  uint64_t used;
+};
+
+class Bench {
+  ObjectStore *os;
+  const Config& cfg;
+  coll_t cid;
+  ObjectStore::CollectionHandle ch;
+  std::mt19937 rng;
+  vector<ghobject_t> objects;
+  uint64_t next_object = 0;
+  bufferlist object_data, block_data, omap_value, attr_value;
+
+public:
+  OpStats stats[OP_MAX];
+  vector<Sample> samples;
+  double duration = 0;
+  uint64_t process_cpu = 0;
+
+  Bench(ObjectStore *os, const Config& cfg)
+    : os(os), cfg(cfg), cid(spg_t(pg_t(0, 0))), rng(cfg.seed) {
+    object_data.append(buffer::create(cfg.object_size));
+    object_data.zero();
+    block_data.append(buffer::create(cfg.block_size));
+    block_data.zero();
+    omap_value.append(buffer::create(cfg.omap_value_size));
+    omap_value.zero();
+    attr_value.append(buffer::create(cfg.attr_size));
+    attr_value.zero();
+  }
+
+  void setup() {
+    ch = os->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    submit(std::move(t));
+  }
+
+  void teardown() {
+    ObjectStore::Transaction t;
+    for (auto& oid : objects) {
+      t.remove(cid, oid);
+    }
+    t.remove_collection(cid);
+    submit(std::move(t));
+    ch.reset();
+  }
+
+  void run() {
+    std::discrete_distribution<int> pick(cfg.mix, cfg.mix + OP_MAX);
+    auto start = ceph::mono_clock::now();
+    auto next_sample = start;
+    uint64_t cpu_start = process_cpu_ns();
+    for (uint64_t i = 0; i < cfg.ops; ++i) {
+      auto now = ceph::mono_clock::now();
+      if (now >= next_sample) {
+	sample(std::chrono::duration<double>(now - start).count(), i);
+	next_sample = now + ceph::make_timespan(cfg.sample_interval);
+      }
+      op_type_t op = choose((op_type_t)pick(rng));
+      uint64_t cpu = thread_cpu_ns();
+      auto op_start = ceph::mono_clock::now();
+      do_op(op);
+      auto lat = ceph::mono_clock::now() - op_start;
+      stats[op].cpu_ns += thread_cpu_ns() - cpu;
+      stats[op].lat_ns.push_back(
+	std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count());
+    }
+    auto end = ceph::mono_clock::now();
+    process_cpu = process_cpu_ns() - cpu_start;
+    duration = std::chrono::duration<double>(end - start).count();
+    sample(duration, cfg.ops);
+    for (auto& s : stats) {
+      std::sort(s.lat_ns.begin(), s.lat_ns.end());
+    }
+  }
+
+private:
+  void submit(ObjectStore::Transaction&& t) {
+    C_SaferCond c;
+    t.register_on_commit(&c);
+    int r = os->queue_transaction(ch, std::move(t));
+    ceph_assert(r == 0);
+    c.wait();
+  }
+
+  const ghobject_t& random_object() {
+    return objects[std::uniform_int_distribution<size_t>(
+	0, objects.size() - 1)(rng)];
+  }
+
+  ghobject_t new_object() {
+    return ghobject_t(hobject_t(sobject_t(
+      "bench_" + stringify(next_object++), CEPH_NOSNAP)));
+  }
+
+  /// fall back to an op that makes sense with the objects at hand
+  op_type_t choose(op_type_t op) {
+    if (objects.empty()) {
+      return OP_WRITE;
+    }
+    if ((op == OP_WRITE || op == OP_CLONE) &&
+	objects.size() >= cfg.max_objects) {
+      return OP_OVERWRITE;
+    }
+    if (op == OP_REMOVE && objects.size() == 1) {
+      return OP_OVERWRITE;
+    }
+    return op;
+  }
+
+  void do_op(op_type_t op) {
+    ObjectStore::Transaction t;
+    switch (op) {
+    case OP_WRITE:
+      {
+	ghobject_t oid = new_object();
+	t.write(cid, oid, 0, object_data.length(), object_data);
+	submit(std::move(t));
+	objects.push_back(oid);
+      }
+      break;
+    case OP_OVERWRITE:
+      {
+	uint64_t blocks = std::max<uint64_t>(
+	  1, cfg.object_size / cfg.block_size);
+	uint64_t off = std::uniform_int_distribution<uint64_t>(
+	  0, blocks - 1)(rng) * cfg.block_size;
+	t.write(cid, random_object(), off, block_data.length(), block_data);
+	submit(std::move(t));
+      }
+      break;
+    case OP_OMAP_SET:
+      {
+	map<string, bufferlist> kv;
+	for (unsigned k = 0; k < cfg.omap_keys; ++k) {
+	  kv["key_" + stringify(k)] = omap_value;
+	}
+	t.omap_setkeys(cid, random_object(), kv);
+	submit(std::move(t));
+      }
+      break;
+    case OP_OMAP_GET:
+      {
+	set<string> keys;
+	for (unsigned k = 0; k < cfg.omap_keys; ++k) {
+	  keys.insert("key_" + stringify(k));
+	}
+	map<string, bufferlist> out;
+	int r = os->omap_get_values(ch, random_object(), keys, &out);
+	ceph_assert(r == 0);
+      }
+      break;
+    case OP_CLONE:
+      {
+	ghobject_t oid = new_object();
+	t.clone(cid, random_object(), oid);
+	submit(std::move(t));
+	objects.push_back(oid);
+      }
+      break;
+    case OP_SETATTR:
+      t.setattr(cid, random_object(), "_", attr_value);
+      submit(std::move(t));
+      break;
+    case OP_REMOVE:
+      {
+	size_t i = std::uniform_int_distribution<size_t>(
+	  0, objects.size() - 1)(rng);
+	t.remove(cid, objects[i]);
+	submit(std::move(t));
+	objects[i] = objects.back();
+	objects.pop_back();
+      }
+      break;
+    default:
+      ceph_abort();
+    }
+  }
+
+  void sample(double elapsed, uint64_t ops) {
+    Sample s{elapsed, ops, -1, 0};
+#if defined(WITH_BLUESTORE)
+    if (dynamic_cast<BlueStore*>(os)) {
+      // kept up to date by the kv_finalize thread, in thousandths
+      s.fragmentation =
+	os->get_perf_counters()->get(l_bluestore_fragmentation) / 1000.0;
+    }
+#endif
+    store_statfs_t st;
+    if (os->statfs(&st) == 0) {
+      s.used = st.total - st.available;
+    }
+    samples.push_back(s);
+  }
+};
+
+static void dump(const Bench& b, const Config& cfg, Formatter *f)
+{
+  f->open_object_section("objectstore_latency");
+  f->dump_string("objectstore", g_conf()->osd_objectstore);
+  f->dump_unsigned("ops", cfg.ops);
+  f->dump_unsigned("object_size", cfg.object_size);
+  f->dump_unsigned("block_size", cfg.block_size);
+  f->dump_unsigned("seed", cfg.seed);
+  f->dump_float("duration_s", b.duration);
+  f->dump_float("ops_per_s", cfg.ops / b.duration);
+  f->dump_float("process_cpu_us_per_op", b.process_cpu / 1000.0 / cfg.ops);
+  f->open_array_section("op_types");
+  for (int op = 0; op < OP_MAX; ++op) {
+    const OpStats& s = b.stats[op];
+    if (s.lat_ns.empty()) {
+      continue;
+    }
+    uint64_t sum = 0;
+    for (auto l : s.lat_ns) {
+      sum += l;
+    }
+    f->open_object_section("op_type");
+    f->dump_string("op", op_names[op]);
+    f->dump_unsigned("count", s.lat_ns.size());
+    f->dump_float("avg_us", sum / 1000.0 / s.lat_ns.size());
+    f->dump_float("p50_us", s.percentile(.5) / 1000.0);
+    f->dump_float("p99_us", s.percentile(.99) / 1000.0);
+    f->dump_float("p999_us", s.percentile(.999) / 1000.0);
+    f->dump_float("max_us", s.lat_ns.back() / 1000.0);
+    f->dump_float("cpu_us_per_op", s.cpu_ns / 1000.0 / s.lat_ns.size());
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("samples");
+  for (auto& s : b.samples) {
+    f->open_object_section("sample");
+    f->dump_float("elapsed_s", s.elapsed);
+    f->dump_unsigned("ops", s.ops);
+    if (s.fragmentation >= 0) {
+      f->dump_float("fragmentation", s.fragmentation);
+    }
+    f->dump_unsigned("used_bytes", s.used);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
+static void print(const Bench& b, const Config& cfg)
+{
+  cout << g_conf()->osd_objectstore << ": " << cfg.ops << " ops in "
+       << b.duration << "s, " << (cfg.ops / b.duration) << " ops/s, "
+       << (b.process_cpu / 1000.0 / cfg.ops) << " us cpu/op\n";
+  cout << "op              count     p50_us     p99_us    p999_us  cpu_us/op\n";
+  for (int op = 0; op < OP_MAX; ++op) {
+    const OpStats& s = b.stats[op];
+    if (s.lat_ns.empty()) {
+      continue;
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "%-12s %8zu %10.1f %10.1f %10.1f %10.1f\n",
+	     op_names[op], s.lat_ns.size(),
+	     s.percentile(.5) / 1000.0,
+	     s.percentile(.99) / 1000.0,
+	     s.percentile(.999) / 1000.0,
+	     s.cpu_ns / 1000.0 / s.lat_ns.size());
+    cout << line;
+  }
+  if (!b.samples.empty() && b.samples.back().fragmentation >= 0) {
+    cout << "fragmentation " << b.samples.front().fragmentation << " -> "
+	 << b.samples.back().fragmentation << "\n";
+  }
+  cout << std::flush;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  if (ceph_argparse_need_usage(args)) {
+    usage();
+    exit(0);
+  }
+
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+
+  Config cfg;
+  string val;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    }
+    string err;
+    if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)nullptr)) {
+      cfg.ops = strict_strtoll(val.c_str(), 10, &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--object-size", (char*)nullptr)) {
+      cfg.object_size = strict_iecstrtoll(val.c_str(), &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--block-size", (char*)nullptr)) {
+      cfg.block_size = strict_iecstrtoll(val.c_str(), &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--max-objects", (char*)nullptr)) {
+      cfg.max_objects = strict_strtoll(val.c_str(), 10, &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--omap-keys", (char*)nullptr)) {
+      cfg.omap_keys = strict_strtoll(val.c_str(), 10, &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--omap-value-size", (char*)nullptr)) {
+      cfg.omap_value_size = strict_iecstrtoll(val.c_str(), &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--attr-size", (char*)nullptr)) {
+      cfg.attr_size = strict_iecstrtoll(val.c_str(), &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--sample-interval", (char*)nullptr)) {
+      cfg.sample_interval = strict_strtod(val.c_str(), &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--seed", (char*)nullptr)) {
+      cfg.seed = strict_strtoll(val.c_str(), 10, &err);
+    } else if (ceph_argparse_witharg(args, i, &val, "--mix", (char*)nullptr)) {
+      if (!parse_mix(val, &cfg)) {
+	err = "expected <op>=<weight>[,...]";
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--json", (char*)nullptr)) {
+      cfg.json = val;
+    } else {
+      cerr << "unrecognized argument: " << *i << std::endl;
+      exit(1);
+    }
+    if (!err.empty()) {
+      cerr << "error parsing '" << val << "': " << err << std::endl;
+      exit(1);
+    }
+  }
+  if (!cfg.ops || !cfg.object_size || !cfg.block_size || !cfg.max_objects ||
+      cfg.block_size > cfg.object_size) {
+    cerr << "invalid sizes" << std::endl;
+    exit(1);
+  }
+
+  common_init_finish(g_ceph_context);
+
+  const string& data = g_conf()->osd_data;
+  dout(0) << "objectstore " << g_conf()->osd_objectstore
+	  << " data " << data << dendl;
+  if (::mkdir(data.c_str(), 0755) < 0 && errno != EEXIST) {
+    cerr << "failed to create " << data << ": " << cpp_strerror(errno)
+	 << std::endl;
+    return 1;
+  }
+  std::unique_ptr<ObjectStore> os(
+    ObjectStore::create(g_ceph_context,
+			g_conf()->osd_objectstore,
+			data,
+			g_conf()->osd_journal));
+  if (!os) {
+    cerr << "bad objectstore type " << g_conf()->osd_objectstore << std::endl;
+    return 1;
+  }
+  if (os->mkfs() < 0) {
+    cerr << "mkfs failed" << std::endl;
+    return 1;
+  }
+  if (os->mount() < 0) {
+    cerr << "mount failed" << std::endl;
+    return 1;
+  }
+
+  Bench b(os.get(), cfg);
+  b.setup();
+  b.run();
+  b.teardown();
+  os->umount();
+
+  if (cfg.json.empty()) {
+    print(b, cfg);
+  } else {
+    JSONFormatter f(true);
+    dump(b, cfg, &f);
+    if (cfg.json == "-") {
+      f.flush(cout);
+      cout << std::endl;
+    } else {
+      std::ofstream out(cfg.json);
+      f.flush(out);
+      out << std::endl;
+      if (!out) {
+	cerr << "failed to write " << cfg.json << std::endl;
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
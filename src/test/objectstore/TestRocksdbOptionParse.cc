@@ -72,3 +72,23 @@ TEST(RocksDBOption, interpret) {
   //high pri threads is flusher_threads
   ASSERT_EQ(5, num_high_pri_threads);
 }
+TEST(RocksDBOption, column_family_options) {
+  string cf_dir = dir + "-cf";
+  map<string,string> kvoptions;
+  vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("O(2)", "write_buffer_size=1048576"));
+  cfs.push_back(KeyValueDB::ColumnFamily("M", "write_buffer_size=2097152"));
+  {
+    RocksDBStore db(g_ceph_context, cf_dir, kvoptions, NULL);
+    ASSERT_EQ(0, db.init(""));
+    ASSERT_EQ(0, db.create_and_open(cout, cfs));
+  }
+  // the options the column families were created with stick without
+  // being given again
+  RocksDBStore db(g_ceph_context, cf_dir, kvoptions, NULL);
+  ASSERT_EQ(0, db.init(""));
+  ASSERT_EQ(0, db.open(cout));
+  ASSERT_EQ(1048576u, db.get_cf_options("O-0").write_buffer_size);
+  ASSERT_EQ(1048576u, db.get_cf_options("O-1").write_buffer_size);
+  ASSERT_EQ(2097152u, db.get_cf_options("M").write_buffer_size);
+}
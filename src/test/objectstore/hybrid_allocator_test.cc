@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include "os/bluestore/HybridAllocator.h"
+
+class TestHybridAllocator : public HybridAllocator {
+public:
+  TestHybridAllocator(CephContext* cct,
+                      int64_t device_size,
+                      int64_t _block_size,
+                      uint64_t max_entries,
+                      const std::string& name) :
+    HybridAllocator(cct, device_size, _block_size,
+                    max_entries * sizeof(range_seg_t),
+                    name) {
+  }
+
+  uint64_t get_bmap_free() {
+    return get_bmap() ? get_bmap()->get_free() : 0;
+  }
+  uint64_t get_avl_free() {
+    return AvlAllocator::get_free();
+  }
+};
+
+const uint64_t _1m = 1024 * 1024;
+
+TEST(HybridAllocator, basic)
+{
+  uint64_t block_size = 0x1000;
+  uint64_t capacity = 256 * _1m;
+  TestHybridAllocator ha(g_ceph_context, capacity, block_size, 2,
+                         "test_hybrid_allocator");
+
+  ASSERT_EQ(0u, ha.get_free());
+  ASSERT_EQ(0u, ha.get_avl_free());
+  ASSERT_EQ(0u, ha.get_bmap_free());
+
+  ha.init_add_free(0, 0x2000);
+  ha.init_add_free(0x4000, 0x2000);
+  ASSERT_EQ(0x4000u, ha.get_free());
+  ASSERT_EQ(0x4000u, ha.get_avl_free());
+  ASSERT_EQ(0u, ha.get_bmap_free());
+
+  // the tree is full, a shorter range is spilled over to the bitmap
+  ha.init_add_free(0x8000, 0x1000);
+  ASSERT_EQ(0x5000u, ha.get_free());
+  ASSERT_EQ(0x4000u, ha.get_avl_free());
+  ASSERT_EQ(0x1000u, ha.get_bmap_free());
+
+  // a longer one evicts the shortest range from the tree
+  ha.init_add_free(0x10000, 0x10000);
+  ASSERT_EQ(0x15000u, ha.get_free());
+  ASSERT_EQ(0x12000u, ha.get_avl_free());
+  ASSERT_EQ(0x3000u, ha.get_bmap_free());
+
+  // released range merges with its neighbour in the tree
+  {
+    interval_set<uint64_t> release_set;
+    release_set.insert(0x6000, 0x2000);
+    ha.release(release_set);
+  }
+  ASSERT_EQ(0x17000u, ha.get_free());
+  ASSERT_EQ(0x14000u, ha.get_avl_free());
+  ASSERT_EQ(0x3000u, ha.get_bmap_free());
+
+  // requests shorter than any range in the tree are served by the bitmap
+  {
+    PExtentVector extents;
+    ASSERT_EQ(0x1000, ha.allocate(0x1000, 0x1000, 0, 0, &extents));
+    ASSERT_EQ(1u, extents.size());
+    ASSERT_EQ(0x14000u, ha.get_avl_free());
+    ASSERT_EQ(0x2000u, ha.get_bmap_free());
+  }
+  // longer ones go to the tree
+  {
+    PExtentVector extents;
+    ASSERT_EQ(0x10000, ha.allocate(0x10000, 0x1000, 0, 0, &extents));
+    ASSERT_EQ(1u, extents.size());
+    ASSERT_EQ(0x10000u, extents[0].offset);
+    ASSERT_EQ(0x10000u, extents[0].length);
+    ASSERT_EQ(0x4000u, ha.get_avl_free());
+    ASSERT_EQ(0x2000u, ha.get_bmap_free());
+  }
+  // the bitmap complements the tree when the latter runs short
+  {
+    PExtentVector extents;
+    ASSERT_EQ(0x6000, ha.allocate(0x6000, 0x1000, 0, 0, &extents));
+    ASSERT_EQ(0x4000u, extents[0].offset);
+    ASSERT_EQ(0x4000u, extents[0].length);
+    ASSERT_EQ(0u, ha.get_free());
+  }
+  {
+    PExtentVector extents;
+    ASSERT_EQ(-ENOSPC, ha.allocate(0x1000, 0x1000, 0, 0, &extents));
+    ASSERT_EQ(0u, extents.size());
+  }
+}
+
+TEST(HybridAllocator, init_rm_free)
+{
+  uint64_t block_size = 0x1000;
+  uint64_t capacity = 256 * _1m;
+  TestHybridAllocator ha(g_ceph_context, capacity, block_size, 1,
+                         "test_hybrid_allocator");
+
+  ha.init_add_free(0, 0x10000);
+  ha.init_add_free(0x20000, 0x1000);
+  ASSERT_EQ(0x10000u, ha.get_avl_free());
+  ASSERT_EQ(0x1000u, ha.get_bmap_free());
+
+  // the range isn't in the tree, hence removed from the bitmap
+  ha.init_rm_free(0x20000, 0x1000);
+  ASSERT_EQ(0x10000u, ha.get_avl_free());
+  ASSERT_EQ(0u, ha.get_bmap_free());
+
+  // splitting the only tree range leaves the shorter head in the bitmap
+  ha.init_rm_free(0x1000, 0x2000);
+  ASSERT_EQ(0xd000u, ha.get_avl_free());
+  ASSERT_EQ(0x1000u, ha.get_bmap_free());
+
+  // freed range adjacent to the tree one is merged into it
+  ha.init_add_free(0x1000, 0x2000);
+  ASSERT_EQ(0xf000u, ha.get_avl_free());
+  ASSERT_EQ(0x1000u, ha.get_bmap_free());
+
+  // removal spanning both the bitmap and the tree
+  ha.init_rm_free(0, 0x4000);
+  ASSERT_EQ(0xc000u, ha.get_avl_free());
+  ASSERT_EQ(0u, ha.get_bmap_free());
+  ASSERT_EQ(0xc000u, ha.get_free());
+}
@@ -1096,6 +1096,108 @@ TEST_P(StoreTest, CompressionTest) {
   doCompressionTest();
 }
 
+TEST_P(StoreTest, ChecksumDigest) {
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    uint32_t crc = -1;
+    ObjectStore::Transaction t;
+    t.touch(cid, hoid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    r = store->checksum_digest(ch, hoid, 0, 4096, &crc);
+    if (r == -EOPNOTSUPP) {
+      return;
+    }
+    ASSERT_EQ(0, r);
+    ASSERT_EQ((uint32_t)-1, crc);
+  }
+
+  // must match crc32c over what read() returns, whichever way the store
+  // laid the data out
+  auto check = [&](uint64_t off, uint64_t len) {
+    bufferlist bl;
+    int rr = store->read(ch, hoid, off, len, bl);
+    ASSERT_LE(0, rr);
+    uint32_t crc = -1;
+    ASSERT_EQ(rr, store->checksum_digest(ch, hoid, off, len, &crc));
+    ASSERT_EQ(bl.crc32c(-1), crc);
+  };
+  auto check_all = [&]() {
+    struct stat st;
+    ASSERT_EQ(0, store->stat(ch, hoid, &st));
+    check(0, st.st_size);
+    check(0, 0x10000);
+    check(0x1000, 0x1000);
+    check(0x1234, 0x8765);
+    check(st.st_size - 3, 0x1000);
+    check(st.st_size, 0x1000);
+    // chained in strides, as deep scrub does
+    uint32_t crc = -1;
+    uint64_t pos = 0;
+    while (true) {
+      int rr = store->checksum_digest(ch, hoid, pos, 0x3000, &crc);
+      ASSERT_LE(0, rr);
+      pos += rr;
+      if (rr < 0x3000)
+	break;
+    }
+    ASSERT_EQ((uint64_t)st.st_size, pos);
+    bufferlist bl;
+    ASSERT_EQ(st.st_size, store->read(ch, hoid, 0, st.st_size, bl));
+    ASSERT_EQ(bl.crc32c(-1), crc);
+  };
+  auto write = [&](uint64_t off, uint64_t len, char c) {
+    bufferlist bl;
+    bufferptr bp(len);
+    for (uint64_t i = 0; i < len; ++i) {
+      bp[i] = c + (i % 7 == 0 ? i % 13 : 0);
+    }
+    bl.append(bp);
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, off, len, bl);
+    ASSERT_EQ(0, queue_transaction(store, ch, std::move(t)));
+  };
+
+  write(0, 0x20000, 'a');
+  check_all();
+  write(0x3003, 0x2ffd, 'b');       // unaligned overwrite
+  write(0x30000, 0x1001, 'c');      // past a hole
+  write(0x7ff, 0x2, 'd');           // small, may be deferred
+  check_all();
+  {
+    ObjectStore::Transaction t;
+    t.zero(cid, hoid, 0x9000, 0x4000);
+    t.truncate(cid, hoid, 0x30800);
+    ASSERT_EQ(0, queue_transaction(store, ch, std::move(t)));
+  }
+  check_all();
+
+  if (string(GetParam()) == "bluestore") {
+    SetVal(g_conf(), "bluestore_compression_mode", "force");
+    g_ceph_context->_conf.apply_changes(nullptr);
+    write(0x40000, 0x20000, 'e');
+    write(0x41111, 0x1111, 'f');
+    check_all();
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   int r;
   coll_t cid;
@@ -4618,7 +4720,201 @@ TEST_P(StoreTestSpecificAUSize, BlueFSExtenderTest) {
   bstore->mount();
 }
 
+TEST_P(StoreTestSpecificAUSize, MultipleAioReapers) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bdev_aio_reap_threads", "4");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  doSyntheticTest(5000, 400*1024, 40*1024, 0);
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTestSpecificAUSize, MultipleKVFinalizeThreads) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  const unsigned num_threads = 4;
+  SetVal(g_conf(), "bluestore_kv_finalize_threads", "4");
+  SetVal(g_conf(), "bluestore_sync_submit_transaction", "true");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+
+  // one collection, and so one sequencer, per finalize thread: a
+  // collection's pg seed picks its thread
+  const unsigned num_txcs = 200;
+  vector<coll_t> cids;
+  vector<ObjectStore::CollectionHandle> chs;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    cids.push_back(coll_t(spg_t(pg_t(i, 0), shard_id_t::NO_SHARD)));
+    chs.push_back(store->create_new_collection(cids.back()));
+    ObjectStore::Transaction t;
+    t.create_collection(cids.back(), 0);
+    ASSERT_EQ(queue_transaction(store, chs.back(), std::move(t)), 0);
+  }
+  vector<uint64_t> before = bstore->get_kv_finalized_txcs();
+  ASSERT_EQ(before.size(), num_threads);
+
+  ceph::mutex lock = ceph::make_mutex("MultipleKVFinalizeThreads::lock");
+  ceph::condition_variable cond;
+  vector<vector<unsigned>> committed(num_threads);
+  unsigned num_committed = 0;
+  for (unsigned n = 0; n < num_txcs; ++n) {
+    for (unsigned i = 0; i < num_threads; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(n % 10),
+					  CEPH_NOSNAP)));
+      bufferlist bl;
+      bl.append(std::string(4096, 'a' + n % 26));
+      ObjectStore::Transaction t;
+      t.write(cids[i], hoid, 0, bl.length(), bl);
+      t.register_on_commit(make_lambda_context([&, i, n](int) {
+	std::lock_guard l(lock);
+	committed[i].push_back(n);
+	++num_committed;
+	cond.notify_all();
+      }));
+      ASSERT_EQ(store->queue_transaction(chs[i], std::move(t)), 0);
+    }
+  }
+  {
+    std::unique_lock l(lock);
+    cond.wait(l, [&] { return num_committed == num_txcs * num_threads; });
+  }
+
+  // every sequencer completes in submission order, whichever thread
+  // finalized it
+  for (unsigned i = 0; i < num_threads; ++i) {
+    ASSERT_EQ(committed[i].size(), num_txcs);
+    for (unsigned n = 0; n < num_txcs; ++n) {
+      ASSERT_EQ(committed[i][n], n);
+    }
+  }
+  vector<uint64_t> after = bstore->get_kv_finalized_txcs();
+  ASSERT_EQ(after.size(), num_threads);
+  unsigned busy = 0;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    if (after[i] > before[i]) {
+      ++busy;
+    }
+  }
+  ASSERT_GT(busy, 1u);
+
+  for (unsigned i = 0; i < num_threads; ++i) {
+    ObjectStore::Transaction t;
+    for (unsigned n = 0; n < 10; ++n) {
+      t.remove(cids[i], ghobject_t(hobject_t(sobject_t(
+	"Object " + stringify(n), CEPH_NOSNAP))));
+    }
+    t.remove_collection(cids[i]);
+    ASSERT_EQ(queue_transaction(store, chs[i], std::move(t)), 0);
+  }
+  chs.clear();
+
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTestSpecificAUSize, ParallelCompression) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_compression_threads", "4");
+  SetVal(g_conf(), "bluestore_compression_mode", "force");
+  SetVal(g_conf(), "bluestore_compression_max_blob_size", "65536");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  bufferlist bl;
+  for (unsigned i = 0; i < 1024 * 1024 / 16; ++i) {
+    bl.append(stringify(i % 1000 + 1000000000000000ull));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_GT(logger->get(l_bluestore_compress_parallel_blobs), 0u);
+  ASSERT_GT(logger->get(l_bluestore_compress_success_count), 0u);
+  {
+    bufferlist in;
+    ASSERT_EQ((int)bl.length(), store->read(ch, hoid, 0, bl.length(), in));
+    ASSERT_TRUE(bl_eq(bl, in));
+  }
+  ch.reset();
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
 #if defined(WITH_BLUESTORE)
+TEST_P(StoreTestSpecificAUSize, ReadZeroCopyBytes) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_default_buffered_write", "true");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(65536, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  {
+    // the written data is still cached, so the whole read is a hit
+    uint64_t before = logger->get(l_bluestore_read_zero_copy_bytes);
+    bufferlist in;
+    ASSERT_EQ((int)bl.length(), store->read(ch, hoid, 0, bl.length(), in));
+    ASSERT_TRUE(bl_eq(bl, in));
+    ASSERT_EQ(logger->get(l_bluestore_read_zero_copy_bytes),
+	      before + bl.length());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, SyntheticMatrixSharding) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -5684,6 +5980,66 @@ TEST_P(StoreTest, MergeSkewed) {
 }
 
 
+TEST_P(StoreTest, MergeOnlyTransaction) {
+  int r;
+  coll_t a(spg_t(pg_t(0, 0), shard_id_t::NO_SHARD));
+  coll_t b(spg_t(pg_t(1, 0), shard_id_t::NO_SHARD));
+  ghobject_t ao(hobject_t("a", "", CEPH_NOSNAP, 0, 0, ""));
+  ghobject_t bo(hobject_t("b", "", CEPH_NOSNAP, 1, 0, ""));
+  auto cha = store->create_new_collection(a);
+  auto chb = store->create_new_collection(b);
+  bufferlist small;
+  small.append("small");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(a, 1);
+    t.write(a, ao, 0, small.length(), small, 0);
+    r = queue_transaction(store, cha, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(b, 1);
+    t.write(b, bo, 0, small.length(), small, 0);
+    r = queue_transaction(store, chb, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // as PG::merge_from() does it: no object in the transaction at all
+  {
+    ObjectStore::Transaction t;
+    t.merge_collection(b, a, 0);
+    t.collection_set_bits(a, 0);
+    r = queue_transaction(store, cha, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.collection_set_bits(a, 0);
+    r = queue_transaction(store, cha, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    vector<ghobject_t> got;
+    r = store->collection_list(cha, ghobject_t(), ghobject_t::get_max(),
+			       INT_MAX, &got, 0);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(set<ghobject_t>(got.begin(), got.end()),
+	      set<ghobject_t>({ao, bo}));
+    struct stat st;
+    ASSERT_EQ(store->stat(cha, ao, &st, false), 0);
+    ASSERT_EQ(store->stat(cha, bo, &st, false), 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(a, ao);
+    t.remove(a, bo);
+    t.remove_collection(a);
+    r = queue_transaction(store, cha, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 /**
  * This test tests adding two different groups
  * of objects, each with 1 common prefix and 1
@@ -6408,6 +6764,56 @@ TEST_P(StoreTestSpecificAUSize, OnodeSizeTracking) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, DeferredWriteAggregation) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "1000");
+  SetVal(g_conf(), "bluestore_max_defer_interval", "1000");
+  SetVal(g_conf(), "bluestore_deferred_aggregate", "true");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(block_size);
+
+  int r;
+  const unsigned num_colls = 8;
+  const PerfCounters* logger = store->get_perf_counters();
+
+  // every collection has its own sequencer; their small deferred writes
+  // stay queued until umount submits them at once
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(0, i), shard_id_t::NO_SHARD));
+    ghobject_t hoid(hobject_t("test_deferred", "", CEPH_NOSNAP, 0, i, ""));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(std::string(block_size, 'a' + i));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(0, store->umount());
+
+  ASSERT_GE(logger->get(l_bluestore_deferred_merge_osrs), 2u);
+  ASSERT_LE(logger->get(l_bluestore_deferred_write_ops),
+	    logger->get(l_bluestore_deferred_merge_in_ops));
+
+  ASSERT_EQ(0, store->mount());
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(0, i), shard_id_t::NO_SHARD));
+    ghobject_t hoid(hobject_t("test_deferred", "", CEPH_NOSNAP, 0, i, ""));
+    auto ch = store->open_collection(cid);
+    bufferlist bl, expected;
+    expected.append(std::string(block_size, 'a' + i));
+    r = store->read(ch, hoid, 0, block_size, bl);
+    ASSERT_EQ(r, (int)block_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwrite) {
 
   if (string(GetParam()) != "bluestore")
@@ -7462,6 +7868,383 @@ TEST_P(StoreTestSpecificAUSize, BluestoreRepairTest) {
 
 }
 
+TEST_P(StoreTestSpecificAUSize, BluestoreParallelFsckTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_fsck_error_on_no_per_pool_stats", "false");
+  SetVal(g_conf(), "bluestore_fsck_threads", "4");
+
+  StartDeferred(0x10000);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+
+  // spread objects over several collections, i.e. key ranges
+  const uint64_t pool = 555;
+  const unsigned num_colls = 8;
+  vector<coll_t> cids;
+  vector<ghobject_t> oids;
+  bufferlist bl;
+  bl.append(std::string(0x40000, 'a'));
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, pool), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 3);
+    for (unsigned j = 0; j < 4; ++j) {
+      ghobject_t oid(hobject_t(sobject_t("Object " + stringify(j), CEPH_NOSNAP),
+                               "", i, pool, ""));
+      t.write(cid, oid, 0, bl.length(), bl);
+      if (j == 0) {
+        cids.push_back(cid);
+        oids.push_back(oid);
+      }
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->fsck(true), 0);
+  EXPECT_EQ(num_colls * 4, bstore->get_fsck_progress().objects);
+  EXPECT_EQ(bstore->get_fsck_progress().ranges,
+            bstore->get_fsck_progress().ranges_done);
+  EXPECT_LT(1u, bstore->get_fsck_progress().ranges);
+
+  // an extent shared by objects from different ranges is caught, and
+  // counted the same way as with a single thread: once per extent, not
+  // once per block
+  bstore->mount();
+  bstore->inject_misreference(cids[1], oids[1], cids[6], oids[6], 0);
+  bstore->umount();
+  int parallel_errors = bstore->fsck(false);
+  ASSERT_LT(0, parallel_errors);
+  SetVal(g_conf(), "bluestore_fsck_threads", "1");
+  ASSERT_EQ(parallel_errors, bstore->fsck(false));
+  SetVal(g_conf(), "bluestore_fsck_threads", "4");
+  ASSERT_EQ(bstore->repair(false), 0);
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTest, BluestoreInlineData) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_inline_data_max", "2048");
+  g_conf().apply_changes(nullptr);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  const PerfCounters* logger = store->get_perf_counters();
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t statfs0;
+  ASSERT_EQ(store->statfs(&statfs0), 0);
+  // releases without inline data can mount us until we use it
+  ASSERT_EQ(bstore->min_compat_ondisk_format,
+            bstore->get_compat_ondisk_format());
+
+  string expected;
+  auto write = [&](uint64_t offset, const string& s) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(s);
+    t.write(cid, hoid, offset, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    if (expected.size() < offset + s.size()) {
+      expected.resize(offset + s.size(), '\0');
+    }
+    expected.replace(offset, s.size(), s);
+  };
+  auto check = [&](const ghobject_t& oid) {
+    bufferlist in, exp;
+    exp.append(expected);
+    ASSERT_EQ((int)expected.size(), store->read(ch, oid, 0, 0x10000, in));
+    ASSERT_TRUE(bl_eq(exp, in));
+  };
+
+  write(0, string(100, 'a'));
+  write(50, string(10, 'b'));
+  write(1000, string(24, 'c'));
+  check(hoid);
+  ASSERT_EQ(logger->get(l_bluestore_write_inline), 3u);
+  ASSERT_EQ(bstore->inline_data_ondisk_format,
+            bstore->get_compat_ondisk_format());
+  {
+    map<uint64_t, uint64_t> m;
+    ASSERT_EQ(store->fiemap(ch, hoid, 0, 0x10000, m), 0);
+    ASSERT_EQ(m.size(), 1u);
+    ASSERT_EQ(m.begin()->second, 1024u);
+  }
+  {
+    // nothing allocated for the data
+    struct store_statfs_t statfs;
+    ASSERT_EQ(store->statfs(&statfs), 0);
+    ASSERT_EQ(statfs.allocated, statfs0.allocated);
+    ASSERT_EQ(statfs.data_stored, statfs0.data_stored + 1024);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.zero(cid, hoid, 10, 20);
+    t.clone(cid, hoid, hoid2);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    expected.replace(10, 20, string(20, '\0'));
+  }
+  check(hoid);
+  check(hoid2);
+
+  // survives a restart and passes fsck
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+  ch = store->open_collection(cid);
+  check(hoid);
+  ASSERT_EQ(bstore->inline_data_ondisk_format,
+            bstore->get_compat_ondisk_format());
+
+  // growing past the threshold moves the data out to a blob
+  write(4000, string(100, 'd'));
+  check(hoid);
+  ASSERT_EQ(logger->get(l_bluestore_write_inline_moved), 1u);
+  {
+    struct store_statfs_t statfs;
+    ASSERT_EQ(store->statfs(&statfs), 0);
+    ASSERT_GT(statfs.allocated, statfs0.allocated);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  {
+    struct store_statfs_t statfs;
+    ASSERT_EQ(store->statfs(&statfs), 0);
+    ASSERT_EQ(statfs.allocated, statfs0.allocated);
+    ASSERT_EQ(statfs.data_stored, statfs0.data_stored);
+  }
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTest, BluestorePackedExtentMap) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto write = [&](uint64_t offset) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(string(0x1000, 'a' + offset / 0x2000 % 26));
+    t.write(cid, hoid, offset, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    bufferlist in;
+    ASSERT_EQ(0x1000, store->read(ch, hoid, offset, 0x1000, in));
+    ASSERT_TRUE(bl_eq(bl, in));
+  };
+
+  // shards in the old encoding don't raise the compat version
+  write(0);
+  ASSERT_EQ(bstore->min_compat_ondisk_format,
+            bstore->get_compat_ondisk_format());
+
+  SetVal(g_conf(), "bluestore_extent_map_packed_encoding", "true");
+  g_conf().apply_changes(nullptr);
+  ASSERT_EQ(bstore->packed_extent_map_ondisk_format,
+            bstore->get_compat_ondisk_format());
+  for (uint64_t offset = 0x2000; offset < 0x40000; offset += 0x2000) {
+    write(offset);
+  }
+
+  // the raised compat version is persisted
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+  ch = store->open_collection(cid);
+  ASSERT_EQ(bstore->packed_extent_map_ondisk_format,
+            bstore->get_compat_ondisk_format());
+  for (uint64_t offset = 0; offset < 0x40000; offset += 0x2000) {
+    bufferlist in;
+    ASSERT_EQ(0x1000, store->read(ch, hoid, offset, 0x1000, in));
+    ASSERT_EQ(in[0], 'a' + offset / 0x2000 % 26);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+}
+
+TEST_P(StoreTest, BluestoreBulkRemoveCollection) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_bulk_remove_collection", "true");
+  SetVal(g_conf(), "bluestore_bulk_remove_batch_objects", "3");
+  SetVal(g_conf(), "bluestore_bulk_remove_paused", "true");
+  g_conf().apply_changes(nullptr);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  ASSERT_TRUE(store->can_bulk_remove_collection());
+
+  struct store_statfs_t statfs0;
+  ASSERT_EQ(store->statfs(&statfs0), 0);
+
+  const uint64_t pool = 777;
+  coll_t cid(spg_t(pg_t(0, pool), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(std::string(0x10000, 'a'));
+    map<string, bufferlist> omap;
+    omap["key"].append("value");
+    for (unsigned i = 0; i < 10; ++i) {
+      ghobject_t oid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP),
+                               "", i, pool, ""));
+      t.write(cid, oid, 0, bl.length(), bl);
+      t.omap_setkeys(cid, oid, omap);
+    }
+    // a clone shares its blobs with the head
+    ghobject_t head(hobject_t(sobject_t("Object 0", CEPH_NOSNAP),
+                              "", 0, pool, ""));
+    ghobject_t clone(hobject_t(sobject_t("Object 0", 1), "", 0, pool, ""));
+    t.clone(cid, head, clone);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove_collection(cid);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  ASSERT_FALSE(store->collection_exists(cid));
+
+  // the removal is paused, yet the objects still pass fsck
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+  const PerfCounters* logger = store->get_perf_counters();
+  ASSERT_EQ(logger->get(l_bluestore_bulk_remove_colls), 1u);
+
+  // neither reusing the name nor a collection overlapping the removed one
+  // wait for the removal, which is still paused, and they don't see what
+  // it left behind
+  coll_t cid2(spg_t(pg_t(1, pool), shard_id_t::NO_SHARD));
+  ch = store->create_new_collection(cid);
+  auto ch2 = store->create_new_collection(cid2);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 1);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid2, 1);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_bulk_remove_colls), 1u);
+  for (auto c : {ch, ch2}) {
+    vector<ghobject_t> objects;
+    int r = store->collection_list(c, ghobject_t(), ghobject_t::get_max(),
+                                   INT_MAX, &objects, nullptr);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(objects.empty());
+  }
+  ghobject_t reused(hobject_t(sobject_t("Object 3", CEPH_NOSNAP),
+                              "", 3, pool, ""));
+  ghobject_t gone(hobject_t(sobject_t("Object 5", CEPH_NOSNAP),
+                            "", 5, pool, ""));
+  bufferlist data;
+  data.append("new");
+  {
+    ObjectStore::Transaction t;
+    t.write(cid2, reused, 0, data.length(), data);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    struct stat st;
+    ASSERT_EQ(store->stat(ch2, gone, &st), -ENOENT);
+    bufferlist bl;
+    ASSERT_EQ(store->read(ch2, reused, 0, 0x10000, bl), (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+    map<string, bufferlist> omap;
+    ASSERT_EQ(store->omap_get_values(ch2, reused, {"key"}, &omap), 0);
+    ASSERT_TRUE(omap.empty());
+  }
+
+  // the objects the new collections write stay put
+  SetVal(g_conf(), "bluestore_bulk_remove_paused", "false");
+  g_conf().apply_changes(nullptr);
+  for (int i = 0; i < 100 && logger->get(l_bluestore_bulk_remove_colls); ++i) {
+    usleep(100000);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_bulk_remove_colls), 0u);
+  ASSERT_EQ(logger->get(l_bluestore_bulk_remove_objects), 0u);
+  // the one the write replaced was reclaimed by that write
+  ASSERT_EQ(logger->get(l_bluestore_bulk_removed_objects), 10u);
+  {
+    vector<ghobject_t> objects;
+    int r = store->collection_list(ch2, ghobject_t(), ghobject_t::get_max(),
+                                   INT_MAX, &objects, nullptr);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(objects, vector<ghobject_t>{reused});
+    bufferlist bl;
+    ASSERT_EQ(store->read(ch2, reused, 0, 0x10000, bl), (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid2, reused);
+    int r = queue_transaction(store, ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  struct store_statfs_t statfs1;
+  ASSERT_EQ(store->statfs(&statfs1), 0);
+  ASSERT_EQ(statfs0.allocated, statfs1.allocated);
+  ASSERT_EQ(statfs0.data_stored, statfs1.data_stored);
+
+  for (auto c : {cid, cid2}) {
+    ObjectStore::Transaction t;
+    t.remove_collection(c);
+    int r = queue_transaction(store, c == cid ? ch : ch2, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  ch2.reset();
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+}
+
 TEST_P(StoreTest, BluestoreRepairGlobalStats)
 {
   if (string(GetParam()) != "bluestore")
@@ -7913,6 +8696,158 @@ TEST_P(StoreTestSpecificAUSize, BluestoreEnforceHWSettingsSsd) {
   }
 }
   
+TEST_P(StoreTestSpecificAUSize, BluestoreTierPlacement) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_block_db_create", "true");
+  SetVal(g_conf(), "bluestore_block_db_size", "4294967296");
+  SetVal(g_conf(), "bluestore_inline_data_max", "4096");
+  SetVal(g_conf(), "bluestore_tier_promote_heat", "3");
+  // no room on the DB device to begin with
+  SetVal(g_conf(), "bluestore_tier_db_min_free_ratio", "1");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  string expected(2000, 'a');
+  auto write = [&](uint64_t offset, const string& s) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(s);
+    t.write(cid, hoid, offset, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    expected.replace(offset, s.size(), s);
+  };
+  auto check = [&]() {
+    bufferlist in, exp;
+    exp.append(expected);
+    ASSERT_EQ((int)expected.size(), store->read(ch, hoid, 0, 0, in));
+    ASSERT_TRUE(bl_eq(exp, in));
+  };
+
+  write(0, expected);
+  ASSERT_EQ(logger->get(l_bluestore_write_inline), 0u);
+  for (int i = 0; i < 3; ++i) {
+    check();
+  }
+  ASSERT_EQ(logger->get(l_bluestore_tier_slow_reads), 3u);
+
+  // hot, and now there is room: the next write moves it inline
+  SetVal(g_conf(), "bluestore_tier_db_min_free_ratio", "0");
+  g_conf().apply_changes(nullptr);
+  write(10, "bbbb");
+  ASSERT_EQ(logger->get(l_bluestore_tier_promoted), 1u);
+  check();
+  ASSERT_EQ(logger->get(l_bluestore_tier_fast_reads), 1u);
+
+  // still hot: it stays even though room runs out
+  SetVal(g_conf(), "bluestore_tier_db_min_free_ratio", "1");
+  g_conf().apply_changes(nullptr);
+  write(20, "cccc");
+  ASSERT_EQ(logger->get(l_bluestore_tier_demoted), 0u);
+
+  // too cold for the new threshold: the next write moves it out
+  SetVal(g_conf(), "bluestore_tier_promote_heat", "100");
+  g_conf().apply_changes(nullptr);
+  write(30, "dddd");
+  ASSERT_EQ(logger->get(l_bluestore_tier_demoted), 1u);
+  check();
+  ASSERT_EQ(logger->get(l_bluestore_tier_slow_reads), 4u);
+  ch.reset();
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTestSpecificAUSize, BluestoreTierDemotion) {
+  if(string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_block_db_create", "true");
+  SetVal(g_conf(), "bluestore_block_db_size", "4294967296");
+  SetVal(g_conf(), "bluestore_inline_data_max", "4096");
+  SetVal(g_conf(), "bluestore_tier_promote_heat", "3");
+  SetVal(g_conf(), "bluestore_tier_db_min_free_ratio", "0");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  const unsigned num = 8;
+  auto oid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  };
+  auto data = [](unsigned i) {
+    bufferlist bl;
+    bl.append(string(2000, 'a' + i));
+    return bl;
+  };
+  for (unsigned i = 0; i < num; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl = data(i);
+    t.write(cid, oid(i), 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_write_inline), num);
+  // object 0 is hot
+  for (int i = 0; i < 3; ++i) {
+    bufferlist in;
+    ASSERT_EQ(2000, store->read(ch, oid(0), 0, 0, in));
+  }
+  struct store_statfs_t statfs0;
+  ASSERT_EQ(store->statfs(&statfs0), 0);
+
+  // running short of room moves the cold objects out without a write
+  SetVal(g_conf(), "bluestore_tier_db_min_free_ratio", "1");
+  g_conf().apply_changes(nullptr);
+  for (int i = 0; i < 100 && logger->get(l_bluestore_tier_demoted) < num - 1;
+       ++i) {
+    usleep(100000);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_tier_demoted), num - 1);
+  {
+    struct store_statfs_t statfs;
+    ASSERT_EQ(store->statfs(&statfs), 0);
+    ASSERT_EQ(statfs.allocated, statfs0.allocated + (num - 1) * 4096);
+    ASSERT_EQ(statfs.data_stored, statfs0.data_stored);
+  }
+  for (unsigned i = 0; i < num; ++i) {
+    bufferlist in, exp = data(i);
+    ASSERT_EQ(2000, store->read(ch, oid(i), 0, 0, in));
+    ASSERT_TRUE(bl_eq(exp, in));
+  }
+  ASSERT_EQ(logger->get(l_bluestore_tier_fast_reads), 4u);
+  ASSERT_EQ(logger->get(l_bluestore_tier_slow_reads), num - 1);
+  ch.reset();
+
+  BlueStore* bstore = NULL;
+  EXPECT_NO_THROW(bstore = dynamic_cast<BlueStore*> (store.get()));
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
 TEST_P(StoreTestSpecificAUSize, ReproNoBlobMultiTest) {
 
   if(string(GetParam()) != "bluestore")
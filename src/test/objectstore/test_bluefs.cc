@@ -586,6 +586,55 @@ TEST(BlueFS, test_compaction_async) {
   fs.umount();
 }
 
+TEST(BlueFS, test_compaction_async_online) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf.set_val(
+    "bluefs_compact_log_sync",
+    "false");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  const string dir = "dir.online";
+  const unsigned num_files = 200;
+  ASSERT_EQ(0, fs.mkdir(dir));
+  {
+    // keep appending to the log while it is being compacted over and over
+    std::atomic<bool> done = false;
+    std::thread compactor([&fs, &done] {
+      while (!done) {
+        fs.compact_log();
+      }
+    });
+    for (unsigned i = 0; i < num_files; ++i) {
+      BlueFS::FileWriter *h;
+      ASSERT_EQ(0, fs.open_for_write(dir, stringify(i), &h, false));
+      std::unique_ptr<char[]> buf = gen_buffer(4096 * (i % 4 + 1));
+      h->append(buf.get(), 4096 * (i % 4 + 1));
+      ASSERT_EQ(0, fs.fsync(h));
+      fs.close_writer(h);
+    }
+    done = true;
+    compactor.join();
+  }
+  fs.umount();
+  ASSERT_EQ(0, fs.mount());
+  for (unsigned i = 0; i < num_files; ++i) {
+    uint64_t file_size = 0;
+    utime_t mtime;
+    ASSERT_EQ(0, fs.stat(dir, stringify(i), &file_size, &mtime));
+    ASSERT_EQ(4096u * (i % 4 + 1), file_size);
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   TempBdev bdev{size};
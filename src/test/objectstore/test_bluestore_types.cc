@@ -1042,6 +1042,42 @@ TEST(Blob, legacy_decode)
   }
 }
 
+TEST(BufferCacheShard, arc)
+{
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "arc", NULL);
+  BlueStore::BufferSpace bs;
+  bc->set_max(0x3000);
+  auto read = [&](uint32_t offset) {
+    bufferlist bl;
+    bl.append(string(0x1000, 'a'));
+    bs.did_read(bc, offset, bl);
+  };
+  for (uint32_t offset = 0; offset < 0x4000; offset += 0x1000) {
+    read(offset);
+  }
+  ASSERT_EQ(0x3000u, bc->_get_bytes());
+  ASSERT_TRUE(bs.buffer_map[0]->is_empty());
+
+  // missing a ghost promotes the buffer to the frequent list
+  read(0);
+  ASSERT_EQ(0x3000u, bc->_get_bytes());
+  ASSERT_TRUE(bs.buffer_map[0]->is_clean());
+  ASSERT_TRUE(bs.buffer_map[0x1000]->is_empty());
+
+  // a scan doesn't flush it
+  for (uint32_t offset = 0x10000; offset < 0x20000; offset += 0x1000) {
+    read(offset);
+  }
+  ASSERT_EQ(0x3000u, bc->_get_bytes());
+  ASSERT_TRUE(bs.buffer_map[0]->is_clean());
+
+  bc->flush();
+  ASSERT_EQ(0u, bc->_get_bytes());
+  ASSERT_TRUE(bs.buffer_map.empty());
+  delete bc;
+}
+
 TEST(ExtentMap, seek_lextent)
 {
   BlueStore store(g_ceph_context, "", 4096);
@@ -1202,6 +1238,80 @@ TEST(ExtentMap, compress_extent_map)
   ASSERT_EQ(6u, em.extent_map.size());
 }
 
+TEST(ExtentMap, encode_decode_bench)
+{
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+    g_ceph_context, "lru", NULL);
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "lru", NULL);
+
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+  BlueStore::Onode onode(coll.get(), ghobject_t(), "");
+  BlueStore::ExtentMap em(&onode);
+  const unsigned num_blobs = 256;
+  for (unsigned i = 0; i < num_blobs; ++i) {
+    BlueStore::BlobRef b(new BlueStore::Blob);
+    b->shared_blob = new BlueStore::SharedBlob(coll.get());
+    b->dirty_blob().allocated_test(
+      bluestore_pextent_t(0x1000000 + i * 0x40000, 0x10000));
+    em.extent_map.insert(*new BlueStore::Extent(i * 0x20000, 0, 0x8000, b));
+    em.extent_map.insert(
+      *new BlueStore::Extent(i * 0x20000 + 0x9000, 0x9000, 0x1000 * (i % 7 + 1),
+			     b));
+  }
+
+  for (bool packed : {false, true}) {
+    g_ceph_context->_conf.set_val_or_die(
+      "bluestore_extent_map_packed_encoding", packed ? "true" : "false");
+    g_ceph_context->_conf.apply_changes(nullptr);
+
+    bufferlist bl;
+    unsigned n = 0;
+    int count = 1000;
+    ceph::mono_clock::time_point start = ceph::mono_clock::now();
+    for (int i = 0; i < count; ++i) {
+      bl.clear();
+      ASSERT_FALSE(em.encode_some(0, num_blobs * 0x20000, bl, &n));
+    }
+    auto enc = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      ceph::mono_clock::now() - start);
+    ASSERT_EQ(em.extent_map.size(), n);
+    bl.rebuild();
+
+    BlueStore::ExtentMap em2(&onode);
+    start = ceph::mono_clock::now();
+    for (int i = 0; i < count; ++i) {
+      em2.clear();
+      ASSERT_EQ(n, em2.decode_some(bl));
+    }
+    auto dec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      ceph::mono_clock::now() - start);
+
+    ASSERT_EQ(em.extent_map.size(), em2.extent_map.size());
+    auto p = em.extent_map.begin();
+    auto q = em2.extent_map.begin();
+    for (; p != em.extent_map.end(); ++p, ++q) {
+      ASSERT_EQ(p->logical_offset, q->logical_offset);
+      ASSERT_EQ(p->blob_offset, q->blob_offset);
+      ASSERT_EQ(p->length, q->length);
+      ASSERT_EQ(p->blob->get_blob().get_extents(),
+		q->blob->get_blob().get_extents());
+    }
+    // extents of the same blob share the decoded blob
+    ASSERT_EQ(em2.extent_map.begin()->blob,
+	      std::next(em2.extent_map.begin())->blob);
+
+    cout << (packed ? "packed" : "varint") << " encoding: "
+	 << bl.length() << " bytes for " << n << " extents, encode "
+	 << (double)enc.count() / count / n << " ns/extent, decode "
+	 << (double)dec.count() / count / n << " ns/extent" << std::endl;
+  }
+  g_ceph_context->_conf.set_val_or_die(
+    "bluestore_extent_map_packed_encoding", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 TEST(GarbageCollector, BasicTest)
 {
   BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
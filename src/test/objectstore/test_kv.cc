@@ -16,6 +16,8 @@
 #include <string.h>
 #include <iostream>
 #include <time.h>
+#include <chrono>
+#include <thread>
 #include <sys/mount.h>
 #include "kv/KeyValueDB.h"
 #include "include/Context.h"
@@ -309,6 +311,64 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, ConcurrentReadWrite) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  // every value is its key, so readers can tell a torn or misplaced one
+  auto write = [&](int round) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; ++i) {
+      string k = stringify(round * 37 + i * 101 % 1000);
+      if (i % 4 == 0) {
+	t->rmkey("prefix", k);
+      } else {
+	bufferlist v;
+	v.append(k);
+	t->set("prefix", k, v);
+      }
+    }
+    db->submit_transaction(t);
+  };
+  write(0);
+
+  std::atomic<bool> stop = {false};
+  std::atomic<unsigned> errors = {0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      while (!stop) {
+	if (r % 2) {
+	  KeyValueDB::Iterator it = db->get_iterator("prefix");
+	  string last;
+	  for (it->seek_to_first(); it->valid(); it->next()) {
+	    if ((!last.empty() && it->key() <= last) ||
+		_bl_to_str(it->value()) != it->key()) {
+	      ++errors;
+	    }
+	    last = it->key();
+	  }
+	} else {
+	  for (int i = 0; i < 1000; i += 7) {
+	    bufferlist v;
+	    if (db->get("prefix", stringify(i), &v) == 0 &&
+		_bl_to_str(v) != stringify(i)) {
+	      ++errors;
+	    }
+	  }
+	}
+      }
+    });
+  }
+  for (int round = 1; round < 200; ++round) {
+    write(round);
+  }
+  stop = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0u, errors.load());
+  fini();
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -530,6 +590,183 @@ TEST_P(KVTest, RocksDB_estimate_size_column_family) {
   fini();
 }
 
+TEST_P(KVTest, MultiGetLatency) {
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const int num_keys = 4096;
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string(100, 'v'));
+    for (int i = 0; i < num_keys; i++) {
+      char k[16];
+      snprintf(k, sizeof(k), "%08d", i);
+      t->set("prefix", k, v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  db->compact();
+  for (unsigned n : {1, 16, 256}) {
+    std::set<string> keys;
+    for (unsigned i = 0; i < n; i++) {
+      char k[16];
+      snprintf(k, sizeof(k), "%08d", (int)(i * (num_keys / n)));
+      keys.insert(k);
+    }
+    // one missing key
+    keys.insert("zzz");
+    const int reps = 100;
+    std::map<string, bufferlist> one_by_one, batched;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) {
+      one_by_one.clear();
+      for (auto& k : keys) {
+	bufferlist v;
+	if (db->get("prefix", k, &v) == 0) {
+	  one_by_one[k] = v;
+	}
+      }
+    }
+    auto single_lat = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) {
+      batched.clear();
+      ASSERT_EQ(0, db->get("prefix", keys, &batched));
+    }
+    auto batched_lat = std::chrono::steady_clock::now() - start;
+    cout << n << " keys: "
+	 << std::chrono::duration_cast<std::chrono::microseconds>(
+	      single_lat).count() / reps << " us one by one, "
+	 << std::chrono::duration_cast<std::chrono::microseconds>(
+	      batched_lat).count() / reps << " us batched" << std::endl;
+    ASSERT_EQ(n, batched.size());
+    ASSERT_EQ(one_by_one.size(), batched.size());
+    for (auto& [k, v] : one_by_one) {
+      ASSERT_TRUE(batched.count(k));
+      ASSERT_EQ(_bl_to_str(v), _bl_to_str(batched[k]));
+    }
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBShardedColumnFamily) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("O(4)", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("O-1", "write_buffer_size=1048576"));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  cout << "creating a prefix sharded over four column families" << std::endl;
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; i++) {
+      bufferlist v;
+      v.append(stringify(i));
+      char k[8];
+      snprintf(k, sizeof(k), "%03d", i);
+      t->set("O", k, v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->open(cout));
+  {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("O", "042", &v));
+    ASSERT_EQ("42", _bl_to_str(v));
+  }
+  {
+    cout << "iterating the shards as one" << std::endl;
+    KeyValueDB::Iterator iter = db->get_iterator("O");
+    int n = 0;
+    for (iter->seek_to_first(); iter->valid(); iter->next(), n++) {
+      ASSERT_EQ(stringify(n), _bl_to_str(iter->value()));
+    }
+    ASSERT_EQ(100, n);
+    for (iter->seek_to_last(); iter->valid(); iter->prev()) {
+      ASSERT_EQ(stringify(--n), _bl_to_str(iter->value()));
+    }
+    ASSERT_EQ(0, n);
+    iter->upper_bound("050");
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ("051", iter->key());
+    // change direction back and forth
+    iter->prev();
+    ASSERT_EQ("050", iter->key());
+    iter->prev();
+    ASSERT_EQ("049", iter->key());
+    iter->next();
+    ASSERT_EQ("050", iter->key());
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("O");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    KeyValueDB::Iterator iter = db->get_iterator("O");
+    iter->seek_to_first();
+    ASSERT_FALSE(iter->valid());
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBReshard) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (int i = 0; i < 100; i++) {
+      bufferlist v;
+      v.append(stringify(i));
+      t->set("O", stringify(i), v);
+      t->set("M", stringify(i), v);
+      t->set("X", stringify(i), v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  auto check = [this]() {
+    for (auto prefix : {"O", "M", "X"}) {
+      KeyValueDB::Iterator iter = db->get_iterator(prefix);
+      int n = 0;
+      for (iter->seek_to_first(); iter->valid(); iter->next(), n++) {
+	ASSERT_EQ(iter->key(), _bl_to_str(iter->value()));
+      }
+      ASSERT_EQ(100, n);
+      bufferlist v;
+      ASSERT_EQ(0, db->get(prefix, "42", &v));
+      ASSERT_EQ("42", _bl_to_str(v));
+    }
+  };
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("O(3)", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("M", ""));
+  cout << "resharding O and M out of the default column family" << std::endl;
+  ASSERT_EQ(0, db->reshard(cfs, cout));
+  check();
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->open(cout));
+  check();
+  cfs.clear();
+  cfs.push_back(KeyValueDB::ColumnFamily("O(2,0-1)", ""));
+  cout << "resharding O again and M back" << std::endl;
+  ASSERT_EQ(0, db->reshard(cfs, cout));
+  check();
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->open(cout));
+  check();
+  fini();
+}
+
 INSTANTIATE_TEST_SUITE_P(
   KeyValueDB,
   KVTest,
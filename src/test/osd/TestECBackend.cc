@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <signal.h>
 #include "osd/ECBackend.h"
+#include "erasure-code/jerasure/ErasureCodeJerasure.h"
 #include "gtest/gtest.h"
 
 TEST(ECUtil, stripe_info_t)
@@ -58,3 +59,201 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ECUtil, parity_delta)
+{
+  auto jerasure = new ErasureCodeJerasureReedSolomonVandermonde();
+  ErasureCodeInterfaceRef ec_impl(jerasure);
+  ErasureCodeProfile profile;
+  profile["plugin"] = "jerasure";
+  profile["technique"] = "reed_sol_van";
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ASSERT_EQ(0, jerasure->init(profile, &cerr));
+  ASSERT_TRUE(ECUtil::supports_parity_delta(ec_impl));
+
+  const uint64_t swidth = 4 * ec_impl->get_chunk_size(16384);
+  ECUtil::stripe_info_t sinfo(4, swidth);
+  const uint64_t csize = sinfo.get_chunk_size();
+  set<int> want;
+  for (int i = 0; i < 6; ++i) {
+    want.insert(i);
+  }
+
+  bufferlist old_stripe;
+  for (uint64_t i = 0; i < swidth; ++i) {
+    old_stripe.append(char(i * 7 + 3));
+  }
+  bufferlist new_stripe;
+  new_stripe.substr_of(old_stripe, 0, csize);
+  for (uint64_t i = csize; i < 2 * csize; ++i) {
+    new_stripe.append(char(i * 13 + 5));
+  }
+  bufferlist tail;
+  tail.substr_of(old_stripe, 2 * csize, 2 * csize);
+  new_stripe.append(tail);
+
+  map<int, bufferlist> old_chunks, new_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, old_stripe, want, &old_chunks));
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, new_stripe, want, &new_chunks));
+
+  // only data chunk 1 changed
+  map<int, bufferlist> data_delta;
+  data_delta[1] = old_chunks[1];
+  ECUtil::xor_into(data_delta[1], new_chunks[1]);
+
+  map<int, bufferlist> parity_delta;
+  ASSERT_EQ(0, ECUtil::encode_parity_delta(
+	      sinfo, ec_impl, data_delta, &parity_delta));
+  ASSERT_EQ(2u, parity_delta.size());
+  for (int i = 4; i < 6; ++i) {
+    bufferlist parity = old_chunks[i];
+    ECUtil::xor_into(parity, parity_delta[i]);
+    ASSERT_TRUE(parity.contents_equal(new_chunks[i]));
+    ASSERT_FALSE(parity.contents_equal(old_chunks[i]));
+  }
+
+  // an xor with itself is all zeroes, and nothing changes the parity
+  bufferlist zero = old_chunks[2];
+  ECUtil::xor_into(zero, old_chunks[2]);
+  ASSERT_TRUE(zero.is_zero());
+  data_delta.clear();
+  data_delta[2] = zero;
+  parity_delta.clear();
+  ASSERT_EQ(0, ECUtil::encode_parity_delta(
+	      sinfo, ec_impl, data_delta, &parity_delta));
+  ASSERT_TRUE(parity_delta[4].is_zero());
+  ASSERT_TRUE(parity_delta[5].is_zero());
+}
+
+struct mydpp : public DoutPrefixProvider {
+  std::ostream& gen_prefix(std::ostream& out) const override { return out << "foo"; }
+  CephContext *get_cct() const override { return g_ceph_context; }
+  unsigned get_subsys() const override { return ceph_subsys_osd; }
+} dpp;
+
+TEST(ECTransaction, generate_parity_delta)
+{
+  auto jerasure = new ErasureCodeJerasureReedSolomonVandermonde();
+  ErasureCodeInterfaceRef ec_impl(jerasure);
+  ErasureCodeProfile profile;
+  profile["plugin"] = "jerasure";
+  profile["technique"] = "reed_sol_van";
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ASSERT_EQ(0, jerasure->init(profile, &cerr));
+
+  const uint64_t swidth = 4 * ec_impl->get_chunk_size(16384);
+  ECUtil::stripe_info_t sinfo(4, swidth);
+  const uint64_t csize = sinfo.get_chunk_size();
+  set<int> want;
+  for (int i = 0; i < 6; ++i) {
+    want.insert(i);
+  }
+
+  // a two stripe object, overwritten within data chunk 1 of stripe 1
+  hobject_t h;
+  ECUtil::HashInfoRef hinfo(new ECUtil::HashInfo(6));
+  hinfo->set_total_chunk_size_clear_hash(2 * csize);
+  hinfo->set_projected_total_logical_size(sinfo, 2 * swidth);
+  bufferlist old_stripe;
+  for (uint64_t i = 0; i < swidth; ++i) {
+    old_stripe.append(char(i * 7 + 3));
+  }
+  bufferlist data;
+  for (uint64_t i = 0; i < 200; ++i) {
+    data.append(char(i * 13 + 5));
+  }
+  const uint64_t off = csize + 100;
+
+  PGTransactionUPtr t(new PGTransaction);
+  t->write(h, swidth + off, data.length(), data, 0);
+  t->obc_map[h] = ObjectContextRef(new ObjectContext);
+  auto plan = ECTransaction::get_write_plan(
+    sinfo, std::move(t),
+    [&](const hobject_t &) { return hinfo; },
+    &dpp, 2);
+  ASSERT_EQ(1u, plan.parity_delta.size());
+  ASSERT_EQ(swidth, plan.parity_delta[h].stripe_off);
+  ASSERT_EQ(set<int>({1}), plan.parity_delta[h].data_chunks);
+
+  // what ECBackend reads: the touched data chunk and the coding chunks
+  map<int, bufferlist> old_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, old_stripe, want, &old_chunks));
+  map<hobject_t, map<int, bufferlist>> parity_delta_chunks;
+  for (int i : {1, 4, 5}) {
+    parity_delta_chunks[h][i] = old_chunks[i];
+  }
+
+  vector<pg_log_entry_t> entries;
+  entries.push_back(pg_log_entry_t(pg_log_entry_t::MODIFY, h,
+				   eversion_t(1, 2), eversion_t(1, 1),
+				   0, osd_reqid_t(), utime_t(), 0));
+  map<hobject_t, extent_map> written;
+  map<shard_id_t, ObjectStore::Transaction> transactions;
+  for (int i = 0; i < 6; ++i) {
+    transactions[shard_id_t(i)];
+  }
+  set<hobject_t> temp_added, temp_removed;
+  ECTransaction::generate_transactions(
+    plan, ec_impl, pg_t(1, 0), sinfo, map<hobject_t, extent_map>(),
+    parity_delta_chunks, entries, &written, &transactions,
+    &temp_added, &temp_removed, &dpp);
+
+  bufferlist new_stripe;
+  {
+    bufferlist head, tail;
+    head.substr_of(old_stripe, 0, off);
+    tail.substr_of(old_stripe, off + data.length(),
+		   swidth - off - data.length());
+    new_stripe.append(head);
+    new_stripe.append(data);
+    new_stripe.append(tail);
+  }
+  map<int, bufferlist> new_chunks;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, new_stripe, want, &new_chunks));
+
+  for (auto &&[shard, st] : transactions) {
+    map<uint64_t, bufferlist> writes;
+    unsigned rollback_clones = 0;
+    for (auto i = st.begin(); i.have_op(); ) {
+      auto op = i.decode_op();
+      switch (op->op) {
+      case ObjectStore::Transaction::OP_WRITE:
+	{
+	  ASSERT_TRUE(i.get_oid(op->oid).is_no_gen());
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	  writes[op->off] = bl;
+	}
+	break;
+      case ObjectStore::Transaction::OP_CLONERANGE2:
+	ASSERT_TRUE(i.get_oid(op->oid).is_no_gen());
+	ASSERT_EQ(2u, i.get_oid(op->dest_oid).generation);
+	ASSERT_EQ(csize, op->off);
+	ASSERT_EQ(csize, op->len);
+	ASSERT_EQ(csize, op->dest_off);
+	++rollback_clones;
+	break;
+      case ObjectStore::Transaction::OP_SETATTR:
+	{
+	  i.decode_string();
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	}
+	break;
+      }
+    }
+    // every shard stashes its chunk for rollback...
+    ASSERT_EQ(1u, rollback_clones);
+    // ...but only the touched data chunk and the coding chunks get
+    // written, with what a full re-encode of the stripe would give
+    if (shard == 1 || shard >= 4) {
+      ASSERT_EQ(1u, writes.size());
+      ASSERT_EQ(csize, writes.begin()->first);
+      ASSERT_TRUE(writes.begin()->second.contents_equal(new_chunks[shard]));
+    } else {
+      ASSERT_TRUE(writes.empty());
+    }
+  }
+}
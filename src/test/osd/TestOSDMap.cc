@@ -1397,6 +1397,126 @@ TEST_F(OSDMapTest, BUG_40104) {
   }
 }
 
+TEST_F(OSDMapTest, SharedEpochMemory) {
+  // a cluster of some size, with a fair amount of pg_temp and upmap state
+  int num_osds = 1000;
+  int pg_num = 4096;
+  set_up_map(num_osds, true);
+  int pool_id;
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.new_pool_max = osdmap.get_pool_max();
+    pool_id = ++pending_inc.new_pool_max;
+    pg_pool_t empty;
+    auto p = pending_inc.get_new_pool(pool_id, &empty);
+    p->size = 3;
+    p->min_size = 1;
+    p->set_pg_num(pg_num);
+    p->set_pgp_num(pg_num);
+    p->type = pg_pool_t::TYPE_REPLICATED;
+    p->crush_rule = 0;
+    p->set_flag(pg_pool_t::FLAG_HASHPSPOOL);
+    pending_inc.new_pool_names[pool_id] = "pool";
+    osdmap.apply_incremental(pending_inc);
+  }
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    for (int i = 0; i < pg_num; i++) {
+      pg_t pgid(i, pool_id);
+      pending_inc.new_pg_upmap_items[pgid] =
+        mempool::osdmap::vector<pair<int32_t,int32_t>>(
+          1, make_pair(i % num_osds, (i + 1) % num_osds));
+      if (i % 4 == 0) {
+        pending_inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+          {i % num_osds, (i + 2) % num_osds, (i + 3) % num_osds});
+      }
+    }
+    osdmap.apply_incremental(pending_inc);
+  }
+
+  // each epoch moves one pg_temp and touches one osd's xinfo
+  auto make_inc = [&](const OSDMap& prev, int n) {
+    OSDMap::Incremental inc(prev.get_epoch() + 1);
+    inc.fsid = prev.get_fsid();
+    inc.new_pg_temp[pg_t(4 * n, pool_id)] = mempool::osdmap::vector<int>(
+      {(n + 5) % num_osds, (n + 6) % num_osds, (n + 7) % num_osds});
+    osd_xinfo_t xi = prev.get_xinfo(n % num_osds);
+    xi.features ^= 1;
+    inc.new_xinfo[n % num_osds] = xi;
+    return inc;
+  };
+
+  const int epochs = 20;
+  bufferlist base_bl;
+  osdmap.encode(base_bl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+
+  // before: every epoch decoded from its predecessor, then deduped against
+  // it, as the OSD used to build them
+  vector<std::shared_ptr<OSDMap>> decoded;
+  size_t start = mempool::osdmap::allocated_bytes();
+  {
+    auto m = std::make_shared<OSDMap>();
+    m->decode(base_bl);
+    decoded.push_back(m);
+  }
+  size_t decoded_base = mempool::osdmap::allocated_bytes() - start;
+  for (int n = 0; n < epochs; n++) {
+    auto& prev = decoded.back();
+    bufferlist bl;
+    prev->encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    auto m = std::make_shared<OSDMap>();
+    m->decode(bl);
+    ASSERT_EQ(0, m->apply_incremental(make_inc(*prev, n)));
+    OSDMap::dedup(prev.get(), m.get());
+    decoded.push_back(m);
+  }
+  size_t decoded_bytes = mempool::osdmap::allocated_bytes() - start;
+
+  // after: every epoch starts as a copy of its predecessor
+  vector<std::shared_ptr<OSDMap>> shared;
+  start = mempool::osdmap::allocated_bytes();
+  {
+    auto m = std::make_shared<OSDMap>();
+    m->decode(base_bl);
+    shared.push_back(m);
+  }
+  size_t shared_base = mempool::osdmap::allocated_bytes() - start;
+  for (int n = 0; n < epochs; n++) {
+    auto& prev = shared.back();
+    auto m = std::make_shared<OSDMap>();
+    m->deepish_copy_from(*prev);
+    ASSERT_EQ(0, m->apply_incremental(make_inc(*prev, n)));
+    OSDMap::dedup(prev.get(), m.get());
+    shared.push_back(m);
+  }
+  size_t shared_bytes = mempool::osdmap::allocated_bytes() - start;
+
+  size_t decoded_per_epoch = (decoded_bytes - decoded_base) / epochs;
+  size_t shared_per_epoch = (shared_bytes - shared_base) / epochs;
+  std::cout << "osdmap mempool bytes per cached epoch: decoded "
+	    << decoded_per_epoch << ", shared " << shared_per_epoch
+	    << " (full map " << shared_base << ")" << std::endl;
+  ASSERT_LT(shared_per_epoch, decoded_per_epoch);
+
+  // same maps either way, and no epoch saw a later epoch's changes
+  for (int n = 0; n <= epochs; n++) {
+    bufferlist dbl, sbl;
+    decoded[n]->encode(dbl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    shared[n]->encode(sbl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    ASSERT_TRUE(dbl.contents_equal(sbl));
+  }
+  bufferlist bl;
+  shared[0]->encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  ASSERT_TRUE(bl.contents_equal(base_bl));
+
+  // writers outside apply_incremental must not reach through either
+  OSDMap cleared;
+  cleared.deepish_copy_from(*shared.back());
+  cleared.clear_temp();
+  ASSERT_EQ(0u, cleared.get_num_pg_temp());
+  ASSERT_LT(0u, shared.back()->get_num_pg_temp());
+}
+
 TEST(PGTempMap, basic)
 {
   PGTempMap m;
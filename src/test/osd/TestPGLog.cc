@@ -2451,9 +2451,10 @@ public:
   }
 
   void check_index() {
-    EXPECT_EQ(log.dups.size(), log.dup_index.size());
     for (auto& i : log.dups) {
-      EXPECT_EQ(1u, log.dup_index.count(i.reqid));
+      pg_log_dup_t found;
+      EXPECT_TRUE(log.dups.find(i.reqid, &found));
+      EXPECT_EQ(i, found);
     }
   }
 
@@ -2827,7 +2828,7 @@ TEST_F(PGLogTrimTest, TestTrimAll)
 {
   SetUp(20);
   PGLog::IndexedLog log;
-  EXPECT_EQ(0u, log.dup_index.size()); // Sanity check
+  EXPECT_EQ(0u, log.dups.size()); // Sanity check
   log.head = mk_evt(24, 0);
   log.skip_can_rollback_to_to_head();
   log.head = mk_evt(9, 0);
@@ -2850,7 +2851,10 @@ TEST_F(PGLogTrimTest, TestTrimAll)
   EXPECT_EQ(6u, trimmed.size());
   EXPECT_EQ(5u, log.dups.size());
   EXPECT_EQ(0u, trimmed_dups.size());
-  EXPECT_EQ(0u, log.dup_index.size()); // dup_index entry should be trimmed
+  for (auto& i : log.dups) {
+    pg_log_dup_t found;
+    EXPECT_TRUE(log.dups.find(i.reqid, &found));
+  }
 }
 
 
@@ -2978,6 +2982,73 @@ TEST(pg_log_dup_t, get_key_name) {
   EXPECT_EQ("dup_0000001234.00000000000000005678", a_key_name);
 }
 
+TEST(pg_log_dups_t, ring) {
+  entity_name_t client = entity_name_t::CLIENT(777);
+  auto mk_dup = [&](unsigned i) {
+    return pg_log_dup_t(eversion_t(1, i), i,
+			osd_reqid_t(client, 8, i), 0);
+  };
+  pg_log_dups_t dups;
+  std::list<pg_log_dup_t> expected;
+  pg_log_dup_t found;
+
+  // slide a window over the ring so that it wraps, grows and shrinks
+  for (unsigned i = 1; i <= 200; ++i) {
+    dups.push_back(mk_dup(i));
+    expected.push_back(mk_dup(i));
+    if (i % 3 == 0) {
+      dups.pop_front();
+      expected.pop_front();
+    }
+  }
+  while (dups.size() > 5) {
+    dups.pop_front();
+    expected.pop_front();
+  }
+  dups.push_front(mk_dup(1000));
+  expected.push_front(mk_dup(1000));
+  dups.pop_back();
+  expected.pop_back();
+
+  ASSERT_EQ(expected.size(), dups.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), dups.begin()));
+  EXPECT_TRUE(std::equal(expected.rbegin(), expected.rend(), dups.rbegin()));
+  for (auto& d : expected) {
+    EXPECT_TRUE(dups.find(d.reqid, &found));
+    EXPECT_EQ(d, found);
+  }
+  EXPECT_FALSE(dups.find(mk_dup(1).reqid, &found));
+  EXPECT_FALSE(dups.find(mk_dup(200).reqid, &found));
+
+  // the newest entry for a reqid wins
+  pg_log_dup_t again = mk_dup(1000);
+  again.version = eversion_t(2, 1);
+  dups.push_back(again);
+  EXPECT_TRUE(dups.find(again.reqid, &found));
+  EXPECT_EQ(again, found);
+  dups.pop_back();
+  EXPECT_TRUE(dups.find(again.reqid, &found));
+  EXPECT_EQ(mk_dup(1000), found);
+
+  // encoded like the list it replaces
+  bufferlist bl, lbl;
+  encode(dups, bl);
+  encode(expected, lbl);
+  EXPECT_TRUE(bl.contents_equal(lbl));
+  pg_log_dups_t decoded;
+  auto p = lbl.cbegin();
+  decode(decoded, p);
+  EXPECT_EQ(dups, decoded);
+  for (auto& d : expected) {
+    EXPECT_TRUE(decoded.find(d.reqid, &found));
+  }
+
+  dups.clear();
+  EXPECT_TRUE(dups.empty());
+  EXPECT_EQ(dups.begin(), dups.end());
+  EXPECT_FALSE(dups.find(mk_dup(1000).reqid, &found));
+}
+
 
 // This tests trim() to make copies of
 // 2 log entries (107, 106) and 3 additional for a total
@@ -122,3 +122,73 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, parity_delta)
+{
+  hobject_t h;
+  ECUtil::stripe_info_t sinfo(4, 16384);
+  auto get_hinfo = [&](const hobject_t &i) {
+    ECUtil::HashInfoRef ref(new ECUtil::HashInfo(6));
+    ref->set_projected_total_logical_size(sinfo, 4 * 16384);
+    return ref;
+  };
+  bufferlist a;
+  a.append_zero(4096);
+
+  // one chunk of the second stripe: read and write that chunk and the two
+  // coding chunks only
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 16384 + 4096, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(0u, plan.to_read.size());
+    ASSERT_TRUE(plan.will_write[h].empty());
+    ASSERT_TRUE(plan.invalidates_cache);
+    ASSERT_EQ(1u, plan.parity_delta.size());
+    ASSERT_EQ(16384u, plan.parity_delta[h].stripe_off);
+    ASSERT_EQ(set<int>({1}), plan.parity_delta[h].data_chunks);
+  }
+
+  // an unaligned write touching two chunks still pays off
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 16384 + 6000, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(1u, plan.parity_delta.size());
+    ASSERT_EQ(set<int>({1, 2}), plan.parity_delta[h].data_chunks);
+  }
+
+  // three of four chunks is cheaper as a plain rmw
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    bufferlist b;
+    b.append_zero(3 * 4096);
+    t->write(h, 16384, b.length(), b, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(0u, plan.parity_delta.size());
+    ASSERT_EQ(1u, plan.to_read.size());
+  }
+
+  // so is anything crossing a stripe boundary, or past the end
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 2 * 16384 - 1024, a.length(), a, 0);
+    t->write(h, 3 * 16384 + 14336, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(0u, plan.parity_delta.size());
+  }
+
+  // and nothing changes unless asked for
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 16384 + 4096, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ASSERT_EQ(0u, plan.parity_delta.size());
+    ASSERT_EQ(1u, plan.to_read.size());
+  }
+}